@@ -1,105 +1,648 @@
 // LED Animation Functions for multi-channel WS2812B driver
 // These functions accept a channel parameter to specify which LED strip to control
-// Animation functions are now non-blocking - call them repeatedly in your main loop
+// Start effects with LED_SetEffect() and call LED_Update() once per frame, or call
+// the LED_* functions repeatedly in your main loop followed by WS2812_Commit()
+// Effects only update the channel buffer and mark it dirty; the commit
+// transmits the channels that changed
+// Effects run on segments: by default segment N is the whole of channel N, and
+// LED_SegmentInit()/LED_SegmentAddSpan() define zones or runs across channels
 
-// Improved timing system for non-blocking animations
-static uint32_t animation_tick_counter = 0;
-
-// Timing function that provides more reasonable timing for animations
+// Effect speeds are in milliseconds of real time, so they do not change with
+// the number of effects, channels or LEDs
 static uint32_t get_animation_ticks(void) {
-    // Increment tick counter more frequently for smoother animations
-    // This provides ~1ms resolution timing based on loop iterations
-    animation_tick_counter++;
-    return animation_tick_counter;
+    return WS2812_Millis();
 }
 
-// Animation state variables (one per channel)
-static uint8_t rainbow_cycle_pos[MAX_LED_CHANNELS] = {0};
-static uint8_t theater_chase_pos[MAX_LED_CHANNELS] = {0};
-static uint8_t color_wipe_pos[MAX_LED_CHANNELS] = {0};
-static uint8_t pulse_brightness[MAX_LED_CHANNELS] = {0};
-static uint8_t pulse_direction[MAX_LED_CHANNELS] = {0}; // 0 = up, 1 = down
-static uint8_t rainbows_pos[MAX_LED_CHANNELS] = {0};
+// Frames rendered late by less than this many periods are caught up back to back;
+// later than that, the missed frames are skipped
+#ifndef LED_SCHEDULER_MAX_CATCH_UP
+#define LED_SCHEDULER_MAX_CATCH_UP 2
+#endif
 
-// Helper function to get a specific channel
-static WS2812_Channel_t* LED_GetChannel(uint8_t channel_idx) {
-    if (channel_idx < MAX_LED_CHANNELS && ws2812_channels[channel_idx].active) {
-        return &ws2812_channels[channel_idx];
+// Fixed-rate frame scheduler state and statistics
+typedef struct {
+    uint32_t period_ticks;         // Frame period in SysTick counts
+    uint32_t next_frame;           // SysTick count the next frame is due
+    uint32_t frames;               // Frames rendered
+    uint32_t missed;               // Frames skipped after an overrun
+    uint32_t jitter_max_us;        // Worst lateness of a frame start
+    uint32_t jitter_sum_us;        // Sum of lateness, divide by frames for the average
+} LED_Scheduler_t;
+
+static LED_Scheduler_t led_scheduler = {0};
+
+#if WS2812_STATS
+// Frame statistics gathered with WS2812_STATS, printed by LED_StatsDump().
+// Channel and segment timers live in the channels and effect slots.
+typedef struct {
+    WS2812_StatTimer_t idle;       // From the end of one LED_Update() to the start of the next
+    uint32_t frames;               // LED_Update() calls since LED_StatsReset()
+    uint32_t overruns;             // Frames that started a whole period or more late
+    uint32_t since;                // SysTick count of LED_StatsReset()
+    uint32_t update_end;           // SysTick count the last LED_Update() returned
+} LED_Stats_t;
+
+static LED_Stats_t led_stats = {0};
+#endif
+
+// Start rendering at a fixed frame rate
+void LED_SchedulerInit(uint16_t fps) {
+    if (fps == 0) fps = 1;
+    
+    memset(&led_scheduler, 0, sizeof(led_scheduler));
+    led_scheduler.period_ticks = WS2812_US_TO_TICKS(1000000UL / fps);
+    led_scheduler.next_frame = WS2812_Now();
+}
+
+// Returns 1 when a frame is due and should be rendered and committed now
+uint8_t LED_FrameDue(void) {
+    int32_t late = (int32_t)(WS2812_Now() - led_scheduler.next_frame);
+    if (late < 0) return 0;
+    
+    uint32_t late_us = (uint32_t)late / WS2812_TICKS_PER_US;
+    led_scheduler.frames++;
+    led_scheduler.jitter_sum_us += late_us;
+    if (late_us > led_scheduler.jitter_max_us) {
+        led_scheduler.jitter_max_us = late_us;
+    }
+#if WS2812_STATS
+    if ((uint32_t)late >= led_scheduler.period_ticks) led_stats.overruns++;
+#endif
+    
+    if ((uint32_t)late >= led_scheduler.period_ticks * LED_SCHEDULER_MAX_CATCH_UP) {
+        // Overrun too large to catch up: skip the missed frames and realign
+        uint32_t behind = (uint32_t)late / led_scheduler.period_ticks;
+        led_scheduler.missed += behind;
+        led_scheduler.next_frame += (behind + 1) * led_scheduler.period_ticks;
+    } else {
+        led_scheduler.next_frame += led_scheduler.period_ticks;
+    }
+    return 1;
+}
+
+#if WS2812_LOW_POWER
+// Sleep until the next frame is due, or until an interrupt (received data, a
+// button) needs the main loop sooner. Call when LED_FrameDue() returned 0.
+void LED_Sleep(void) {
+    WS2812_SleepUntil(led_scheduler.next_frame);
+}
+#endif
+
+// Segments
+// A segment is a logical strip made of up to LED_SEGMENT_MAX_SPANS spans, each
+// a slice of one channel buffer, optionally reversed. Pixels are not copied:
+// effects write straight into the channel buffers through the segment, so one
+// strip can be split into zones or several pins joined into one long run.
+// Segments 0 .. MAX_LED_CHANNELS-1 default to the whole of the matching channel.
+
+// Number of segments (and effect slots)
+#ifndef LED_MAX_SEGMENTS
+#define LED_MAX_SEGMENTS (MAX_LED_CHANNELS + 2)
+#endif
+
+// Maximum number of channel slices in one segment
+#ifndef LED_SEGMENT_MAX_SPANS
+#define LED_SEGMENT_MAX_SPANS 4
+#endif
+
+// A slice of one channel buffer
+typedef struct {
+    uint8_t channel;               // Channel index
+    uint8_t reverse;               // 1 = logical order runs from the end of the slice
+    uint16_t start;                // First LED in the channel
+    uint16_t count;                // Number of LEDs
+} LED_Span_t;
+
+typedef struct {
+    LED_Span_t spans[LED_SEGMENT_MAX_SPANS];
+    uint8_t span_count;
+    uint8_t custom;                // 1 = defined by the user, 0 = channel default
+    uint16_t length;               // Total LEDs, refreshed by LED_GetSegment()
+} LED_Segment_t;
+
+// Walks a segment's pixels in logical order
+typedef struct {
+    const LED_Segment_t* seg;
+    uint8_t span;                  // Next span to start
+    uint16_t left;                 // Pixels left in the current span
+    uint8_t* pixel;                // Next pixel
+    int8_t step;                   // Bytes to the following pixel, 3 or -3
+} LED_SegmentIter_t;
+
+static LED_Segment_t led_segments[LED_MAX_SEGMENTS] = {0};
+
+// LEDs of a span that exist, 0 if its channel is inactive, too short or
+// palette-indexed or a shader channel (those only take LED_EFFECT_PALETTE_* /
+// LED_EFFECT_SHADER_* effects)
+static uint16_t LED_SpanCount(const LED_Span_t* span) {
+    WS2812_Channel_t* ch = &ws2812_channels[span->channel];
+    if (!ch->active || ch->format != WS2812_FORMAT_RGB || span->start >= ch->led_count) return 0;
+    
+    uint16_t available = ch->led_count - span->start;
+    return span->count < available ? span->count : available;
+}
+
+// Get a segment with its length refreshed, NULL if it has no LEDs
+static LED_Segment_t* LED_GetSegment(uint8_t seg_idx) {
+    if (seg_idx >= LED_MAX_SEGMENTS) return NULL;
+    LED_Segment_t* seg = &led_segments[seg_idx];
+    
+    if (!seg->custom) {
+        // Default segment: the whole channel with the same index
+        if (seg_idx >= MAX_LED_CHANNELS) return NULL;
+        seg->span_count = 1;
+        seg->spans[0].channel = seg_idx;
+        seg->spans[0].reverse = 0;
+        seg->spans[0].start = 0;
+        seg->spans[0].count = ws2812_channels[seg_idx].led_count;
+    }
+    
+    seg->length = 0;
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        seg->length += LED_SpanCount(&seg->spans[s]);
+    }
+    return seg->length ? seg : NULL;
+}
+
+// Start a new, empty user-defined segment; add LEDs with LED_SegmentAddSpan()
+uint8_t LED_SegmentInit(uint8_t seg_idx) {
+    if (seg_idx >= LED_MAX_SEGMENTS) return 0;
+    
+    memset(&led_segments[seg_idx], 0, sizeof(LED_Segment_t));
+    led_segments[seg_idx].custom = 1;
+    return 1;
+}
+
+// Append count LEDs of a channel, from start, to the end of a segment.
+// Returns 0 if the segment is full or the slice is outside the channel.
+uint8_t LED_SegmentAddSpan(uint8_t seg_idx, uint8_t channel_idx, uint16_t start, uint16_t count, uint8_t reverse) {
+    if (seg_idx >= LED_MAX_SEGMENTS || channel_idx >= MAX_LED_CHANNELS || count == 0) return 0;
+    LED_Segment_t* seg = &led_segments[seg_idx];
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    if (!seg->custom || seg->span_count >= LED_SEGMENT_MAX_SPANS) return 0;
+    if (!ch->active || start >= ch->led_count || count > ch->led_count - start) return 0;
+    
+    LED_Span_t* span = &seg->spans[seg->span_count++];
+    span->channel = channel_idx;
+    span->reverse = reverse;
+    span->start = start;
+    span->count = count;
+    return 1;
+}
+
+// Return a segment to its default (whole channel, or nothing above MAX_LED_CHANNELS)
+void LED_SegmentReset(uint8_t seg_idx) {
+    if (seg_idx < LED_MAX_SEGMENTS) {
+        memset(&led_segments[seg_idx], 0, sizeof(LED_Segment_t));
+    }
+}
+
+static inline void LED_SegmentBegin(LED_SegmentIter_t* it, const LED_Segment_t* seg) {
+    it->seg = seg;
+    it->span = 0;
+    it->left = 0;
+}
+
+// Next pixel of the segment in logical order, NULL after the last one
+static uint8_t* LED_SegmentNext(LED_SegmentIter_t* it) {
+    while (it->left == 0) {
+        if (it->span >= it->seg->span_count) return NULL;
+        
+        const LED_Span_t* span = &it->seg->spans[it->span++];
+        uint16_t count = LED_SpanCount(span);
+        if (count == 0) continue;
+        
+        WS2812_Channel_t* ch = &ws2812_channels[span->channel];
+        it->left = count;
+        if (span->reverse) {
+            it->pixel = ch->led_buffer[span->start + count - 1];
+            it->step = -3;
+        } else {
+            it->pixel = ch->led_buffer[span->start];
+            it->step = 3;
+        }
+    }
+    
+    uint8_t* pixel = it->pixel;
+    if (--it->left) it->pixel += it->step;
+    return pixel;
+}
+
+// Pixel at a logical position of the segment, NULL if out of range
+static uint8_t* LED_SegmentPixel(const LED_Segment_t* seg, uint16_t position) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        
+        if (position < count) {
+            uint16_t led = span->reverse ? span->start + count - 1 - position : span->start + position;
+            return ws2812_channels[span->channel].led_buffer[led];
+        }
+        position -= count;
     }
     return NULL;
 }
 
-// Turn off all LEDs on the specified channel
-void LED_OFF(uint8_t channel_idx) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+// Mark every channel the segment touches for transmission
+static void LED_SegmentMarkDirty(const LED_Segment_t* seg) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        WS2812_MarkDirty(seg->spans[s].channel);
+    }
+}
+
+static inline void LED_SetRGB(uint8_t* pixel, uint8_t red, uint8_t green, uint8_t blue) {
+    pixel[WS2812_R] = red;
+    pixel[WS2812_G] = green;
+    pixel[WS2812_B] = blue;
+}
+
+// Set one LED of a segment and mark its channel for transmission
+void LED_SegmentSetPixel(uint8_t seg_idx, uint16_t position, uint8_t red, uint8_t green, uint8_t blue) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    if (!seg) return;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;  // Red
-        ch->led_buffer[i][1] = 0;  // Green
-        ch->led_buffer[i][2] = 0;  // Blue
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        
+        if (position < count) {
+            uint16_t led = span->reverse ? span->start + count - 1 - position : span->start + position;
+            LED_SetRGB(ws2812_channels[span->channel].led_buffer[led], red, green, blue);
+            WS2812_MarkDirty(span->channel);
+            return;
+        }
+        position -= count;
     }
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
 }
 
-// Fill with red color
-void LED_RED(uint8_t channel_idx, uint8_t brightness) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+// Number of LEDs in a segment
+uint16_t LED_GetSegmentLength(uint8_t seg_idx) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    return seg ? seg->length : 0;
+}
+
+// Bulk pixel operations
+// These work on runs of pixels (3 bytes each) with 32-bit loads and stores once
+// the pointer is word aligned; channel buffers come from the arena word aligned.
+// Scaling and blending handle two byte lanes per word with a multiply and a
+// shift, never a division.
+
+typedef uint32_t __attribute__((may_alias)) LED_Word_t;
+
+#define LED_LANES_LO 0x00FF00FFUL  // Bytes 0 and 2 of a word; bytes 1 and 3 are this << 8
+
+// Fill count pixels with one colour
+static void LED_BufFill(uint8_t* dst, uint16_t count, uint8_t red, uint8_t green, uint8_t blue) {
+    uint8_t px[3];
+    px[WS2812_R] = red;
+    px[WS2812_G] = green;
+    px[WS2812_B] = blue;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = brightness;  // Red
-        ch->led_buffer[i][1] = 0;           // Green
-        ch->led_buffer[i][2] = 0;           // Blue
+    // Single pixels until dst is word aligned (at most three)
+    while (count && ((uintptr_t)dst & 3)) {
+        dst[0] = px[0];
+        dst[1] = px[1];
+        dst[2] = px[2];
+        dst += 3;
+        count--;
+    }
+    
+    // Four pixels are three words
+    uint32_t w0 = px[0] | (uint32_t)px[1] << 8 | (uint32_t)px[2] << 16 | (uint32_t)px[0] << 24;
+    uint32_t w1 = px[1] | (uint32_t)px[2] << 8 | (uint32_t)px[0] << 16 | (uint32_t)px[1] << 24;
+    uint32_t w2 = px[2] | (uint32_t)px[0] << 8 | (uint32_t)px[1] << 16 | (uint32_t)px[2] << 24;
+    LED_Word_t* w = (LED_Word_t*)dst;
+    for (; count >= 4; count -= 4) {
+        w[0] = w0;
+        w[1] = w1;
+        w[2] = w2;
+        w += 3;
+    }
+    
+    dst = (uint8_t*)w;
+    while (count--) {
+        dst[0] = px[0];
+        dst[1] = px[1];
+        dst[2] = px[2];
+        dst += 3;
     }
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
 }
 
-// Fill with green color
-void LED_GREEN(uint8_t channel_idx, uint8_t brightness) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+// Repeat the first period pixels of dst over all count pixels
+static void LED_BufRepeat(uint8_t* dst, uint16_t count, uint16_t period) {
+    if (period == 0 || period >= count) return;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;           // Red
-        ch->led_buffer[i][1] = brightness;  // Green
-        ch->led_buffer[i][2] = 0;           // Blue
+    // Copy what is already written, doubling each time
+    uint16_t done = period;
+    while (done < count) {
+        uint16_t chunk = done < count - done ? done : count - done;
+        memcpy(dst + done * 3, dst, chunk * 3);
+        done += chunk;
     }
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
 }
 
-// Fill with blue color
-void LED_BLUE(uint8_t channel_idx, uint8_t brightness) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+// Fill count pixels with a repeating pattern of pattern_len pixels (stored
+// like the channel buffer, index with WS2812_R/G/B)
+static void LED_BufFillPattern(uint8_t* dst, uint16_t count, const uint8_t* pattern, uint16_t pattern_len) {
+    if (pattern_len == 0) return;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;           // Red
-        ch->led_buffer[i][1] = 0;           // Green
-        ch->led_buffer[i][2] = brightness;  // Blue
+    uint16_t first = pattern_len < count ? pattern_len : count;
+    memcpy(dst, pattern, first * 3);
+    LED_BufRepeat(dst, count, pattern_len);
+}
+
+// Scale every colour of count pixels by scale/256 (255 = unchanged)
+static void LED_BufScale(uint8_t* buf, uint16_t count, uint8_t scale) {
+    uint32_t bytes = (uint32_t)count * 3;
+    uint16_t factor = scale + 1;
+    
+    while (bytes && ((uintptr_t)buf & 3)) {
+        *buf = (*buf * factor) >> 8;
+        buf++;
+        bytes--;
+    }
+    
+    LED_Word_t* w = (LED_Word_t*)buf;
+    for (; bytes >= 4; bytes -= 4, w++) {
+        uint32_t v = *w;
+        uint32_t lo = (((v & LED_LANES_LO) * factor) >> 8) & LED_LANES_LO;
+        uint32_t hi = (((v >> 8) & LED_LANES_LO) * factor) & ~LED_LANES_LO;
+        *w = lo | hi;
+    }
+    
+    buf = (uint8_t*)w;
+    while (bytes--) {
+        *buf = (*buf * factor) >> 8;
+        buf++;
     }
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
 }
 
-// Fill entire strip with a custom RGB color
-void LED_FILL(uint8_t channel_idx, uint16_t red, uint16_t green, uint16_t blue) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+// Fade count pixels towards black by amount/256
+static inline void LED_BufFade(uint8_t* buf, uint16_t count, uint8_t amount) {
+    LED_BufScale(buf, count, 255 - amount);
+}
+
+// Blend src into dst: amount 0 keeps dst, 255 gives src
+static void LED_BufBlend(uint8_t* dst, const uint8_t* src, uint16_t count, uint8_t amount) {
+    uint32_t bytes = (uint32_t)count * 3;
+    uint16_t take = amount + 1;
+    uint16_t keep = 256 - take;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = (uint8_t)(red > 255 ? 255 : red);
-        ch->led_buffer[i][1] = (uint8_t)(green > 255 ? 255 : green);
-        ch->led_buffer[i][2] = (uint8_t)(blue > 255 ? 255 : blue);
+    // Word path only when both pointers reach alignment together
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) == 0) {
+        while (bytes && ((uintptr_t)dst & 3)) {
+            *dst = (*dst * keep + *src * take) >> 8;
+            dst++;
+            src++;
+            bytes--;
+        }
+        
+        LED_Word_t* d = (LED_Word_t*)dst;
+        const LED_Word_t* s = (const LED_Word_t*)src;
+        for (; bytes >= 4; bytes -= 4, d++, s++) {
+            uint32_t dv = *d, sv = *s;
+            uint32_t lo = (((dv & LED_LANES_LO) * keep + (sv & LED_LANES_LO) * take) >> 8) & LED_LANES_LO;
+            uint32_t hi = (((dv >> 8) & LED_LANES_LO) * keep + ((sv >> 8) & LED_LANES_LO) * take) & ~LED_LANES_LO;
+            *d = lo | hi;
+        }
+        dst = (uint8_t*)d;
+        src = (const uint8_t*)s;
     }
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
+    
+    while (bytes--) {
+        *dst = (*dst * keep + *src * take) >> 8;
+        dst++;
+        src++;
+    }
+}
+
+// Copy count pixels; the ranges may overlap
+static inline void LED_BufCopy(uint8_t* dst, const uint8_t* src, uint16_t count) {
+    memmove(dst, src, (uint32_t)count * 3);
+}
+
+// Reverse the order of count pixels
+static void LED_BufReverse(uint8_t* buf, uint16_t count) {
+    if (count < 2) return;
+    
+    uint8_t* end = buf + (count - 1) * 3;
+    while (buf < end) {
+        for (uint8_t c = 0; c < 3; c++) {
+            uint8_t t = buf[c];
+            buf[c] = end[c];
+            end[c] = t;
+        }
+        buf += 3;
+        end -= 3;
+    }
+}
+
+// Rotate count pixels n places towards the end; pixels leaving the end come
+// back at the start
+static void LED_BufRotate(uint8_t* buf, uint16_t count, uint16_t n) {
+    if (count < 2) return;
+    while (n >= count) n -= count;
+    if (n == 0) return;
+    
+    LED_BufReverse(buf, count);
+    LED_BufReverse(buf, n);
+    LED_BufReverse(buf + n * 3, count - n);
+}
+
+// Shift count pixels n places, towards the end for n > 0 and towards the start
+// for n < 0, filling the pixels left behind with black
+static void LED_BufShift(uint8_t* buf, uint16_t count, int16_t n) {
+    uint16_t places = n < 0 ? -n : n;
+    if (places >= count) {
+        memset(buf, 0, (uint32_t)count * 3);
+        return;
+    }
+    
+    uint32_t kept = (uint32_t)(count - places) * 3;
+    if (n > 0) {
+        memmove(buf + places * 3, buf, kept);
+        memset(buf, 0, places * 3);
+    } else {
+        memmove(buf, buf + places * 3, kept);
+        memset(buf + kept, 0, places * 3);
+    }
+}
+
+// Fill a segment with one colour, one span at a time
+static void LED_SegmentFill(const LED_Segment_t* seg, uint8_t red, uint8_t green, uint8_t blue) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        if (count) LED_BufFill(ws2812_channels[span->channel].led_buffer[span->start], count, red, green, blue);
+    }
+}
+
+// Fill a segment with a pattern of period pixels repeating along its logical
+// order. Each span gets its first period pixels placed one by one (so reversed
+// spans stay in phase) and the rest copied in bulk.
+static void LED_SegmentFillPattern(const LED_Segment_t* seg, const uint8_t* pattern, uint16_t period) {
+    if (period == 0) return;
+    uint16_t phase = 0;            // Pattern position of the span's first logical pixel
+    
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        if (count == 0) continue;
+        
+        uint8_t* dst = ws2812_channels[span->channel].led_buffer[span->start];
+        uint16_t first = period < count ? period : count;
+        for (uint16_t k = 0; k < first; k++) {
+            // Logical position of physical pixel k, taken modulo period
+            uint32_t logical = phase + (span->reverse ? count - 1 - k : k);
+            memcpy(dst + k * 3, pattern + (logical % period) * 3, 3);
+        }
+        LED_BufRepeat(dst, count, period);
+        phase = (phase + count) % period;
+    }
+}
+
+// Scale every pixel of a segment by scale/256
+static void LED_SegmentScale(const LED_Segment_t* seg, uint8_t scale) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        if (count) LED_BufScale(ws2812_channels[span->channel].led_buffer[span->start], count, scale);
+    }
+}
+
+// Fill a segment with one colour and mark it for transmission
+void LED_FillSolid(uint8_t seg_idx, uint8_t red, uint8_t green, uint8_t blue) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    if (!seg) return;
+    
+    LED_SegmentFill(seg, red, green, blue);
+    LED_SegmentMarkDirty(seg);
+}
+
+// Set the white level of every LED of a segment that sits on an RGBW channel
+// and mark it for transmission (see WS2812_SetChipProfile)
+void LED_FillWhite(uint8_t seg_idx, uint8_t white) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    if (!seg) return;
+    
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        WS2812_Channel_t* ch = &ws2812_channels[span->channel];
+        uint16_t count = LED_SpanCount(span);
+        
+        if (count && ch->white_buffer) {
+            memset(ch->white_buffer + span->start, white, count);
+            WS2812_MarkDirty(span->channel);
+        }
+    }
+}
+
+// Fade a segment towards black by amount/256 and mark it for transmission
+void LED_FadeToBlack(uint8_t seg_idx, uint8_t amount) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    if (!seg) return;
+    
+    LED_SegmentScale(seg, 255 - amount);
+    LED_SegmentMarkDirty(seg);
 }
 
-// Wheel function for rainbow effects (returns pointer to 3-byte RGB array)
+// Effect engine
+// Every segment has one effect slot holding a descriptor (render function),
+// its parameters and a compact state block. LED_Update() runs every slot that
+// is due and then commits once, so effects never touch the transmit path.
+// Adding an effect means writing a render function and a descriptor.
+
+typedef struct LED_EffectSlot LED_EffectSlot_t;
+
+// Effect descriptor
+typedef struct {
+    // Advance the effect by steps (>= 1) and draw it into the segment
+    void (*render)(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps);
+    uint8_t kind;                  // LED_KIND_*: what kind of channel it draws on
+} LED_Effect_t;
+
+// Effect kinds
+#define LED_KIND_RGB     0         // Pixels of any segment (default)
+#define LED_KIND_PALETTE 1         // Palette indices of an indexed channel
+#define LED_KIND_SHADER  2         // Generator state of a shader channel
+
+// State blocks of the generators below, for use with WS2812_SetShader()
+typedef struct {
+    uint16_t hue;                  // Hue of LED 0
+    uint16_t delta;                // Hue step per LED (65536 / n = one rainbow every n LEDs)
+    uint16_t next;                 // Hue of the LED produced next
+} LED_RainbowShader_t;
+
+typedef struct {
+    uint8_t colour[3];             // Lit LEDs, stored like a led_buffer pixel (LED_SetRGB)
+    uint8_t pos;                   // LED i is lit when (i + pos) % 3 == 0
+    uint8_t phase;                 // (i + pos) % 3 of the LED produced next
+} LED_ChaseShader_t;
+
+typedef struct {
+    uint8_t colour[3];             // Every LED, stored like a led_buffer pixel (LED_SetRGB)
+} LED_FillShader_t;
+
+// Parameters an effect is started with
+typedef struct {
+    uint8_t red, green, blue;      // Effect colour (flash uses red as brightness)
+    uint16_t speed;                // Step period in ms, 0 = draw once
+    uint16_t width;                // Rainbow width / pixel position
+} LED_EffectParams_t;
+
+// Per-effect state, only the member of the running effect is used
+typedef union {
+    uint16_t pos;                  // Rainbows, theater chase, colour wipe, flash
+    struct {
+        uint8_t level;             // Pulse brightness
+        uint8_t down;              // 0 = pulsing up, 1 = pulsing down
+    } pulse;
+    struct {
+        uint8_t drawn;             // Indices drawn, later steps only rotate the palette
+        uint8_t on;                // Palette flash state
+    } palette;
+    struct {
+        LED_RainbowShader_t shader;
+        uint8_t pos;               // As pos for the buffered rainbows
+    } rainbow;                     // Shader rainbows
+    struct {
+        LED_ChaseShader_t shader;
+        uint8_t pos;               // As pos for the buffered theater chase
+    } chase;                       // Shader theater chase
+    struct {
+        LED_FillShader_t shader;
+        uint8_t level;             // As for the buffered pulse
+        uint8_t down;
+    } fill;                        // Shader pulse
+} LED_EffectState_t;
+
+struct LED_EffectSlot {
+    const LED_Effect_t* effect;    // Running effect, NULL if none
+    LED_EffectParams_t params;
+    LED_EffectState_t state;
+    uint8_t pending;               // 1 until a draw-once effect has been drawn
+    uint32_t last_step;            // Millisecond time of the last step
+#if WS2812_STATS
+    WS2812_StatTimer_t stat_render;  // Time spent in the effect's render function
+#endif
+};
+
+static LED_EffectSlot_t led_slots[LED_MAX_SEGMENTS] = {0};
+
+// Build an LED_EffectParams_t in place
+#define LED_PARAMS(r, g, b, speed, width) ((LED_EffectParams_t){ (r), (g), (b), (speed), (width) })
+
+// Helper function to get a specific channel
+static WS2812_Channel_t* LED_GetChannel(uint8_t channel_idx) {
+    if (channel_idx < MAX_LED_CHANNELS && ws2812_channels[channel_idx].active) {
+        return &ws2812_channels[channel_idx];
+    }
+    return NULL;
+}
+
+// Wheel function for rainbow effects (returns pointer to 3-byte RGB array).
+// Kept for existing code; new code should use LED_HSV16ToRGB(), which is re-entrant.
 uint8_t * Wheel(uint8_t WheelPos) {
     static uint8_t c[3];
     
@@ -121,217 +664,808 @@ uint8_t * Wheel(uint8_t WheelPos) {
     return c;
 }
 
-// Rainbow cycle effect (non-blocking - call repeatedly)
-void LED_RAINBOW_CYCLE(uint8_t channel_idx, uint16_t speed) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
+// Scale an 8-bit value by an 8-bit factor (255 = unchanged)
+static inline uint8_t LED_Scale8(uint8_t value, uint8_t scale) {
+    return ((uint16_t)value * (scale + 1)) >> 8;
+}
+
+// Red, green and blue of each hue sector as 2-bit picks from {0, rise, fall, 255}
+static const uint8_t led_hsv_sectors[6] = {
+    3 | 1 << 2 | 0 << 4,  // red to yellow
+    2 | 3 << 2 | 0 << 4,  // yellow to green
+    0 | 3 << 2 | 1 << 4,  // green to cyan
+    0 | 2 << 2 | 3 << 4,  // cyan to blue
+    1 | 0 << 2 | 3 << 4,  // blue to magenta
+    3 | 0 << 2 | 2 << 4,  // magenta to red
+};
+
+// Fixed-point HSV to RGB. Hue is 16-bit (0-65535 is one turn, red, green, blue);
+// saturation and value are 0-255. Re-entrant, no division, and the multiplies are
+// skipped at full saturation and value, the rainbow case.
+static void LED_HSV16ToRGB(uint16_t hue, uint8_t sat, uint8_t val, uint8_t rgb[3]) {
+    // hue * 6 with shifts: the top bits pick the sector, the next 8 its ramp
+    uint32_t h6 = ((uint32_t)hue << 2) + ((uint32_t)hue << 1);
+    uint8_t rise = h6 >> 8;
+    uint8_t level[4] = {0, rise, (uint8_t)(255 - rise), 255};
+    uint8_t pick = led_hsv_sectors[h6 >> 16];
+    uint8_t r = level[pick & 3];
+    uint8_t g = level[(pick >> 2) & 3];
+    uint8_t b = level[pick >> 4];
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+    if (sat != 255) {
+        // Blend towards white
+        uint8_t white = 255 - sat;
+        r = LED_Scale8(r, sat) + white;
+        g = LED_Scale8(g, sat) + white;
+        b = LED_Scale8(b, sat) + white;
+    }
+    if (val != 255) {
+        r = LED_Scale8(r, val);
+        g = LED_Scale8(g, val);
+        b = LED_Scale8(b, val);
+    }
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+}
+
+// Fill a segment with a rainbow: hue starts at start_hue and advances by
+// delta_hue per LED (65536 / n gives one full rainbow every n LEDs)
+static void LED_SegmentRainbow(LED_Segment_t* seg, uint16_t start_hue, uint16_t delta_hue) {
+    uint16_t hue = start_hue;
+    uint8_t rgb[3];
+    LED_SegmentIter_t it;
+    uint8_t* px;
     
-    last_update[channel_idx] = current_time;
+    LED_SegmentBegin(&it, seg);
+    while ((px = LED_SegmentNext(&it))) {
+        LED_HSV16ToRGB(hue, 255, 255, rgb);
+        LED_SetRGB(px, rgb[0], rgb[1], rgb[2]);
+        hue += delta_hue;
+    }
+}
+
+// Fill a segment with a rainbow and mark it for transmission
+void LED_FillRainbow(uint8_t seg_idx, uint16_t start_hue, uint16_t delta_hue) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    if (!seg) return;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        uint8_t* color = Wheel((i + rainbow_cycle_pos[channel_idx]) & 255);
-        ch->led_buffer[i][0] = color[0];
-        ch->led_buffer[i][1] = color[1];
-        ch->led_buffer[i][2] = color[2];
+    LED_SegmentRainbow(seg, start_hue, delta_hue);
+    LED_SegmentMarkDirty(seg);
+}
+
+// Fill the whole segment with one colour
+static void LED_Render_Fill(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    (void)steps;
+    LED_SegmentFill(seg, slot->params.red, slot->params.green, slot->params.blue);
+}
+
+// One lit pixel at params.width, the rest off
+static void LED_Render_SinglePixel(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    (void)steps;
+    LED_SegmentFill(seg, 0, 0, 0);
+    
+    uint8_t* px = LED_SegmentPixel(seg, slot->params.width);
+    if (px) {
+        LED_SetRGB(px, slot->params.red, slot->params.green, slot->params.blue);
     }
+}
+
+// Rainbow spread over 256 LEDs, moving one LED per step
+static void LED_Render_RainbowCycle(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t pos = slot->state.pos + steps - 1;
     
-    WS2812_SendAll();
+    LED_SegmentRainbow(seg, (uint16_t)pos << 8, 256);
+    slot->state.pos = (uint8_t)(pos + 1);
+}
+
+// Rainbow repeating every params.width LEDs
+static void LED_Render_Rainbows(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint16_t width = slot->params.width ? slot->params.width : 1;
+    uint8_t pos = slot->state.pos + steps - 1;
     
-    rainbow_cycle_pos[channel_idx] = (rainbow_cycle_pos[channel_idx] + 1) & 255;
+    // One division per frame instead of one per pixel
+    LED_SegmentRainbow(seg, (uint16_t)pos << 8, (uint16_t)(65536UL / width));
+    slot->state.pos = (uint8_t)(pos + 1);
 }
 
-// Theater chase effect (non-blocking - call repeatedly)
-void LED_THEATER_CHASE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
+// Every third pixel lit, moving one pixel per step
+static void LED_Render_TheaterChase(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t pos = (slot->state.pos + steps - 1) % 3;
+    uint8_t pattern[3][3] = {{0}};
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+    // Pixel i is lit when (i + pos) % 3 == 0
+    LED_SetRGB(pattern[pos ? 3 - pos : 0], slot->params.red, slot->params.green, slot->params.blue);
+    LED_SegmentFillPattern(seg, pattern[0], 3);
+    slot->state.pos = (pos + 1) % 3;
+}
+
+// Paint one more pixel per step, then start over
+static void LED_Render_ColourWipe(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    while (steps--) {
+        if (slot->state.pos < seg->length) {
+            LED_SetRGB(LED_SegmentPixel(seg, slot->state.pos),
+                       slot->params.red, slot->params.green, slot->params.blue);
+            slot->state.pos++;
+        } else {
+            // Reset for next wipe
+            slot->state.pos = 0;
+        }
+    }
+}
+
+// Move a pulse up and down by steps brightness levels, returns the level to draw
+static uint8_t LED_PulseStep(uint8_t* level_state, uint8_t* down, uint8_t steps) {
+    uint8_t level = *level_state;
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+    while (steps--) {
+        level = *level_state;
+        
+        if (*down == 0) { // Pulsing up
+            if (++*level_state == 255) *down = 1;
+        } else { // Pulsing down
+            if (--*level_state == 0) *down = 0;
+        }
+    }
+    return level;
+}
+
+// Fade the colour up and down, one brightness level per step
+static void LED_Render_Pulse(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t level = LED_PulseStep(&slot->state.pulse.level, &slot->state.pulse.down, steps);
+    
+    LED_SegmentFill(seg, LED_Scale8(slot->params.red, level),
+                         LED_Scale8(slot->params.green, level),
+                         LED_Scale8(slot->params.blue, level));
+}
+
+// Whole segment red, green, blue in turn at brightness params.red
+static void LED_Render_RGBFlash(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t state = (slot->state.pos + steps - 1) % 3;
+    uint8_t level = slot->params.red;
     
-    last_update[channel_idx] = current_time;
+    LED_SegmentFill(seg, state == 0 ? level : 0, state == 1 ? level : 0, state == 2 ? level : 0);
     
-    // Clear all pixels
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;
-        ch->led_buffer[i][1] = 0;
-        ch->led_buffer[i][2] = 0;
+    // Cycle through colors: Red -> Green -> Blue -> Red...
+    slot->state.pos = (state + 1) % 3;
+}
+
+// Effect descriptors
+static const LED_Effect_t LED_EFFECT_FILL = { .render = LED_Render_Fill, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_SINGLE_PIXEL = { .render = LED_Render_SinglePixel, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_RAINBOW_CYCLE = { .render = LED_Render_RainbowCycle, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_RAINBOWS = { .render = LED_Render_Rainbows, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_THEATER_CHASE = { .render = LED_Render_TheaterChase, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_COLOUR_WIPE = { .render = LED_Render_ColourWipe, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_PULSE = { .render = LED_Render_Pulse, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_RGB_FLASH = { .render = LED_Render_RGBFlash, .kind = LED_KIND_RGB };
+
+// Palette effects
+// Effects for indexed channels (WS2812_SetPaletteMode), started with
+// LED_SetEffect() on the channel's own segment. They draw palette indices, so
+// params.red is the palette index to draw with and the colours come from the
+// palette. Effects that move colours along the strip draw the indices once
+// and then only rotate the palette, so a step costs the same for any strip length.
+
+// Fill a RAM palette with entries colours of a full rainbow
+void LED_PaletteRainbow(uint8_t (*palette)[3], uint16_t entries) {
+    uint16_t step = entries ? (uint16_t)(65536UL / entries) : 0;
+    uint16_t hue = 0;
+    
+    for (uint16_t i = 0; i < entries; i++) {
+        uint8_t rgb[3];
+        LED_HSV16ToRGB(hue, 255, 255, rgb);
+        LED_SetRGB(palette[i], rgb[0], rgb[1], rgb[2]);
+        hue += step;
     }
+}
+
+// Fill a RAM palette with a ramp from one colour to another and back, so
+// rotating it fades smoothly (e.g. black to a colour for LED_EFFECT_PALETTE_PULSE)
+void LED_PaletteGradient(uint8_t (*palette)[3], uint16_t entries,
+                         uint8_t r1, uint8_t g1, uint8_t b1, uint8_t r2, uint8_t g2, uint8_t b2) {
+    uint16_t half = entries >> 1;
+    
+    for (uint16_t i = 0; i < entries; i++) {
+        uint16_t t = i < half ? i : entries - i;
+        uint8_t amount = half ? (uint8_t)((t * 255U) / half) : 0;
+        LED_SetRGB(palette[i], LED_Scale8(r1, 255 - amount) + LED_Scale8(r2, amount),
+                               LED_Scale8(g1, 255 - amount) + LED_Scale8(g2, amount),
+                               LED_Scale8(b1, 255 - amount) + LED_Scale8(b2, amount));
+    }
+}
+
+// Channel behind a palette or shader effect's segment
+static inline WS2812_Channel_t* LED_SegmentChannel(const LED_Segment_t* seg) {
+    return &ws2812_channels[seg->spans[0].channel];
+}
+
+// Spread the whole palette over every period LEDs, without a division per LED
+static void LED_PaletteSpread(WS2812_Channel_t* ch, uint16_t period) {
+    uint32_t step = ((uint32_t)(ch->palette_mask + 1) << 16) / (period ? period : 1);
+    uint32_t acc = 0;
     
-    // Turn every third pixel on based on current position
     for (uint16_t i = 0; i < ch->led_count; i++) {
-        if ((i + theater_chase_pos[channel_idx]) % 3 == 0) {
-            ch->led_buffer[i][0] = red;
-            ch->led_buffer[i][1] = green;
-            ch->led_buffer[i][2] = blue;
-        }
+        WS2812_SetPixelIndexOf(ch, i, (uint8_t)(acc >> 16));
+        acc += step;
     }
+}
+
+// Every LED at palette index params.red
+static void LED_Render_PaletteFill(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    (void)steps;
+    WS2812_FillIndexOf(LED_SegmentChannel(seg), 0, seg->length, slot->params.red);
+}
+
+// LED params.width at index params.red, the rest at index 0
+static void LED_Render_PaletteSinglePixel(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
+    (void)steps;
     
-    WS2812_SendAll();
+    WS2812_FillIndexOf(ch, 0, seg->length, 0);
+    if (slot->params.width < seg->length) {
+        WS2812_SetPixelIndexOf(ch, slot->params.width, slot->params.red);
+    }
+}
+
+// The palette spread once over the strip, rotating one entry per step
+static void LED_Render_PaletteCycle(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    theater_chase_pos[channel_idx] = (theater_chase_pos[channel_idx] + 1) % 3;
+    if (!slot->state.palette.drawn) {
+        LED_PaletteSpread(ch, seg->length);
+        slot->state.palette.drawn = 1;
+    } else {
+        ch->palette_offset += steps;
+    }
 }
 
-// Color wipe effect (non-blocking - call repeatedly)
-void LED_COLOUR_WIPE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
+// The palette repeating every params.width LEDs, rotating one entry per step
+static void LED_Render_PaletteRainbows(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+    if (!slot->state.palette.drawn) {
+        LED_PaletteSpread(ch, slot->params.width);
+        slot->state.palette.drawn = 1;
+    } else {
+        ch->palette_offset += steps;
+    }
+}
+
+// Every third LED at index params.red, the rest at index 0, moving one LED per step
+static void LED_Render_PaletteTheaterChase(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
+    uint8_t pos = (slot->state.pos + steps - 1) % 3;
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+    // LED i is lit when (i + pos) % 3 == 0
+    uint8_t phase = pos;
+    for (uint16_t i = 0; i < seg->length; i++) {
+        WS2812_SetPixelIndexOf(ch, i, phase ? 0 : slot->params.red);
+        if (++phase == 3) phase = 0;
+    }
+    slot->state.pos = (pos + 1) % 3;
+}
+
+// Set one more LED to index params.red per step, then start over
+static void LED_Render_PaletteColourWipe(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    last_update[channel_idx] = current_time;
+    while (steps--) {
+        if (slot->state.pos < seg->length) {
+            WS2812_SetPixelIndexOf(ch, slot->state.pos++, slot->params.red);
+        } else {
+            // Reset for next wipe
+            slot->state.pos = 0;
+        }
+    }
+}
+
+// Every LED at index params.red, stepping through the palette one entry per
+// step (with an LED_PaletteGradient() palette this is a pulse)
+static void LED_Render_PalettePulse(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    if (color_wipe_pos[channel_idx] < ch->led_count) {
-        ch->led_buffer[color_wipe_pos[channel_idx]][0] = red;
-        ch->led_buffer[color_wipe_pos[channel_idx]][1] = green;
-        ch->led_buffer[color_wipe_pos[channel_idx]][2] = blue;
-        
-        WS2812_SendAll();
-        
-        color_wipe_pos[channel_idx]++;
+    if (!slot->state.palette.drawn) {
+        WS2812_FillIndexOf(ch, 0, seg->length, slot->params.red);
+        slot->state.palette.drawn = 1;
     } else {
-        // Reset for next wipe
-        color_wipe_pos[channel_idx] = 0;
+        ch->palette_offset += steps;
     }
 }
 
-// Single pixel control
-void LED_SINGLE_PIXEL(uint8_t channel_idx, uint16_t position, uint8_t red, uint8_t green, uint8_t blue) {
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch || position >= ch->led_count) return;
+// Every LED flashing between palette entry params.red and entry 0, once per step
+static void LED_Render_PaletteFlash(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    // Clear all pixels
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;
-        ch->led_buffer[i][1] = 0;
-        ch->led_buffer[i][2] = 0;
+    if (!slot->state.palette.drawn) {
+        WS2812_FillIndexOf(ch, 0, seg->length, 0);
+        slot->state.palette.drawn = 1;
+        slot->state.palette.on = 1;
+    } else {
+        slot->state.palette.on ^= steps & 1;
     }
+    ch->palette_offset = slot->state.palette.on ? slot->params.red : 0;
+}
+
+static const LED_Effect_t LED_EFFECT_PALETTE_FILL = { .render = LED_Render_PaletteFill, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_SINGLE_PIXEL = { .render = LED_Render_PaletteSinglePixel, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_CYCLE = { .render = LED_Render_PaletteCycle, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_RAINBOWS = { .render = LED_Render_PaletteRainbows, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_THEATER_CHASE = { .render = LED_Render_PaletteTheaterChase, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_COLOUR_WIPE = { .render = LED_Render_PaletteColourWipe, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_PULSE = { .render = LED_Render_PalettePulse, .kind = LED_KIND_PALETTE };
+static const LED_Effect_t LED_EFFECT_PALETTE_FLASH = { .render = LED_Render_PaletteFlash, .kind = LED_KIND_PALETTE };
+
+// Shader effects
+// Effects for shader channels (WS2812_SetShader), started with LED_SetEffect()
+// on the channel's own segment. They point the channel at one of the generators
+// below with its state block in the effect slot; a step only updates that
+// state, so it costs the same for any strip length, and the pixels are made as
+// the frame is sent. Each draws the same frames as the buffered effect of the same name.
+#if WS2812_SHADER
+
+// Generator: a rainbow starting at hue, advancing by delta per LED
+void LED_ShaderRainbow(void* state, uint16_t i, uint8_t pixel[3]) {
+    LED_RainbowShader_t* s = (LED_RainbowShader_t*)state;
+    uint8_t rgb[3];
     
-    // Set the specified pixel
-    ch->led_buffer[position][0] = red;
-    ch->led_buffer[position][1] = green;
-    ch->led_buffer[position][2] = blue;
+    if (i == 0) s->next = s->hue;
+    LED_HSV16ToRGB(s->next, 255, 255, rgb);
+    LED_SetRGB(pixel, rgb[0], rgb[1], rgb[2]);
+    s->next += s->delta;
+}
+
+// Generator: every third LED lit, the rest off
+void LED_ShaderChase(void* state, uint16_t i, uint8_t pixel[3]) {
+    LED_ChaseShader_t* s = (LED_ChaseShader_t*)state;
     
-    //WS2812_SendChannel(ch);
-    WS2812_SendAll();
+    if (i == 0) s->phase = s->pos;
+    if (s->phase == 0) {
+        pixel[0] = s->colour[0];
+        pixel[1] = s->colour[1];
+        pixel[2] = s->colour[2];
+    } else {
+        pixel[0] = pixel[1] = pixel[2] = 0;
+    }
+    s->phase = (s->phase == 2) ? 0 : s->phase + 1;
 }
 
-// Pulse effect (non-blocking - call repeatedly)
-void LED_PULSE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
+// Generator: every LED one colour
+void LED_ShaderFill(void* state, uint16_t i, uint8_t pixel[3]) {
+    const LED_FillShader_t* s = (const LED_FillShader_t*)state;
+    (void)i;
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+    pixel[0] = s->colour[0];
+    pixel[1] = s->colour[1];
+    pixel[2] = s->colour[2];
+}
+
+// Point a shader effect's channel at its generator and state, after waiting
+// for a DMA backend to finish the frame it is generating from the old state
+static void LED_ShaderBind(const LED_Segment_t* seg, WS2812_Shader_t shader, void* state) {
+    WS2812_Channel_t* ch = LED_SegmentChannel(seg);
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+    WS2812_WaitIdle(ch);
+    if (ch->shader != shader || ch->shader_state != state) {
+        WS2812_SetShader(seg->spans[0].channel, 0, shader, state);
+    }
+}
+
+// Rainbow spread over 256 LEDs, moving one LED per step
+static void LED_Render_ShaderRainbowCycle(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t pos = slot->state.rainbow.pos + steps - 1;
     
-    last_update[channel_idx] = current_time;
+    LED_ShaderBind(seg, LED_ShaderRainbow, &slot->state.rainbow.shader);
+    slot->state.rainbow.shader.hue = (uint16_t)pos << 8;
+    slot->state.rainbow.shader.delta = 256;
+    slot->state.rainbow.pos = (uint8_t)(pos + 1);
+}
+
+// Rainbow repeating every params.width LEDs
+static void LED_Render_ShaderRainbows(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint16_t width = slot->params.width ? slot->params.width : 1;
+    uint8_t pos = slot->state.rainbow.pos + steps - 1;
     
-    uint8_t r = (uint16_t)red * pulse_brightness[channel_idx] / 255;
-    uint8_t g = (uint16_t)green * pulse_brightness[channel_idx] / 255;
-    uint8_t b = (uint16_t)blue * pulse_brightness[channel_idx] / 255;
+    LED_ShaderBind(seg, LED_ShaderRainbow, &slot->state.rainbow.shader);
+    slot->state.rainbow.shader.hue = (uint16_t)pos << 8;
+    slot->state.rainbow.shader.delta = (uint16_t)(65536UL / width);
+    slot->state.rainbow.pos = (uint8_t)(pos + 1);
+}
+
+// Every third pixel lit, moving one pixel per step
+static void LED_Render_ShaderTheaterChase(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t pos = (slot->state.chase.pos + steps - 1) % 3;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = r;
-        ch->led_buffer[i][1] = g;
-        ch->led_buffer[i][2] = b;
-    }
+    LED_ShaderBind(seg, LED_ShaderChase, &slot->state.chase.shader);
+    LED_SetRGB(slot->state.chase.shader.colour, slot->params.red, slot->params.green, slot->params.blue);
+    slot->state.chase.shader.pos = pos;
+    slot->state.chase.pos = (pos + 1) % 3;
+}
+
+// Fade the colour up and down, one brightness level per step
+static void LED_Render_ShaderPulse(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    uint8_t level = LED_PulseStep(&slot->state.fill.level, &slot->state.fill.down, steps);
     
-    WS2812_SendAll();
+    LED_ShaderBind(seg, LED_ShaderFill, &slot->state.fill.shader);
+    LED_SetRGB(slot->state.fill.shader.colour, LED_Scale8(slot->params.red, level),
+                                               LED_Scale8(slot->params.green, level),
+                                               LED_Scale8(slot->params.blue, level));
+}
+
+static const LED_Effect_t LED_EFFECT_SHADER_RAINBOW_CYCLE = { .render = LED_Render_ShaderRainbowCycle, .kind = LED_KIND_SHADER };
+static const LED_Effect_t LED_EFFECT_SHADER_RAINBOWS = { .render = LED_Render_ShaderRainbows, .kind = LED_KIND_SHADER };
+static const LED_Effect_t LED_EFFECT_SHADER_THEATER_CHASE = { .render = LED_Render_ShaderTheaterChase, .kind = LED_KIND_SHADER };
+static const LED_Effect_t LED_EFFECT_SHADER_PULSE = { .render = LED_Render_ShaderPulse, .kind = LED_KIND_SHADER };
+#endif
+
+// Start an effect on a segment, replacing whatever ran there (O(1)).
+// Segment indices below MAX_LED_CHANNELS are whole channels unless redefined.
+void LED_SetEffect(uint8_t seg_idx, const LED_Effect_t* effect, LED_EffectParams_t params) {
+    if (seg_idx >= LED_MAX_SEGMENTS) return;
+    LED_EffectSlot_t* slot = &led_slots[seg_idx];
     
-    if (pulse_direction[channel_idx] == 0) { // Pulsing up
-        pulse_brightness[channel_idx]++;
-        if (pulse_brightness[channel_idx] >= 255) {
-            pulse_direction[channel_idx] = 1; // Start pulsing down
+    slot->effect = effect;
+    slot->params = params;
+    memset(&slot->state, 0, sizeof(slot->state));
+    slot->pending = 1;
+}
+
+// Stop the effect on a segment, leaving its pixels as they are
+void LED_StopEffect(uint8_t seg_idx) {
+    if (seg_idx < LED_MAX_SEGMENTS) {
+        led_slots[seg_idx].effect = NULL;
+    }
+}
+
+// Crossfade transitions, available with WS2812_DOUBLE_BUFFER
+// LED_SetEffectTransition() snapshots the segment's last frame into the pixel
+// arena and starts the new effect. Effects keep drawing their own frames in the
+// back buffers; after each swap the snapshot is blended over the front buffers,
+// fading from the outgoing frame to the live incoming effect.
+#ifndef LED_TRANSITIONS
+#define LED_TRANSITIONS WS2812_DOUBLE_BUFFER
+#endif
+
+#if LED_TRANSITIONS && !WS2812_DOUBLE_BUFFER
+#error "LED_TRANSITIONS needs WS2812_DOUBLE_BUFFER"
+#endif
+
+#if LED_TRANSITIONS
+typedef struct {
+    uint8_t* snapshot;             // Outgoing frame, span after span, in the pixel arena
+    uint16_t length;               // Segment length when the snapshot was taken
+    uint16_t duration;             // Fade time in ms, 0 = no transition running
+    uint32_t start;                // Millisecond time the fade started
+} LED_Transition_t;
+
+static LED_Transition_t led_transitions[LED_MAX_SEGMENTS] = {0};
+
+// Copy a segment's drawn pixels into buf, span after span
+static void LED_SegmentSave(const LED_Segment_t* seg, uint8_t* buf) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        if (count == 0) continue;
+        
+        LED_BufCopy(buf, ws2812_channels[span->channel].led_buffer[span->start], count);
+        buf += count * 3;
+    }
+}
+
+// Blend buf (laid out by LED_SegmentSave) into the front buffers of the
+// segment's spans on channel_mask: amount 0 leaves the frame, 255 shows buf
+static void LED_SegmentBlendFront(const LED_Segment_t* seg, const uint8_t* buf, uint8_t channel_mask, uint8_t amount) {
+    for (uint8_t s = 0; s < seg->span_count; s++) {
+        const LED_Span_t* span = &seg->spans[s];
+        uint16_t count = LED_SpanCount(span);
+        if (count == 0) continue;
+        
+        if (channel_mask & (1 << span->channel)) {
+            LED_BufBlend(ws2812_channels[span->channel].front_buffer[span->start], buf, count, amount);
         }
-    } else { // Pulsing down
-        pulse_brightness[channel_idx]--;
-        if (pulse_brightness[channel_idx] <= 0) {
-            pulse_direction[channel_idx] = 0; // Start pulsing up again
+        buf += count * 3;
+    }
+}
+
+static void LED_StopTransition(LED_Transition_t* t) {
+    WS2812_ArenaFree((void**)&t->snapshot);
+    t->duration = 0;
+}
+
+// Present callback: fade every running transition one frame further
+static void LED_PresentTransitions(uint8_t channel_mask) {
+    uint32_t now = get_animation_ticks();
+    uint8_t running = 0;
+    
+    for (uint8_t i = 0; i < LED_MAX_SEGMENTS; i++) {
+        LED_Transition_t* t = &led_transitions[i];
+        if (!t->duration) continue;
+        
+        LED_Segment_t* seg = LED_GetSegment(i);
+        uint32_t elapsed = now - t->start;
+        if (!seg || seg->length != t->length || elapsed >= t->duration) {
+            LED_StopTransition(t);
+            continue;
         }
+        
+        // Weight of the outgoing frame, one division per segment per frame
+        uint8_t outgoing = 255 - elapsed * 255 / t->duration;
+        LED_SegmentBlendFront(seg, t->snapshot, channel_mask, outgoing);
+        running = 1;
+    }
+    
+    if (!running) {
+        WS2812_SetPresentCallback(NULL);
     }
 }
 
-// Rainbow effect with configurable width (non-blocking - call repeatedly)
-void LED_RAINBOWS(uint8_t channel_idx, uint16_t speed, uint16_t width) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
+// Start an effect on a segment, fading over duration_ms from what it shows now.
+// Without room in the arena for the snapshot the change is a hard cut.
+void LED_SetEffectTransition(uint8_t seg_idx, const LED_Effect_t* effect, LED_EffectParams_t params, uint16_t duration_ms) {
+    LED_Segment_t* seg = LED_GetSegment(seg_idx);
+    LED_SetEffect(seg_idx, effect, params);
+    if (!seg) return;
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch || width == 0) return;
+    LED_Transition_t* t = &led_transitions[seg_idx];
+    if (duration_ms == 0 || !WS2812_ArenaAlloc((void**)&t->snapshot, seg->length * 3)) {
+        LED_StopTransition(t);
+        return;
+    }
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+    LED_SegmentSave(seg, t->snapshot);
+    t->length = seg->length;
+    t->duration = duration_ms;
+    t->start = get_animation_ticks();
+    WS2812_SetPresentCallback(LED_PresentTransitions);
+}
+
+// 1 while a segment is fading between effects
+uint8_t LED_InTransition(uint8_t seg_idx) {
+    return seg_idx < LED_MAX_SEGMENTS && led_transitions[seg_idx].duration != 0;
+}
+#endif
+
+// The whole-channel segment of an indexed or shader channel, for palette and
+// shader effects; NULL unless seg_idx is a default segment on a channel of that kind
+static LED_Segment_t* LED_GetChannelSegment(uint8_t seg_idx, uint8_t kind) {
+    if (seg_idx >= MAX_LED_CHANNELS || led_segments[seg_idx].custom) return NULL;
+    WS2812_Channel_t* ch = &ws2812_channels[seg_idx];
+    if (!ch->active) return NULL;
+    if (kind == LED_KIND_PALETTE ? !WS2812_IsIndexed(ch) : ch->format != WS2812_FORMAT_SHADER) return NULL;
     
-    last_update[channel_idx] = current_time;
+    LED_Segment_t* seg = &led_segments[seg_idx];
+    seg->span_count = 1;
+    seg->spans[0].channel = seg_idx;
+    seg->spans[0].reverse = 0;
+    seg->spans[0].start = 0;
+    seg->spans[0].count = ch->led_count;
+    seg->length = ch->led_count;
+    return seg;
+}
+
+// Run a segment's effect if it is due, returns 1 if its pixels were redrawn
+static uint8_t LED_RunSlot(uint8_t seg_idx, uint32_t now) {
+    LED_EffectSlot_t* slot = &led_slots[seg_idx];
+    if (!slot->effect) return 0;
+    LED_Segment_t* seg = slot->effect->kind ? LED_GetChannelSegment(seg_idx, slot->effect->kind) : LED_GetSegment(seg_idx);
+    if (!seg) return 0;
     
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        uint8_t* color = Wheel((uint8_t)((i * 256 / width + rainbows_pos[channel_idx]) & 255));
-        ch->led_buffer[i][0] = color[0];
-        ch->led_buffer[i][1] = color[1];
-        ch->led_buffer[i][2] = color[2];
-    }
+    uint8_t steps = 1;
     
-    WS2812_SendAll();
+    if (slot->pending) {
+        // First draw happens straight away
+        slot->pending = 0;
+        slot->last_step = now;
+    } else {
+        if (slot->params.speed == 0) return 0;
+        
+        uint32_t elapsed = now - slot->last_step;
+        if (elapsed < slot->params.speed) return 0;
+        
+        // Catch up on every step that fell due, so speed stays in real time
+        uint32_t due = elapsed / slot->params.speed;
+        if (due > 255) {
+            steps = 255;
+            slot->last_step = now;
+        } else {
+            steps = due;
+            slot->last_step += due * slot->params.speed;
+        }
+    }
     
-    rainbows_pos[channel_idx] = (rainbows_pos[channel_idx] + 1) & 255;
+    WS2812_STATS_START(render_start);
+    slot->effect->render(seg, slot, steps);
+    WS2812_STATS_STOP(slot->stat_render, render_start);
+    LED_SegmentMarkDirty(seg);
+    return 1;
 }
 
-// Flash RGB colors (non-blocking - call repeatedly)
-// Note: speed parameter is in animation ticks (loop iterations), not milliseconds
-// Typical values: 10-50 for fast flashing, 100-500 for slower transitions
-// THIS FUNCTION CURRENTLY CAUSES TIMING ISSUES - USE WITH CAUTION
-void LED_RGB_FLASH(uint8_t channel_idx, uint16_t speed, uint8_t brightness) {
-    static uint32_t last_update[MAX_LED_CHANNELS] = {0};
-    static uint8_t flash_state[MAX_LED_CHANNELS] = {0};
+// Run every effect that is due, then send the channels that changed once;
+// channels touched by several segments are still sent once, in parallel
+void LED_Update(void) {
+    uint32_t now = get_animation_ticks();
+    
+#if WS2812_STATS
+    if (led_stats.frames++) {
+        WS2812_STATS_ADD(led_stats.idle, WS2812_Now() - led_stats.update_end);
+    }
+#endif
     
-    WS2812_Channel_t* ch = LED_GetChannel(channel_idx);
-    if (!ch) return;
+    for (uint8_t i = 0; i < LED_MAX_SEGMENTS; i++) {
+        LED_RunSlot(i, now);
+#if LED_TRANSITIONS
+        // A fading segment changes every frame even when its effect does not
+        LED_Segment_t* seg;
+        if (led_transitions[i].duration && (seg = LED_GetSegment(i))) {
+            LED_SegmentMarkDirty(seg);
+        }
+#endif
+    }
+    WS2812_Commit();
     
-    uint32_t current_time = get_animation_ticks();
-    if (current_time - last_update[channel_idx] < speed) return;
+#if WS2812_STATS
+    led_stats.update_end = WS2812_Now();
+#endif
+}
+
+#if WS2812_STATS
+// Clear every statistic and start a new measuring window
+void LED_StatsReset(void) {
+    for (uint8_t i = 0; i < MAX_LED_CHANNELS; i++) {
+        memset(&ws2812_channels[i].stat_transmit, 0, sizeof(WS2812_StatTimer_t));
+        memset(&ws2812_channels[i].stat_latch, 0, sizeof(WS2812_StatTimer_t));
+    }
+    for (uint8_t i = 0; i < LED_MAX_SEGMENTS; i++) {
+        memset(&led_slots[i].stat_render, 0, sizeof(WS2812_StatTimer_t));
+    }
+    memset(&led_stats, 0, sizeof(led_stats));
+    memset(&ws2812_irq_stats, 0, sizeof(ws2812_irq_stats));
+    led_scheduler.missed = 0;
+#if WS2812_POWER_LIMIT
+    WS2812_ResetPowerStats();
+#endif
+#if WS2812_LOW_POWER
+    WS2812_ResetSleepStats();
+#endif
+    memset(&ws2812_commit_stats, 0, sizeof(ws2812_commit_stats));
+    led_stats.since = WS2812_Now();
+}
+
+// Print one timer as "name min/avg/max us (count)"
+static void LED_StatsPrintTimer(const char* name, const WS2812_StatTimer_t* timer) {
+    uint32_t avg = timer->count ? timer->sum / timer->count : 0;
+    printf(" %s %lu/%lu/%lu us (%lu)", name,
+           (unsigned long)(timer->min / WS2812_TICKS_PER_US), (unsigned long)(avg / WS2812_TICKS_PER_US),
+           (unsigned long)(timer->max / WS2812_TICKS_PER_US), (unsigned long)timer->count);
+}
+
+// Print the statistics since LED_StatsReset() with printf (the debug UART):
+// frame rate, overruns and idle time, then transmit and latch times per
+// channel and render time per segment, as min/avg/max (and the power limiter,
+// sleep and unchanged frames when they are built in)
+void LED_StatsDump(void) {
+    uint32_t ms = (WS2812_Now() - led_stats.since) / (WS2812_TICKS_PER_US * 1000);
+    uint32_t fps10 = ms ? led_stats.frames * 10000 / ms : 0;
     
-    last_update[channel_idx] = current_time;
+    printf("frames %lu fps %lu.%lu overruns %lu missed %lu",
+           (unsigned long)led_stats.frames, (unsigned long)(fps10 / 10), (unsigned long)(fps10 % 10),
+           (unsigned long)led_stats.overruns, (unsigned long)led_scheduler.missed);
+    LED_StatsPrintTimer("idle", &led_stats.idle);
+    printf("\r\nirq off max %lu us restarts %lu\r\n",
+           (unsigned long)WS2812_GetMaxIrqOffUs(), (unsigned long)ws2812_irq_stats.restarts);
+#if WS2812_POWER_LIMIT
+    const WS2812_PowerStats_t* power = WS2812_GetPowerStats();
+    uint32_t avg_scale = power->throttled ? power->scale_sum / power->throttled : 255;
+    printf("power %u mA peak %u mA throttled %lu cuts %lu scale avg %lu min %u\r\n",
+           power->last_ma, power->peak_ma, (unsigned long)power->throttled, (unsigned long)power->cuts,
+           (unsigned long)avg_scale, power->min_scale);
+#endif
+#if WS2812_LOW_POWER
+    const WS2812_SleepStats_t* sleep = WS2812_GetSleepStats();
+    uint32_t sleep_ms = sleep->ticks / WS2812_TICKS_PER_MS;
+    printf("sleep %lu ms (%lu%%) sleeps %lu early %lu\r\n",
+           (unsigned long)sleep_ms, (unsigned long)(ms ? sleep_ms * 100 / ms : 0),
+           (unsigned long)sleep->sleeps, (unsigned long)sleep->early);
+#endif
+#if WS2812_SKIP_UNCHANGED
+    printf("channel frames sent %lu unchanged %lu\r\n",
+           (unsigned long)ws2812_commit_stats.sent, (unsigned long)ws2812_commit_stats.unchanged);
+#endif
     
-    // Clear all pixels first
-    for (uint16_t i = 0; i < ch->led_count; i++) {
-        ch->led_buffer[i][0] = 0;
-        ch->led_buffer[i][1] = 0;
-        ch->led_buffer[i][2] = 0;
-    }
-    
-    // Set color based on state
-    switch (flash_state[channel_idx]) {
-        case 0: // Red
-            for (uint16_t i = 0; i < ch->led_count; i++) {
-                ch->led_buffer[i][0] = brightness;
-            }
-            break;
-        case 1: // Green
-            for (uint16_t i = 0; i < ch->led_count; i++) {
-                ch->led_buffer[i][1] = brightness;
-            }
-            break;
-        case 2: // Blue
-            for (uint16_t i = 0; i < ch->led_count; i++) {
-                ch->led_buffer[i][2] = brightness;
-            }
-            break;
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!ws2812_channels[i].active) continue;
+        printf("ch%u", i);
+        LED_StatsPrintTimer("tx", &ws2812_channels[i].stat_transmit);
+        LED_StatsPrintTimer("latch", &ws2812_channels[i].stat_latch);
+        printf("\r\n");
+    }
+    for (uint8_t i = 0; i < LED_MAX_SEGMENTS; i++) {
+        if (!led_slots[i].effect) continue;
+        printf("seg%u", i);
+        LED_StatsPrintTimer("render", &led_slots[i].stat_render);
+        printf("\r\n");
     }
+}
+#endif
+
+// Keep an effect running from a call made every loop: the slot is only
+// restarted when the effect or its parameters change, then stepped if due
+static void LED_RunEffect(uint8_t seg_idx, const LED_Effect_t* effect, LED_EffectParams_t params) {
+    if (!LED_GetSegment(seg_idx)) return;
+    LED_EffectSlot_t* slot = &led_slots[seg_idx];
     
-    WS2812_SendAll();
+    if (slot->effect != effect || memcmp(&slot->params, &params, sizeof(params)) != 0) {
+        LED_SetEffect(seg_idx, effect, params);
+    }
+    LED_RunSlot(seg_idx, get_animation_ticks());
+}
+
+// Turn off all LEDs on the specified channel
+void LED_OFF(uint8_t channel_idx) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_FILL, LED_PARAMS(0, 0, 0, 0, 0));
+}
+
+// Fill with red color
+void LED_RED(uint8_t channel_idx, uint8_t brightness) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_FILL, LED_PARAMS(brightness, 0, 0, 0, 0));
+}
+
+// Fill with green color
+void LED_GREEN(uint8_t channel_idx, uint8_t brightness) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_FILL, LED_PARAMS(0, brightness, 0, 0, 0));
+}
+
+// Fill with blue color
+void LED_BLUE(uint8_t channel_idx, uint8_t brightness) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_FILL, LED_PARAMS(0, 0, brightness, 0, 0));
+}
+
+// Fill entire strip with a custom RGB color
+void LED_FILL(uint8_t channel_idx, uint16_t red, uint16_t green, uint16_t blue) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_FILL, LED_PARAMS(red > 255 ? 255 : red,
+                                                           green > 255 ? 255 : green,
+                                                           blue > 255 ? 255 : blue, 0, 0));
+}
+
+// Rainbow cycle effect (non-blocking - call repeatedly)
+void LED_RAINBOW_CYCLE(uint8_t channel_idx, uint16_t speed) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_RAINBOW_CYCLE, LED_PARAMS(0, 0, 0, speed, 0));
+}
+
+// Theater chase effect (non-blocking - call repeatedly)
+void LED_THEATER_CHASE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_THEATER_CHASE, LED_PARAMS(red, green, blue, speed, 0));
+}
+
+// Color wipe effect (non-blocking - call repeatedly)
+void LED_COLOUR_WIPE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_COLOUR_WIPE, LED_PARAMS(red, green, blue, speed, 0));
+}
+
+// Single pixel control
+void LED_SINGLE_PIXEL(uint8_t channel_idx, uint16_t position, uint8_t red, uint8_t green, uint8_t blue) {
+    if (position >= LED_GetSegmentLength(channel_idx)) return;
     
-    // Cycle through colors: Red -> Green -> Blue -> Red...
-    flash_state[channel_idx] = (flash_state[channel_idx] + 1) % 3;
+    LED_RunEffect(channel_idx, &LED_EFFECT_SINGLE_PIXEL, LED_PARAMS(red, green, blue, 0, position));
+}
+
+// Pulse effect (non-blocking - call repeatedly)
+void LED_PULSE(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue, uint16_t speed) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_PULSE, LED_PARAMS(red, green, blue, speed, 0));
+}
+
+// Rainbow effect with configurable width (non-blocking - call repeatedly)
+void LED_RAINBOWS(uint8_t channel_idx, uint16_t speed, uint16_t width) {
+    if (width == 0) return;
+    LED_RunEffect(channel_idx, &LED_EFFECT_RAINBOWS, LED_PARAMS(0, 0, 0, speed, width));
+}
+
+// Flash RGB colors (non-blocking - call repeatedly)
+// Note: speed parameter is in milliseconds
+// Typical values: 50-100 for fast flashing, 250-1000 for slower transitions
+void LED_RGB_FLASH(uint8_t channel_idx, uint16_t speed, uint8_t brightness) {
+    LED_RunEffect(channel_idx, &LED_EFFECT_RGB_FLASH, LED_PARAMS(brightness, 0, 0, speed, 0));
 }
 
 // Multi-channel API helper functions
@@ -351,9 +1485,11 @@ void LED_SendAllChannels(void) {
     WS2812_SendAll();
 }
 
-// Get buffer for a specific channel
+// Get buffer for a specific channel (index pixels with WS2812_R/G/B and call
+// WS2812_MarkDirty() after writing), NULL for palette-indexed and shader channels
 uint8_t (*LED_GetChannelBuffer(uint8_t channel_idx))[3] {
-    if (channel_idx < num_channels && ws2812_channels[channel_idx].active) {
+    if (channel_idx < num_channels && ws2812_channels[channel_idx].active &&
+        ws2812_channels[channel_idx].format == WS2812_FORMAT_RGB) {
         return ws2812_channels[channel_idx].led_buffer;
     }
     return NULL;
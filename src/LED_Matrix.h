@@ -0,0 +1,285 @@
+// 2D matrix layer for the multi-channel WS2812B driver
+// A matrix sits on top of a segment (see LED_Functions.h), so it can be one
+// channel, part of one, or panels spread over several pins.
+// Include after LED_Functions.h. Configure with LED_MatrixConfigure(), then run
+// matrix effects on the segment with LED_SetEffect() like any other effect.
+
+// Number of matrices that can be configured at once
+#ifndef LED_MAX_MATRICES
+#define LED_MAX_MATRICES 1
+#endif
+
+// Wiring layout flags
+#define LED_MATRIX_PROGRESSIVE      0x00   // Every row runs the same way
+#define LED_MATRIX_SERPENTINE       0x01   // Every other row runs backwards (zigzag)
+#define LED_MATRIX_COLUMNS          0x02   // Wired in columns instead of rows
+#define LED_MATRIX_TILE_SERPENTINE  0x04   // Every other row of tiles runs backwards
+
+// Rotation of the logical picture, clockwise
+#define LED_MATRIX_ROTATE_0   0
+#define LED_MATRIX_ROTATE_90  1
+#define LED_MATRIX_ROTATE_180 2
+#define LED_MATRIX_ROTATE_270 3
+
+typedef struct LED_Matrix LED_Matrix_t;
+
+struct LED_Matrix {
+    uint8_t active;
+    uint8_t segment;               // Segment the matrix is drawn into
+    uint8_t width, height;         // Logical size, after rotation
+    uint8_t panel_width;           // LEDs across one tile
+    uint8_t panel_height;          // LEDs down one tile
+    uint8_t tiles_x, tiles_y;      // Tiles across and down
+    uint8_t layout;                // LED_MATRIX_* wiring flags
+    uint8_t rotation;              // LED_MATRIX_ROTATE_*
+    uint16_t* map;                 // XY table in the pixel arena, NULL if not built
+    const uint16_t* user_map;      // XY table supplied by the user (may live in flash)
+    uint16_t (*xy)(const LED_Matrix_t* m, uint8_t x, uint8_t y);  // Picked by LED_MatrixConfigure()
+    const uint8_t* scroll_columns; // Bitmap for the scroll effect, one byte per column, bit 0 = top
+    uint16_t scroll_length;        // Number of columns in scroll_columns
+};
+
+static LED_Matrix_t led_matrices[LED_MAX_MATRICES] = {0};
+
+// Quarter sine wave, 127 * sin(i * 2pi / 256) for i = 0..64
+static const uint8_t led_sin8_quarter[65] = {
+    0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+    49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+    90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+    117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+    127,
+};
+
+// Sine of a 0-255 angle, scaled to 1-255 around 128
+static inline uint8_t LED_sin8(uint8_t theta) {
+    uint8_t i = theta & 63;
+    uint8_t v = (theta & 64) ? led_sin8_quarter[64 - i] : led_sin8_quarter[i];
+    return (theta & 128) ? 128 - v : 128 + v;
+}
+
+// Reference mapping of a logical (x, y) to the LED index along the segment.
+// Handles every layout, rotation and tiling; used directly only when the
+// XY table does not fit in the arena.
+static uint16_t LED_MatrixXY_Generic(const LED_Matrix_t* m, uint8_t x, uint8_t y) {
+    uint16_t full_width = m->panel_width * m->tiles_x;
+    uint16_t full_height = m->panel_height * m->tiles_y;
+    uint16_t px, py;
+
+    // Logical picture to physical panel coordinates
+    switch (m->rotation) {
+        case LED_MATRIX_ROTATE_90:  px = y;                  py = full_height - 1 - x; break;
+        case LED_MATRIX_ROTATE_180: px = full_width - 1 - x; py = full_height - 1 - y; break;
+        case LED_MATRIX_ROTATE_270: px = full_width - 1 - y; py = x;                   break;
+        default:                    px = x;                  py = y;                   break;
+    }
+
+    // Which tile, and where inside it
+    uint8_t tx = px / m->panel_width;
+    uint8_t ty = py / m->panel_height;
+    uint8_t lx = px % m->panel_width;
+    uint8_t ly = py % m->panel_height;
+
+    if ((m->layout & LED_MATRIX_TILE_SERPENTINE) && (ty & 1)) {
+        tx = m->tiles_x - 1 - tx;
+    }
+    uint16_t tile = (uint16_t)ty * m->tiles_x + tx;
+
+    // Rows (or columns) inside the tile
+    uint8_t major = ly, minor = lx, minor_len = m->panel_width;
+    if (m->layout & LED_MATRIX_COLUMNS) {
+        major = lx;
+        minor = ly;
+        minor_len = m->panel_height;
+    }
+    if ((m->layout & LED_MATRIX_SERPENTINE) && (major & 1)) {
+        minor = minor_len - 1 - minor;
+    }
+
+    return tile * m->panel_width * m->panel_height + (uint16_t)major * minor_len + minor;
+}
+
+// Single tile, unrotated, progressive rows
+static uint16_t LED_MatrixXY_Progressive(const LED_Matrix_t* m, uint8_t x, uint8_t y) {
+    return (uint16_t)y * m->width + x;
+}
+
+// Single tile, unrotated, serpentine rows: odd rows mirrored without a branch
+static uint16_t LED_MatrixXY_Serpentine(const LED_Matrix_t* m, uint8_t x, uint8_t y) {
+    uint8_t mirror = (m->width - 1 - 2 * x) & -(y & 1);
+    return (uint16_t)y * m->width + (uint8_t)(x + mirror);
+}
+
+// Precomputed table in the pixel arena
+static uint16_t LED_MatrixXY_Table(const LED_Matrix_t* m, uint8_t x, uint8_t y) {
+    return m->map[(uint16_t)y * m->width + x];
+}
+
+// Table supplied with LED_MatrixSetMap()
+static uint16_t LED_MatrixXY_UserMap(const LED_Matrix_t* m, uint8_t x, uint8_t y) {
+    return m->user_map[(uint16_t)y * m->width + x];
+}
+
+// Matrix drawn into a segment, NULL if there is none
+static LED_Matrix_t* LED_GetMatrix(uint8_t seg_idx) {
+    for (uint8_t i = 0; i < LED_MAX_MATRICES; i++) {
+        if (led_matrices[i].active && led_matrices[i].segment == seg_idx) return &led_matrices[i];
+    }
+    return NULL;
+}
+
+// Release a segment's matrix and its XY table
+void LED_MatrixRemove(uint8_t seg_idx) {
+    LED_Matrix_t* m = LED_GetMatrix(seg_idx);
+    if (!m) return;
+
+    WS2812_ArenaFree((void**)&m->map);
+    m->active = 0;
+}
+
+// Lay a matrix of tiles_x by tiles_y panels, each panel_width by panel_height
+// LEDs, over a segment. Plain single-tile layouts use a formula; anything else
+// gets an XY table in the pixel arena, or the generic mapping if it does not fit.
+// Returns 0 if the sizes are invalid or no matrix slot is free.
+uint8_t LED_MatrixConfigure(uint8_t seg_idx, uint8_t panel_width, uint8_t panel_height,
+                            uint8_t tiles_x, uint8_t tiles_y, uint8_t layout, uint8_t rotation) {
+    uint16_t full_width = panel_width * tiles_x;
+    uint16_t full_height = panel_height * tiles_y;
+    // Up to 255 x 255 LEDs: the table size can pass the arena's 16-bit sizes
+    uint32_t map_bytes = (uint32_t)full_width * full_height * 2;
+    if (seg_idx >= LED_MAX_SEGMENTS || !full_width || !full_height) return 0;
+    if (full_width > 255 || full_height > 255 || rotation > LED_MATRIX_ROTATE_270) return 0;
+
+    LED_MatrixRemove(seg_idx);
+    LED_Matrix_t* m = NULL;
+    for (uint8_t i = 0; i < LED_MAX_MATRICES && !m; i++) {
+        if (!led_matrices[i].active) m = &led_matrices[i];
+    }
+    if (!m) return 0;
+
+    memset(m, 0, sizeof(LED_Matrix_t));
+    m->segment = seg_idx;
+    m->panel_width = panel_width;
+    m->panel_height = panel_height;
+    m->tiles_x = tiles_x;
+    m->tiles_y = tiles_y;
+    m->layout = layout;
+    m->rotation = rotation;
+    m->width = (rotation & 1) ? full_height : full_width;
+    m->height = (rotation & 1) ? full_width : full_height;
+    m->active = 1;
+
+    if (tiles_x == 1 && tiles_y == 1 && rotation == LED_MATRIX_ROTATE_0 && !(layout & LED_MATRIX_COLUMNS)) {
+        m->xy = (layout & LED_MATRIX_SERPENTINE) ? LED_MatrixXY_Serpentine : LED_MatrixXY_Progressive;
+    } else if (map_bytes <= 0xFFFF && WS2812_ArenaAlloc((void**)&m->map, (uint16_t)map_bytes)) {
+        uint16_t i = 0;
+        for (uint8_t y = 0; y < m->height; y++) {
+            for (uint8_t x = 0; x < m->width; x++) {
+                m->map[i++] = LED_MatrixXY_Generic(m, x, y);
+            }
+        }
+        m->xy = LED_MatrixXY_Table;
+    } else {
+        m->xy = LED_MatrixXY_Generic;
+    }
+    return 1;
+}
+
+// Use a width * height table of LED indices (row by row, logical order)
+// instead of the computed mapping, e.g. a const table for an irregular panel
+uint8_t LED_MatrixSetMap(uint8_t seg_idx, const uint16_t* map) {
+    LED_Matrix_t* m = LED_GetMatrix(seg_idx);
+    if (!m || !map) return 0;
+
+    WS2812_ArenaFree((void**)&m->map);
+    m->user_map = map;
+    m->xy = LED_MatrixXY_UserMap;
+    return 1;
+}
+
+// LED index of a logical (x, y), 0xFFFF if outside the matrix
+uint16_t LED_MatrixXY(uint8_t seg_idx, uint8_t x, uint8_t y) {
+    LED_Matrix_t* m = LED_GetMatrix(seg_idx);
+    if (!m || x >= m->width || y >= m->height) return 0xFFFF;
+    return m->xy(m, x, y);
+}
+
+// Set one matrix pixel and mark its channel for transmission
+void LED_MatrixSetPixel(uint8_t seg_idx, uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    uint16_t index = LED_MatrixXY(seg_idx, x, y);
+    if (index != 0xFFFF) {
+        LED_SegmentSetPixel(seg_idx, index, red, green, blue);
+    }
+}
+
+// Bitmap shown by LED_EFFECT_MATRIX_SCROLL, one byte per column with bit 0 at
+// the top row; the buffer must stay valid while the effect runs
+void LED_MatrixSetScroll(uint8_t seg_idx, const uint8_t* columns, uint16_t length) {
+    LED_Matrix_t* m = LED_GetMatrix(seg_idx);
+    if (!m) return;
+
+    m->scroll_columns = columns;
+    m->scroll_length = length;
+}
+
+// Matrix of the segment being rendered
+static LED_Matrix_t* LED_MatrixOfSegment(const LED_Segment_t* seg) {
+    return LED_GetMatrix((uint8_t)(seg - led_segments));
+}
+
+// Scroll the bitmap from right to left in params colour, one column per step
+static void LED_Render_MatrixScroll(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    LED_Matrix_t* m = LED_MatrixOfSegment(seg);
+    if (!m) return;
+
+    uint16_t period = m->scroll_length + m->width;
+    uint16_t pos = slot->state.pos + steps - 1;
+    while (pos >= period) pos -= period;
+
+    for (uint8_t x = 0; x < m->width; x++) {
+        // Column of the bitmap under x; the text enters from the right edge
+        int16_t src = (int16_t)(pos + x) - m->width;
+        uint8_t bits = (src >= 0 && src < (int16_t)m->scroll_length) ? m->scroll_columns[src] : 0;
+
+        for (uint8_t y = 0; y < m->height; y++) {
+            uint8_t* px = LED_SegmentPixel(seg, m->xy(m, x, y));
+            if (!px) continue;
+
+            if (y < 8 && (bits >> y) & 1) {
+                LED_SetRGB(px, slot->params.red, slot->params.green, slot->params.blue);
+            } else {
+                LED_SetRGB(px, 0, 0, 0);
+            }
+        }
+    }
+    slot->state.pos = (pos + 1 == period) ? 0 : pos + 1;
+}
+
+// Plasma from three sine waves, moving one phase unit per step;
+// params.width sets the spatial scale as a shift (0-4, larger = finer)
+static void LED_Render_MatrixPlasma(LED_Segment_t* seg, LED_EffectSlot_t* slot, uint8_t steps) {
+    LED_Matrix_t* m = LED_MatrixOfSegment(seg);
+    if (!m) return;
+
+    uint8_t t = slot->state.pos + steps - 1;
+    uint8_t rgb[3];
+    uint8_t shift = slot->params.width > 4 ? 4 : slot->params.width;
+
+    for (uint8_t y = 0; y < m->height; y++) {
+        uint8_t wy = LED_sin8((uint8_t)((y << shift) + (t >> 1)));
+
+        for (uint8_t x = 0; x < m->width; x++) {
+            uint8_t* px = LED_SegmentPixel(seg, m->xy(m, x, y));
+            if (!px) continue;
+
+            uint16_t v = LED_sin8((uint8_t)((x << shift) + t)) + wy
+                       + LED_sin8((uint8_t)(((x + y) << shift >> 1) - t));
+            LED_HSV16ToRGB((uint16_t)((uint8_t)((v >> 2) + t)) << 8, 255, 255, rgb);
+            LED_SetRGB(px, rgb[0], rgb[1], rgb[2]);
+        }
+    }
+    slot->state.pos = (uint8_t)(t + 1);
+}
+
+// Matrix effect descriptors, run on the matrix's segment with LED_SetEffect()
+static const LED_Effect_t LED_EFFECT_MATRIX_SCROLL = { .render = LED_Render_MatrixScroll, .kind = LED_KIND_RGB };
+static const LED_Effect_t LED_EFFECT_MATRIX_PLASMA = { .render = LED_Render_MatrixPlasma, .kind = LED_KIND_RGB };
@@ -0,0 +1,237 @@
+// Playback of compressed animations stored in flash
+// tools/ws2812_anim_encode.py turns a raw RGB frame dump into a C array in the
+// format below. A frame only stores the LEDs that changed since the frame
+// before, as skips, runs and literals, so it costs flash and decode time in
+// proportion to what moves. The decoder reads the array in place and writes
+// the changed LEDs straight into the channel buffer. Include after WS2812B_Driver.h.
+//
+// Format (16-bit values high byte first):
+//   'W' 'A'  version  flags  led_count  frame_count  frame_ms
+//   with LED_ANIM_FLAG_PALETTE: entries - 1, then entries x R G B
+//   frames, each 'K' (key frame: sets every LED) or 'D' (delta), then ops:
+//     00nnnnnn  skip n+1 LEDs, they keep their colour
+//     01nnnnnn  run: one value for the next n+1 LEDs
+//     10nnnnnn  literal: n+1 values, one per LED
+//     11nnnnnn  n = 0: end of the frame, else skip n*64 LEDs
+//   A value is R G B, or a palette index with LED_ANIM_FLAG_PALETTE.
+// The first frame is a key frame; looping starts over from it. LEDs beyond the
+// channel length are decoded but not written. Every read is checked against the
+// data size given to LED_PlaybackStart(), and every palette index against the
+// palette size, so damaged or truncated data stops playback instead of reading
+// past the array. Only full colour (WS2812_FORMAT_RGB) channels can play; the
+// white LEDs of RGBW channels are left alone.
+
+#define LED_ANIM_MAGIC1 'W'
+#define LED_ANIM_MAGIC2 'A'
+#define LED_ANIM_VERSION 1
+#define LED_ANIM_HEADER_SIZE 10
+
+#define LED_ANIM_FLAG_PALETTE 0x01     // Values are palette indices
+
+#define LED_ANIM_KEY 'K'
+#define LED_ANIM_DELTA 'D'
+
+#define LED_ANIM_OP_SKIP 0
+#define LED_ANIM_OP_RUN 1
+#define LED_ANIM_OP_LITERAL 2
+#define LED_ANIM_OP_END 3              // With a count: long skip
+#define LED_ANIM_END 0xC0
+
+// Playback counters
+typedef struct {
+    uint32_t frames;               // Frames decoded
+    uint32_t pixels;               // LEDs written
+    uint32_t bytes;                // Animation bytes read by the frames
+#if WS2812_STATS
+    WS2812_StatTimer_t decode;     // Time to decode a frame
+#endif
+} LED_PlaybackStats_t;
+
+// One animation playing on one channel
+typedef struct {
+    const uint8_t* frames;         // First frame
+    const uint8_t* next;           // Next frame to decode
+    const uint8_t* palette;        // R G B per entry, NULL for full colour values
+    const uint8_t* end;            // First byte after the animation data
+    uint16_t entries;              // Palette entries, 0 for full colour values
+    uint16_t led_count;            // LEDs per frame in the animation
+    uint16_t frame_count;
+    uint16_t frame_ms;             // Frame period, 0 = one frame per LED_PlaybackUpdate()
+    uint16_t frame;                // Index of the next frame
+    uint8_t channel;
+    uint8_t loop;                  // 1 to start over after the last frame
+    uint8_t playing;               // 0 once finished, stopped or on bad data
+    uint32_t due;                  // Millisecond time the next frame is due
+    LED_PlaybackStats_t stats;
+} LED_Playback_t;
+
+static inline uint16_t LED_AnimRead16(const uint8_t* src) {
+    return ((uint16_t)src[0] << 8) | src[1];
+}
+
+// 1 if the channel can take decoded frames
+static uint8_t LED_PlaybackChannelOk(uint8_t channel_idx) {
+    if (channel_idx >= num_channels) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    return ch->active && ch->format == WS2812_FORMAT_RGB && ch->led_buffer;
+}
+
+// Check an animation's header and get ready to play it on a channel from its
+// first frame, which is decoded on the next LED_PlaybackUpdate(). size is the
+// length of the data in bytes (sizeof the array the encoder wrote). Returns 0
+// if the data is not an animation or the channel cannot show it.
+static uint8_t LED_PlaybackStart(LED_Playback_t* p, uint8_t channel_idx, const uint8_t* anim, uint32_t size, uint8_t loop) {
+    memset(p, 0, sizeof(*p));
+    if (!anim || size <= LED_ANIM_HEADER_SIZE + 1 || !LED_PlaybackChannelOk(channel_idx)) return 0;
+    if (anim[0] != LED_ANIM_MAGIC1 || anim[1] != LED_ANIM_MAGIC2 || anim[2] != LED_ANIM_VERSION) return 0;
+
+    p->led_count = LED_AnimRead16(anim + 4);
+    p->frame_count = LED_AnimRead16(anim + 6);
+    p->frame_ms = LED_AnimRead16(anim + 8);
+    if (p->led_count == 0 || p->frame_count == 0) return 0;
+
+    const uint8_t* src = anim + LED_ANIM_HEADER_SIZE;
+    const uint8_t* end = anim + size;
+    if (anim[3] & LED_ANIM_FLAG_PALETTE) {
+        p->entries = *src++ + 1;
+        p->palette = src;
+        src += (p->entries << 1) + p->entries;
+        if (src >= end) return 0;
+    }
+    if (*src != LED_ANIM_KEY) return 0;
+
+    p->end = end;
+    p->frames = src;
+    p->next = src;
+    p->channel = channel_idx;
+    p->loop = loop;
+    p->playing = 1;
+    p->due = WS2812_Millis();
+    return 1;
+}
+
+// Stop playing; the channel keeps the last frame
+static void LED_PlaybackStop(LED_Playback_t* p) {
+    p->playing = 0;
+}
+
+// Write count LEDs from pos: one value each (literal) or the same value (run)
+static void LED_PlaybackWrite(const LED_Playback_t* p, WS2812_Channel_t* ch, uint16_t pos, uint16_t count,
+                              const uint8_t* value, uint8_t literal) {
+    uint8_t step = p->palette ? 1 : 3;
+
+    if (pos >= ch->led_count) return;
+    if (count > ch->led_count - pos) count = ch->led_count - pos;
+
+    uint8_t* px = ch->led_buffer[pos];
+    while (count--) {
+        const uint8_t* rgb = value;
+        if (p->palette) rgb = p->palette + ((uint16_t)*value << 1) + *value;
+
+        px[WS2812_R] = rgb[0];
+        px[WS2812_G] = rgb[1];
+        px[WS2812_B] = rgb[2];
+        px += 3;
+        if (literal) value += step;
+    }
+}
+
+// 1 if the count values at src are all entries of the palette
+static uint8_t LED_PlaybackIndicesOk(const LED_Playback_t* p, const uint8_t* src, uint16_t count) {
+    if (!p->palette || p->entries > 0xFF) return 1;
+    while (count--) {
+        if (*src++ >= p->entries) return 0;
+    }
+    return 1;
+}
+
+// Walk the frame at p->next, writing the LEDs it changes. Returns 0 if the
+// data is damaged: ops past the last LED, reads past the end of the data, or
+// palette indices past the last entry.
+static uint8_t LED_PlaybackWalk(LED_Playback_t* p, WS2812_Channel_t* ch) {
+    const uint8_t* src = p->next;
+    const uint8_t* end = p->end;
+    uint8_t step = p->palette ? 1 : 3;
+    uint16_t pos = 0;
+
+    if (src >= end || (*src != LED_ANIM_KEY && *src != LED_ANIM_DELTA)) return 0;
+    src++;
+
+    for (;;) {
+        if (src >= end) return 0;
+        uint8_t op = *src++;
+        uint8_t code = op >> 6;
+        uint16_t count = (op & 0x3F) + 1;
+
+        if (op == LED_ANIM_END) break;
+        if (code == LED_ANIM_OP_END) count = (count - 1) << 6;
+        if (count > p->led_count - pos) return 0;
+
+        if (code == LED_ANIM_OP_RUN) {
+            if (end - src < step || !LED_PlaybackIndicesOk(p, src, 1)) return 0;
+            LED_PlaybackWrite(p, ch, pos, count, src, 0);
+            src += step;
+            p->stats.pixels += count;
+        } else if (code == LED_ANIM_OP_LITERAL) {
+            if (end - src < count * step || !LED_PlaybackIndicesOk(p, src, count)) return 0;
+            LED_PlaybackWrite(p, ch, pos, count, src, 1);
+            src += count * step;
+            p->stats.pixels += count;
+        }
+        pos += count;
+    }
+
+    p->stats.bytes += src - p->next;
+    p->next = src;
+    return 1;
+}
+
+// Decode the next frame into the channel buffer and mark the channel dirty.
+// Returns 0 (and stops) at the end of a non-looping animation, on bad data or
+// if the channel can no longer take frames.
+static uint8_t LED_PlaybackDecode(LED_Playback_t* p) {
+    if (!p->playing) return 0;
+    if (!LED_PlaybackChannelOk(p->channel)) {
+        p->playing = 0;
+        return 0;
+    }
+    if (p->frame == p->frame_count) {
+        if (!p->loop) {
+            p->playing = 0;
+            return 0;
+        }
+        p->next = p->frames;
+        p->frame = 0;
+    }
+
+    WS2812_STATS_START(decode_start);
+    uint8_t ok = LED_PlaybackWalk(p, &ws2812_channels[p->channel]);
+    WS2812_STATS_STOP(p->stats.decode, decode_start);
+    if (!ok) {
+        p->playing = 0;
+        return 0;
+    }
+
+    p->stats.frames++;
+    p->frame++;
+    WS2812_MarkDirty(p->channel);
+    return 1;
+}
+
+// Decode every frame that fell due since the last call (each delta builds on
+// the one before, so none are dropped). Call from the main loop before
+// LED_Update() or WS2812_Commit(), which send the result. Returns the number
+// of frames decoded.
+static uint8_t LED_PlaybackUpdate(LED_Playback_t* p) {
+    uint8_t decoded = 0;
+
+    if (p->frame_ms == 0) return LED_PlaybackDecode(p);
+
+    uint32_t now = WS2812_Millis();
+    while (p->playing && (int32_t)(now - p->due) >= 0 && decoded < 255) {
+        if (!LED_PlaybackDecode(p)) break;
+        p->due += p->frame_ms;
+        decoded++;
+    }
+    return decoded;
+}
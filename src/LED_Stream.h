@@ -0,0 +1,368 @@
+// Live pixel streaming over UART for the multi-channel WS2812B driver
+// A host (PC, Raspberry Pi, ...) sends frames to USART1 RX on PD6. DMA copies
+// the bytes into a small circular buffer, LED_StreamPoll() parses whatever has
+// arrived and writes the pixels straight into the target channel buffer, and a
+// complete frame is committed. Include after WS2812B_Driver.h.
+//
+// Frame format (Adalight-like, with a channel id and a payload checksum):
+//   'W' 'S'  channel  length_hi  length_lo  channel^length_hi^length_lo^0x55
+//   payload: length bytes, R G B per LED (R G B W on RGBW channels), from LED 0
+//   checksum: 8-bit sum of the payload bytes
+// A frame may update fewer LEDs than the channel has; the rest keep their colour.
+// Frames with a bad header, an unknown or palette-indexed channel, too long a
+// payload or a wrong checksum are counted as dropped and the parser hunts for
+// the next 'W' 'S'. If the DMA laps the parser (LED_StreamPoll() called too
+// late), the overrun is counted, the frame in progress is dropped and the
+// parser hunts for the next header after the newest byte.
+//
+// The payload is written into the channel buffer as it arrives, before the
+// checksum can be checked, so a dropped frame has already changed the LEDs it
+// reached. The channel is not marked dirty for it, but without
+// WS2812_DOUBLE_BUFFER those LEDs keep the bad bytes until the next intact
+// frame, and any send before that (another frame's commit, a direct
+// WS2812_SendChannel()) shows them. With WS2812_DOUBLE_BUFFER the frame lands in
+// the back buffer and a drop copies the committed frame back over the LEDs it
+// reached; the white plane of RGBW channels has no front copy and keeps them.
+//
+// Do not run an effect on a streamed channel, it would overwrite the frames.
+//
+// Every half of the ring filling raises an interrupt that counts the bytes
+// received, so overruns are seen however far the DMA got. With
+// WS2812_LOW_POWER, the line going idle after a burst raises one too, so a core
+// stopped by LED_Sleep() wakes to parse the data before the ring can overflow.
+
+// Fastest baud rate the stream is sized for
+#ifndef LED_STREAM_MAX_BAUD
+#define LED_STREAM_MAX_BAUD 1000000
+#endif
+
+// Size of the DMA receive ring in bytes (power of two). It must hold everything
+// that arrives between two LED_StreamPoll() calls. The longest gap is the commit
+// after a frame: sending a full arena takes 30us per 3 bytes, as long as 1Mbaud
+// needs for the same number of bytes, plus the latch. The default fits that at
+// LED_STREAM_MAX_BAUD: 1KB with the default arena at 1Mbaud, 512 bytes at 500kbaud.
+#define LED_STREAM_COMMIT_BYTES ((WS2812_ARENA_SIZE + 8) * (LED_STREAM_MAX_BAUD / 1000) / 1000)
+#ifndef LED_STREAM_RING_SIZE
+#if LED_STREAM_COMMIT_BYTES <= 128
+#define LED_STREAM_RING_SIZE 128
+#elif LED_STREAM_COMMIT_BYTES <= 256
+#define LED_STREAM_RING_SIZE 256
+#elif LED_STREAM_COMMIT_BYTES <= 512
+#define LED_STREAM_RING_SIZE 512
+#else
+#define LED_STREAM_RING_SIZE 1024
+#endif
+#endif
+
+// Commit the channels as soon as a frame is complete. Set to 0 to leave the
+// commit to the caller (LED_StreamPoll() still returns the frame count).
+#ifndef LED_STREAM_AUTO_COMMIT
+#define LED_STREAM_AUTO_COMMIT 1
+#endif
+
+_Static_assert((LED_STREAM_RING_SIZE & (LED_STREAM_RING_SIZE - 1)) == 0 && LED_STREAM_RING_SIZE <= 32768,
+               "LED_STREAM_RING_SIZE must be a power of two");
+
+#define LED_STREAM_HALF (LED_STREAM_RING_SIZE / 2)
+
+#define LED_STREAM_SYNC1 'W'
+#define LED_STREAM_SYNC2 'S'
+#define LED_STREAM_HEADER_KEY 0x55
+
+// Parser states
+enum {
+    LED_STREAM_WAIT_SYNC1,
+    LED_STREAM_WAIT_SYNC2,
+    LED_STREAM_WAIT_CHANNEL,
+    LED_STREAM_WAIT_LENGTH_HI,
+    LED_STREAM_WAIT_LENGTH_LO,
+    LED_STREAM_WAIT_HEADER_CHECK,
+    LED_STREAM_PAYLOAD,
+    LED_STREAM_WAIT_CHECKSUM,
+};
+
+// Receive statistics
+typedef struct {
+    uint32_t bytes;                // Bytes fed to the parser
+    uint32_t frames;               // Frames received intact
+    uint32_t dropped;              // Frames rejected (bad header, channel, length or checksum) or cut by an overrun
+    uint32_t overruns;             // Times the DMA overwrote bytes not yet parsed
+} LED_StreamStats_t;
+
+// Incremental frame parser. It keeps its place between calls, so the input
+// can be split into chunks of any size.
+typedef struct {
+    uint8_t state;                 // LED_STREAM_WAIT_* / LED_STREAM_PAYLOAD
+    uint8_t channel;               // Channel of the frame being received
+    uint8_t bytes_per_pixel;       // 3, or 4 for RGBW channels
+    uint8_t component;             // Byte of the current LED the next payload byte is
+    uint8_t sum;                   // Running payload checksum
+    uint8_t completed;             // Set when the bytes just fed ended an intact frame
+    uint16_t remaining;            // Payload bytes still to come
+    uint8_t* pixel;                // Current LED in the channel buffer
+    uint8_t* white;                // Current LED in the white plane (RGBW channels)
+    LED_StreamStats_t stats;
+} LED_StreamParser_t;
+
+// Payload byte order R, G, B mapped to the stored pixel layout
+static const uint8_t led_stream_index[3] = { WS2812_R, WS2812_G, WS2812_B };
+
+// Start hunting for a frame header; the statistics are kept
+static void LED_StreamReset(LED_StreamParser_t* p) {
+    p->state = LED_STREAM_WAIT_SYNC1;
+    p->completed = 0;
+}
+
+// Check a received header and point the parser at the channel buffer
+static uint8_t LED_StreamBegin(LED_StreamParser_t* p) {
+    if (p->channel >= num_channels) return 0;
+
+    WS2812_Channel_t* ch = &ws2812_channels[p->channel];
+    if (!ch->active || ch->format != WS2812_FORMAT_RGB) return 0;
+
+    uint16_t capacity = (ch->led_count << 1) + ch->led_count;
+    if (ch->bytes_per_pixel == 4) capacity += ch->led_count;
+    if (p->remaining > capacity) return 0;
+
+    p->bytes_per_pixel = ch->bytes_per_pixel;
+    p->component = 0;
+    p->sum = 0;
+    p->pixel = ch->led_buffer[0];
+    p->white = ch->white_buffer;
+    return 1;
+}
+
+// Count the frame in progress as dropped and start hunting for a header
+static void LED_StreamDrop(LED_StreamParser_t* p) {
+    p->stats.dropped++;
+#if WS2812_DOUBLE_BUFFER
+    if (p->state == LED_STREAM_PAYLOAD || p->state == LED_STREAM_WAIT_CHECKSUM) {
+        // The LEDs written so far, the one in progress included
+        WS2812_Channel_t* ch = &ws2812_channels[p->channel];
+        if (ch->active && ch->front_buffer) {
+            uint16_t written = (uint16_t)(p->pixel - ch->led_buffer[0]) + (p->component ? 3 : 0);
+            memcpy(ch->led_buffer, ch->front_buffer, written);
+        }
+    }
+#endif
+    p->state = LED_STREAM_WAIT_SYNC1;
+}
+
+// Parse len bytes of input. Stops right after the last byte of an intact frame
+// (setting p->completed and marking the channel dirty) so the caller can
+// commit before the next frame overwrites the buffer. Returns the number of
+// bytes consumed; call again with the rest.
+static uint16_t LED_StreamFeed(LED_StreamParser_t* p, const uint8_t* data, uint16_t len) {
+    uint16_t i = 0;
+    p->completed = 0;
+
+    while (i < len) {
+        if (p->state == LED_STREAM_PAYLOAD) {
+            // Copy as much of the payload as this chunk holds in one loop
+            uint16_t n = len - i;
+            if (n > p->remaining) n = p->remaining;
+            p->remaining -= n;
+
+            uint8_t* pixel = p->pixel;
+            uint8_t component = p->component;
+            uint8_t sum = p->sum;
+            while (n--) {
+                uint8_t b = data[i++];
+                sum += b;
+                if (component < 3) {
+                    pixel[led_stream_index[component]] = b;
+                } else {
+                    *p->white++ = b;
+                }
+                if (++component == p->bytes_per_pixel) {
+                    component = 0;
+                    pixel += 3;
+                }
+            }
+            p->pixel = pixel;
+            p->component = component;
+            p->sum = sum;
+
+            if (p->remaining == 0) p->state = LED_STREAM_WAIT_CHECKSUM;
+            continue;
+        }
+
+        uint8_t b = data[i++];
+
+        switch (p->state) {
+            case LED_STREAM_WAIT_SYNC1:
+                if (b == LED_STREAM_SYNC1) p->state = LED_STREAM_WAIT_SYNC2;
+                break;
+            case LED_STREAM_WAIT_SYNC2:
+                if (b == LED_STREAM_SYNC2) {
+                    p->state = LED_STREAM_WAIT_CHANNEL;
+                } else if (b != LED_STREAM_SYNC1) {
+                    p->state = LED_STREAM_WAIT_SYNC1;
+                }
+                break;
+            case LED_STREAM_WAIT_CHANNEL:
+                p->channel = b;
+                p->state = LED_STREAM_WAIT_LENGTH_HI;
+                break;
+            case LED_STREAM_WAIT_LENGTH_HI:
+                p->remaining = (uint16_t)b << 8;
+                p->state = LED_STREAM_WAIT_LENGTH_LO;
+                break;
+            case LED_STREAM_WAIT_LENGTH_LO:
+                p->remaining |= b;
+                p->state = LED_STREAM_WAIT_HEADER_CHECK;
+                break;
+            case LED_STREAM_WAIT_HEADER_CHECK:
+                if (b != (p->channel ^ (p->remaining >> 8) ^ (p->remaining & 0xFF) ^ LED_STREAM_HEADER_KEY) ||
+                    !LED_StreamBegin(p)) {
+                    LED_StreamDrop(p);
+                } else {
+                    p->state = p->remaining ? LED_STREAM_PAYLOAD : LED_STREAM_WAIT_CHECKSUM;
+                }
+                break;
+            case LED_STREAM_WAIT_CHECKSUM:
+                if (b != p->sum) {
+                    LED_StreamDrop(p);
+                    break;
+                }
+                p->state = LED_STREAM_WAIT_SYNC1;
+                p->stats.frames++;
+                p->stats.bytes += i;
+                p->completed = 1;
+                WS2812_MarkDirty(p->channel);
+                return i;
+        }
+    }
+
+    p->stats.bytes += i;
+    return i;
+}
+
+// DMA receive ring, the parser, and the bytes written and parsed since
+// LED_StreamInit() (both wrap together, only their difference matters)
+static uint8_t led_stream_ring[LED_STREAM_RING_SIZE];
+static LED_StreamParser_t led_stream = {0};
+static volatile uint32_t led_stream_halves = 0;   // Ring halves filled, counted by the DMA interrupt
+static uint32_t led_stream_consumed = 0;
+
+// Start receiving frames on USART1 RX (PD6) through DMA1 channel 5.
+// USART1 TX (PD5, used by printf) keeps working at the same baud rate.
+static void LED_StreamInit(uint32_t baud) {
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_USART1;
+    RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+
+    // PD6 as input with pull-up, so an unconnected line idles high
+    GPIOD->CFGLR = (GPIOD->CFGLR & ~(0xF << 24)) | ((GPIO_Mode_IPU & 0x0F) << 24);
+    GPIOD->BSHR = 1 << 6;
+
+    memset(&led_stream, 0, sizeof(led_stream));
+    led_stream_halves = 0;
+    led_stream_consumed = 0;
+
+    // Every received byte is written into the ring, which wraps forever; each
+    // half filled raises an interrupt that counts it
+    DMA1_Channel5->CFGR = 0;
+    DMA1->INTFCR = DMA1_IT_GL5;
+    DMA1_Channel5->PADDR = (uint32_t)&USART1->DATAR;
+    DMA1_Channel5->MADDR = (uint32_t)led_stream_ring;
+    DMA1_Channel5->CNTR = LED_STREAM_RING_SIZE;
+    DMA1_Channel5->CFGR = DMA_DIR_PeripheralSRC | DMA_MemoryInc_Enable | DMA_Mode_Circular | DMA_Priority_High |
+                          DMA_IT_HT | DMA_IT_TC | DMA_CFGR1_EN;
+    NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+
+    // 8N1, receive requests through DMA
+    USART1->BRR = (WS2812_F_CPU + baud / 2) / baud;
+    USART1->CTLR3 |= USART_DMAReq_Rx;
+    USART1->CTLR1 |= USART_Mode_Rx | USART_CTLR1_UE;
+
+#if WS2812_LOW_POWER
+    USART1->CTLR1 |= USART_CTLR1_IDLEIE;
+    NVIC_EnableIRQ(USART1_IRQn);
+#endif
+}
+
+// Count the ring halves as the DMA fills them (and wake a sleeping core);
+// LED_StreamPoll() does the parsing
+void DMA1_Channel5_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel5_IRQHandler(void) {
+    uint32_t flags = DMA1->INTFR;
+
+    if (flags & DMA1_IT_HT5) {
+        DMA1->INTFCR = DMA1_IT_HT5;
+        led_stream_halves++;
+    }
+    if (flags & DMA1_IT_TC5) {
+        DMA1->INTFCR = DMA1_IT_TC5;
+        led_stream_halves++;
+    }
+}
+
+#if WS2812_LOW_POWER
+// The idle interrupt only ends the sleep
+void USART1_IRQHandler(void) __attribute__((interrupt));
+void USART1_IRQHandler(void) {
+    // Reading STATR then DATAR clears IDLE; DMA has already taken the data
+    (void)USART1->STATR;
+    (void)USART1->DATAR;
+}
+#endif
+
+// Bytes the DMA has written since LED_StreamInit(): the halves counted by the
+// interrupt plus the position in the half being filled. A position already in
+// the other half means its interrupt is still pending (held off by a bit-bang
+// send for at most WS2812_IRQ_OFF_BYTES, far less than a half takes to fill).
+static uint32_t LED_StreamReceived(void) {
+    uint32_t halves;
+    uint16_t pos;
+
+    do {
+        halves = led_stream_halves;
+        pos = (LED_STREAM_RING_SIZE - DMA1_Channel5->CNTR) & (LED_STREAM_RING_SIZE - 1);
+    } while (halves != led_stream_halves);
+
+    if ((pos >= LED_STREAM_HALF) != (halves & 1)) halves++;
+    return halves * LED_STREAM_HALF + (pos & (LED_STREAM_HALF - 1));
+}
+
+// Parse the bytes received since the last call and commit each complete frame
+// (with LED_STREAM_AUTO_COMMIT). Call from the main loop, often enough that the
+// ring cannot fill up; an overrun is counted in the statistics and the parser
+// starts over at the newest byte. Returns the number of frames completed.
+static uint8_t LED_StreamPoll(void) {
+    uint32_t received = LED_StreamReceived();
+    uint8_t frames = 0;
+
+    while (led_stream_consumed != received) {
+        if (received - led_stream_consumed > LED_STREAM_RING_SIZE) {
+            // The DMA lapped the parser: the unread part of the ring no longer
+            // follows on from what was parsed
+            led_stream.stats.overruns++;
+            if (led_stream.state != LED_STREAM_WAIT_SYNC1) LED_StreamDrop(&led_stream);
+            LED_StreamReset(&led_stream);
+            led_stream_consumed = received;
+            break;
+        }
+
+        // Feed the part up to the newest byte or the end of the ring, whichever is first
+        uint16_t tail = led_stream_consumed & (LED_STREAM_RING_SIZE - 1);
+        uint32_t n = received - led_stream_consumed;
+        if (n > (uint32_t)(LED_STREAM_RING_SIZE - tail)) n = LED_STREAM_RING_SIZE - tail;
+        led_stream_consumed += LED_StreamFeed(&led_stream, led_stream_ring + tail, n);
+
+        if (led_stream.completed) {
+            frames++;
+#if LED_STREAM_AUTO_COMMIT
+            WS2812_Commit();
+            // Bytes kept arriving while the frame was sent
+            received = LED_StreamReceived();
+#endif
+        }
+    }
+
+    return frames;
+}
+
+// Bytes, frames, dropped frames and overruns so far
+static const LED_StreamStats_t* LED_StreamGetStats(void) {
+    return &led_stream.stats;
+}
@@ -9,33 +9,786 @@
 #define PC1  0x11
 #define PC2  0x12
 #define PC4  0x14
+#define PC6  0x16  // SPI1 MOSI, used by the SPI + DMA backend
 #define PD4  0x34
 
 // Maximum number of independent LED channels
 #define MAX_LED_CHANNELS 4
 
-// Structure to hold configuration and state for a single LED channel
+// Output backends a channel can be driven by
+#define WS2812_BACKEND_BITBANG 0   // CPU timed GPIO writes (any pin)
+#define WS2812_BACKEND_SPI_DMA 1   // SPI1 MOSI fed by DMA (PC6 only)
+#define WS2812_BACKEND_PWM_DMA 2   // TIM2 CH1 PWM fed by circular DMA (PD4 only)
+
+// Enable the SPI + DMA backend (claims SPI1 and DMA1 channel 3)
+#ifndef WS2812_USE_SPI_DMA
+#define WS2812_USE_SPI_DMA 0
+#endif
+
+// Enable the timer PWM + DMA backend (claims TIM2 and DMA1 channel 2)
+#ifndef WS2812_USE_PWM_DMA
+#define WS2812_USE_PWM_DMA 0
+#endif
+
+// Core clock the driver is built for (SysTick runs at WS2812_F_CPU / 8)
+#ifndef WS2812_F_CPU
+#define WS2812_F_CPU 48000000
+#endif
+
+#define WS2812_TICKS_PER_US (WS2812_F_CPU / 8000000)
+#define WS2812_TICKS_PER_MS (WS2812_F_CPU / 8000)
+#define WS2812_US_TO_TICKS(us) ((uint32_t)(us) * WS2812_TICKS_PER_US)
+
+// Low time each chip needs before it latches a frame
+#define WS2812_RESET_US_WS2812  50
+#define WS2812_RESET_US_SK6812  80
+#define WS2812_RESET_US_WS2812B 280   // V5 parts; also safe for the older ones
+#define WS2812_RESET_US_WS2813  300
+#define WS2812_RESET_US_WS2811  280
+
+#ifndef WS2812_DEFAULT_RESET_US
+#define WS2812_DEFAULT_RESET_US WS2812_RESET_US_WS2812B
+#endif
+
+// Size of the static pixel arena all channel buffers are allocated from
+// (3 bytes per LED, rounded up to 4). WS2812_ArenaRemaining() reports what is left.
+#ifndef WS2812_ARENA_SIZE
+#define WS2812_ARENA_SIZE 512
+#endif
+
+// Keep a front buffer per channel for transmission and let effects draw into
+// the back one; WS2812_Commit() swaps them, and direct sends repeat the last
+// committed frame. Doubles the arena use per channel.
+#ifndef WS2812_DOUBLE_BUFFER
+#define WS2812_DOUBLE_BUFFER 0
+#endif
+
+#if WS2812_DOUBLE_BUFFER
+#define WS2812_CHANNEL_BUFFERS 2
+#else
+#define WS2812_CHANNEL_BUFFERS 1
+#endif
+
+// Maximum number of buffers allocated from the arena at once
+#ifndef WS2812_ARENA_MAX_BLOCKS
+#define WS2812_ARENA_MAX_BLOCKS (MAX_LED_CHANNELS * 2)
+#endif
+
+// Store pixels in wire order (G, R, B) so the send path reads them sequentially.
+// Always index pixels with WS2812_R / WS2812_G / WS2812_B.
+#ifndef WS2812_WIRE_ORDER_STORAGE
+#define WS2812_WIRE_ORDER_STORAGE 0
+#endif
+
+#if WS2812_WIRE_ORDER_STORAGE
+#define WS2812_R 1
+#define WS2812_G 0
+#define WS2812_B 2
+#define WS2812_RGB(r, g, b) { (g), (r), (b) }
+#else
+#define WS2812_R 0
+#define WS2812_G 1
+#define WS2812_B 2
+#define WS2812_RGB(r, g, b) { (r), (g), (b) }
+#endif
+// WS2812_RGB() initialises a stored pixel or palette entry in storage order,
+// e.g. static const uint8_t palette[16][3] = { WS2812_RGB(255, 0, 0), ... };
+
+// Number of shared 256-entry colour lookup tables. Channels (and colours) with the
+// same brightness, correction and gamma share one table, so two identically
+// configured channels need one table; each distinct setting needs another.
+#ifndef WS2812_LUT_COUNT
+#define WS2812_LUT_COUNT 2
+#endif
+
+// Chip profiles: pixel size, default colour order, bit rate and reset time.
+// Set with WS2812_SetChipProfile() after configuring a channel.
+#define WS2812_CHIP_WS2812      0   // GRB, 800kHz (default)
+#define WS2812_CHIP_WS2813      1   // GRB, 800kHz, longer reset
+#define WS2812_CHIP_SK6812      2   // GRB, 800kHz
+#define WS2812_CHIP_SK6812_RGBW 3   // GRBW, 800kHz, white kept in a separate plane
+#define WS2812_CHIP_WS2811      4   // RGB, 400kHz
+
+// Colour orders on the wire
+#define WS2812_ORDER_GRB 0
+#define WS2812_ORDER_RGB 1
+#define WS2812_ORDER_BRG 2
+#define WS2812_ORDER_RBG 3
+#define WS2812_ORDER_GBR 4
+#define WS2812_ORDER_BGR 5
+
+// Bit rates
+#define WS2812_SPEED_800K 0
+#define WS2812_SPEED_400K 1
+
+// Channel flags
+#define WS2812_FLAG_AUTO_WHITE 0x01   // RGBW: move the common part of R, G, B to white when sending
+
+// Pixel formats of a channel buffer (WS2812_SetPaletteMode, WS2812_SetShader)
+#define WS2812_FORMAT_RGB  0   // 3 bytes per LED, index with WS2812_R/G/B (default)
+#define WS2812_FORMAT_PAL8 1   // 1 byte per LED: an index into the channel palette
+#define WS2812_FORMAT_PAL4 2   // 4 bits per LED (even LEDs in the low nibble), up to 16 palette entries
+#define WS2812_FORMAT_SHADER 3 // No buffer: a generator produces each LED as it is sent (WS2812_SetShader)
+
+// Senders for 400kHz and RGBW chips; set to 0 to leave their code out
+#ifndef WS2812_PROFILE_400K
+#define WS2812_PROFILE_400K 1
+#endif
+#ifndef WS2812_PROFILE_RGBW
+#define WS2812_PROFILE_RGBW 1
+#endif
+// Senders for palette-indexed channels; set to 0 to leave their code out
+#ifndef WS2812_PALETTE
+#define WS2812_PALETTE 1
+#endif
+// Senders for shader channels; set to 0 to leave their code out
+#ifndef WS2812_SHADER
+#define WS2812_SHADER 1
+#endif
+
+// Bit-bang hooks. Every timed port write and delay in the transmit path goes
+// through these, so a host build can define them to record BSHR/BCR writes
+// against a modelled cycle count instead of touching the hardware.
+#ifndef WS2812_PORT_SET
+#define WS2812_PORT_SET(port, mask) ((port)->BSHR = (mask))
+#endif
+#ifndef WS2812_PORT_CLR
+#define WS2812_PORT_CLR(port, mask) ((port)->BCR = (mask))
+#endif
+
+// Emit n NOPs (n must be a compile-time constant), expanded by the assembler
+// so the count is independent of optimisation level
+#ifndef WS2812_NOPS
+#define WS2812_NOPS(n) __asm__ volatile(".rept %c0\n\tnop\n\t.endr" :: "i"(n))
+#endif
+
+// Marks the end of one slice of a port group's next-LED work, done in a low
+// phase; a host build can charge WS2812_GROUP_STEP_CYCLES for it
+#ifndef WS2812_GROUP_STEP_DONE
+#define WS2812_GROUP_STEP_DONE()
+#endif
+
+// Spin until a DMA backend's busy flag clears; a host build can define it to
+// play the transfer out instead of waiting for an interrupt
+#ifndef WS2812_DMA_WAIT
+#define WS2812_DMA_WAIT(busy) while (busy)
+#endif
+
+// Mask interrupts while the bit-bang senders clock out bits, and let them in
+// again in the low phase every WS2812_IRQ_OFF_BYTES wire bytes, so an ISR
+// never stretches a high phase and never waits longer than one section.
+// Set to 0 to send with interrupts left alone.
+#ifndef WS2812_IRQ_GUARD
+#define WS2812_IRQ_GUARD 1
+#endif
+// Wire bytes sent per critical section (3 = one RGB LED: 30us at 800kHz
+// nominal, up to about 40us on one pin and 60us for a port group, as their
+// 1 bits run longer than 1.25us)
+#ifndef WS2812_IRQ_OFF_BYTES
+#define WS2812_IRQ_OFF_BYTES 3
+#endif
+// Longest low gap an interrupt window may take: what is left of
+// WS2812_TL_MAX_NS once the slowest low phase and the next LED's fetch are
+// taken off (3us at 48MHz). A longer gap may have let the strip latch part of
+// the frame, so the frame is restarted once the reset time has passed.
+#ifndef WS2812_IRQ_GAP_MAX_US
+#define WS2812_IRQ_GAP_MAX_US (WS2812_SHADER_BUDGET_NS / 1000)
+#endif
+// Restarts tried per frame; after that the frame is sent whatever the gaps
+#ifndef WS2812_MAX_RESTARTS
+#define WS2812_MAX_RESTARTS 3
+#endif
+// Interrupt mask hooks, replaceable like the port hooks
+#ifndef WS2812_IRQ_DISABLE
+#define WS2812_IRQ_DISABLE() __disable_irq()
+#endif
+#ifndef WS2812_IRQ_ENABLE
+#define WS2812_IRQ_ENABLE() __enable_irq()
+#endif
+
+// Instrumentation: SysTick timing of rendering, transmission, latch waits and
+// idle time, printed by LED_StatsDump(). With 0 every hook compiles to nothing.
+#ifndef WS2812_STATS
+#define WS2812_STATS 0
+#endif
+
+// Power limiter: every output byte is added up as it is sent, and when the
+// estimated draw of all channels goes over the budget set with
+// WS2812_SetPowerBudget(), all channels are scaled down by one factor, folded
+// into their colour tables. Set to 1 to build it in.
+#ifndef WS2812_POWER_LIMIT
+#define WS2812_POWER_LIMIT 0
+#endif
+// Default current of one LED colour at full output, and of an idle LED in uA
+// (WS2812_SetPowerModel() changes them at run time)
+#ifndef WS2812_POWER_MA_RED
+#define WS2812_POWER_MA_RED 20
+#endif
+#ifndef WS2812_POWER_MA_GREEN
+#define WS2812_POWER_MA_GREEN 20
+#endif
+#ifndef WS2812_POWER_MA_BLUE
+#define WS2812_POWER_MA_BLUE 20
+#endif
+#ifndef WS2812_POWER_MA_WHITE
+#define WS2812_POWER_MA_WHITE 20
+#endif
+#ifndef WS2812_POWER_IDLE_UA
+#define WS2812_POWER_IDLE_UA 1000
+#endif
+// Scale steps (of 255) the allowed scale must rise by before the limiter
+// lets go again, so content hovering at the budget does not rebuild the tables every frame
+#ifndef WS2812_POWER_HYSTERESIS
+#define WS2812_POWER_HYSTERESIS 8
+#endif
+
+// Skip unchanged frames: WS2812_Commit() hashes a dirty channel's pixels and
+// colour settings and does not send it again if they match the frame the
+// LEDs already show (they hold it without refresh). The hash is a CRC-32: a
+// change within any 4 bytes in a row is always seen, and a frame that differs
+// more widely is taken for the one shown, and skipped, about once in 4
+// billion commits. Set to 1 to build it in.
+#ifndef WS2812_SKIP_UNCHANGED
+#define WS2812_SKIP_UNCHANGED 0
+#endif
+
+// Low power idle: WS2812_SleepUntil() stops the core with WFI until a SysTick
+// deadline or any other interrupt. Set to 1 to build it in (it takes SysTick_Handler).
+#ifndef WS2812_LOW_POWER
+#define WS2812_LOW_POWER 0
+#endif
+// Deadlines closer than this are waited for awake, the sleep would not pay for itself
+#ifndef WS2812_SLEEP_MIN_US
+#define WS2812_SLEEP_MIN_US 20
+#endif
+
+_Static_assert(WS2812_IRQ_OFF_BYTES >= 1 && WS2812_IRQ_OFF_BYTES <= 255, "WS2812_IRQ_OFF_BYTES must be 1-255");
+
+// Target bit timings in nanoseconds
+#ifndef WS2812_T0H_NS
+#define WS2812_T0H_NS 350
+#endif
+#ifndef WS2812_T1H_NS
+#define WS2812_T1H_NS 900
+#endif
+#ifndef WS2812_BIT_NS
+#define WS2812_BIT_NS 1250
+#endif
+
+// Limits the generated timing is checked against at compile time. The low
+// phase may stretch (well below the reset time), the high phases may not.
+#define WS2812_T0H_MAX_NS 450
+#define WS2812_T1H_MIN_NS 650
+#define WS2812_T1H_MAX_NS 1000
+#define WS2812_TL_MAX_NS 5000
+
+// Cycle costs of the bit-bang code around the delays, measured at 48MHz:
+// a port store, and the per-bit loop/shift/branch work done in the low phase
+#ifndef WS2812_PORT_WRITE_CYCLES
+#define WS2812_PORT_WRITE_CYCLES 4
+#endif
+#ifndef WS2812_BIT_LOOP_CYCLES
+#define WS2812_BIT_LOOP_CYCLES 31
+#endif
+
+// Delay lengths in NOPs, generated from the core clock
+#define WS2812_CPU_MHZ (WS2812_F_CPU / 1000000)
+#define WS2812_NS_TO_CYCLES(ns) (((ns) * WS2812_CPU_MHZ + 999) / 1000)
+#define WS2812_CYCLES_TO_NS(c) ((c) * 1000 / WS2812_CPU_MHZ)
+#define WS2812_SUB_SAT(a, b) ((a) > (b) ? (a) - (b) : 0)
+#define WS2812_MAX(a, b) ((a) > (b) ? (a) : (b))
+// x / 255 and x / 10 with a multiply by a constant and a shift (exact for x < 65535
+// and x < 16384): the core has no divider, and the tables are rebuilt at run time
+#define WS2812_DIV255(x) ((((uint32_t)(x) + 1) * 257) >> 16)
+#define WS2812_DIV10(x) (((uint32_t)(x) * 6554) >> 16)
+
+#define WS2812_T0H_CYCLES WS2812_NS_TO_CYCLES(WS2812_T0H_NS)
+#define WS2812_T1H_CYCLES WS2812_NS_TO_CYCLES(WS2812_T1H_NS)
+#define WS2812_BIT_CYCLES WS2812_NS_TO_CYCLES(WS2812_BIT_NS)
+
+#define WS2812_T0H_NOPS WS2812_SUB_SAT(WS2812_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_T1H_NOPS WS2812_SUB_SAT(WS2812_T1H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_T01H_NOPS WS2812_SUB_SAT(WS2812_T1H_CYCLES - WS2812_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_T0L_NOPS WS2812_SUB_SAT(WS2812_BIT_CYCLES - WS2812_T0H_CYCLES, WS2812_BIT_LOOP_CYCLES)
+#define WS2812_T1L_NOPS WS2812_SUB_SAT(WS2812_BIT_CYCLES - WS2812_T1H_CYCLES, WS2812_BIT_LOOP_CYCLES)
+
+// The same delays named by bit rate, pasted together by the generated senders
+#define WS2812_800K_T0H_NOPS WS2812_T0H_NOPS
+#define WS2812_800K_T1H_NOPS WS2812_T1H_NOPS
+#define WS2812_800K_T01H_NOPS WS2812_T01H_NOPS
+#define WS2812_800K_T0L_NOPS WS2812_T0L_NOPS
+#define WS2812_800K_T1L_NOPS WS2812_T1L_NOPS
+
+// WS2811 low speed mode: 0.5us / 1.2us high in a 2.5us bit
+#ifndef WS2811_T0H_NS
+#define WS2811_T0H_NS 500
+#endif
+#ifndef WS2811_T1H_NS
+#define WS2811_T1H_NS 1200
+#endif
+#ifndef WS2811_BIT_NS
+#define WS2811_BIT_NS 2500
+#endif
+#define WS2811_T0H_MAX_NS 650
+
+#define WS2811_T0H_CYCLES WS2812_NS_TO_CYCLES(WS2811_T0H_NS)
+#define WS2811_T1H_CYCLES WS2812_NS_TO_CYCLES(WS2811_T1H_NS)
+#define WS2811_BIT_CYCLES WS2812_NS_TO_CYCLES(WS2811_BIT_NS)
+
+#define WS2812_400K_T0H_NOPS WS2812_SUB_SAT(WS2811_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_400K_T1H_NOPS WS2812_SUB_SAT(WS2811_T1H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_400K_T01H_NOPS WS2812_SUB_SAT(WS2811_T1H_CYCLES - WS2811_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_400K_T0L_NOPS WS2812_SUB_SAT(WS2811_BIT_CYCLES - WS2811_T0H_CYCLES, WS2812_BIT_LOOP_CYCLES)
+#define WS2812_400K_T1L_NOPS WS2812_SUB_SAT(WS2811_BIT_CYCLES - WS2811_T1H_CYCLES, WS2812_BIT_LOOP_CYCLES)
+
+// Fail the build when this clock cannot produce valid WS2812 timing
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)) <= WS2812_T0H_MAX_NS,
+               "WS2812: core clock too slow for the T0H high time");
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_T1H_CYCLES, WS2812_PORT_WRITE_CYCLES)) >= WS2812_T1H_MIN_NS &&
+               WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_T1H_CYCLES, WS2812_PORT_WRITE_CYCLES)) <= WS2812_T1H_MAX_NS,
+               "WS2812: T1H high time out of range at this core clock");
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_BIT_CYCLES - WS2812_T0H_CYCLES, WS2812_BIT_LOOP_CYCLES)) <= WS2812_TL_MAX_NS,
+               "WS2812: core clock too slow for the bit loop low time");
+#if WS2812_PROFILE_400K
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2811_T0H_CYCLES, WS2812_PORT_WRITE_CYCLES)) <= WS2811_T0H_MAX_NS,
+               "WS2812: core clock too slow for the WS2811 T0H high time");
+#endif
+
+// Longest a shader generator (WS2812_SetShader) may take per LED. The
+// bit-bang senders call it with interrupts masked after the last bit of the
+// previous LED, so its time adds to that bit's low phase, as do the colour
+// tables, loop and timing around it (WS2812_SHADER_FETCH_CYCLES). Past
+// WS2812_TL_MAX_NS the strip may see a reset and latch part way. Every call
+// is timed against it; see WS2812_GetShaderStats().
+#ifndef WS2812_SHADER_FETCH_CYCLES
+#define WS2812_SHADER_FETCH_CYCLES 48
+#endif
+#if WS2812_PROFILE_400K
+#define WS2812_SHADER_LOW_CYCLES WS2812_MAX(WS2812_BIT_CYCLES - WS2812_T0H_CYCLES, WS2811_BIT_CYCLES - WS2811_T0H_CYCLES)
+#else
+#define WS2812_SHADER_LOW_CYCLES (WS2812_BIT_CYCLES - WS2812_T0H_CYCLES)
+#endif
+#define WS2812_SHADER_BUDGET_NS (WS2812_TL_MAX_NS - WS2812_CYCLES_TO_NS(WS2812_SHADER_LOW_CYCLES + WS2812_SHADER_FETCH_CYCLES))
+#define WS2812_SHADER_BUDGET_TICKS (WS2812_SHADER_BUDGET_NS * WS2812_TICKS_PER_US / 1000)
+#if WS2812_SHADER
+_Static_assert(WS2812_SHADER_BUDGET_TICKS > 0, "WS2812: core clock too slow to leave shader generators any time");
+#endif
+
+// Longest one slice of a port group's next-LED work (WS2812_GroupStep) may
+// take outside a shader: a pixel fetched through the colour tables, RGBW
+// auto-white included, or one wire byte transposed into 8 bit masks. It runs
+// in a bit's low phase after the loop work the NOPs allow for, so it stretches
+// that low phase, which must stay under WS2812_TL_MAX_NS. A shader call in a
+// slice is held to WS2812_SHADER_BUDGET_NS instead.
+#ifndef WS2812_GROUP_STEP_CYCLES
+#define WS2812_GROUP_STEP_CYCLES 64
+#endif
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_BIT_CYCLES - WS2812_T0H_CYCLES, WS2812_BIT_LOOP_CYCLES) +
+                                   WS2812_GROUP_STEP_CYCLES) <= WS2812_TL_MAX_NS,
+               "WS2812: core clock too slow to prepare a port group's next LED in the low phase");
+#if WS2812_PROFILE_400K
+_Static_assert(WS2812_CYCLES_TO_NS(WS2812_MAX(WS2811_BIT_CYCLES - WS2811_T0H_CYCLES, WS2812_BIT_LOOP_CYCLES) +
+                                   WS2812_GROUP_STEP_CYCLES) <= WS2812_TL_MAX_NS,
+               "WS2812: core clock too slow to prepare a WS2811 port group's next LED in the low phase");
+#endif
+#if WS2812_IRQ_GUARD
+_Static_assert(WS2812_IRQ_GAP_MAX_US >= 1, "WS2812: core clock too slow to leave interrupts a window between LEDs");
+#endif
+
+typedef struct WS2812_Channel WS2812_Channel_t;
+
+#if WS2812_STATS
+// Minimum, maximum and total of a measured duration, in SysTick counts
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;                  // Divide by count for the average
+    uint32_t count;
+} WS2812_StatTimer_t;
+
+// Add one measurement to a timer
+static void WS2812_StatAdd(WS2812_StatTimer_t* timer, uint32_t ticks) {
+    if (timer->count == 0 || ticks < timer->min) timer->min = ticks;
+    if (ticks > timer->max) timer->max = ticks;
+    timer->sum += ticks;
+    timer->count++;
+}
+
+// Instrumentation hooks, empty unless WS2812_STATS is set
+#define WS2812_STATS_START(var) uint32_t var = WS2812_Now()
+#define WS2812_STATS_STOP(timer, var) WS2812_StatAdd(&(timer), WS2812_Now() - (var))
+#define WS2812_STATS_ADD(timer, ticks) WS2812_StatAdd(&(timer), (ticks))
+#define WS2812_STATS_COUNT(counter) ((counter)++)
+#else
+#define WS2812_STATS_START(var)
+#define WS2812_STATS_STOP(timer, var)
+#define WS2812_STATS_ADD(timer, ticks)
+#define WS2812_STATS_COUNT(counter)
+#endif
+
+// Critical section state of a bit-bang frame
 typedef struct {
+    uint32_t off_start;            // SysTick count when interrupts were last masked
+    uint32_t gap_ticks;            // Longest interrupt window allowed before the frame is restarted
+} WS2812_IrqSection_t;
+
+// Pixel generator of a shader channel: writes LED i into pixel, stored like a
+// led_buffer entry (WS2812_R/G/B). Called for LED 0, 1, 2, ... in order every frame.
+typedef void (*WS2812_Shader_t)(void* state, uint16_t i, uint8_t pixel[3]);
+
+// Structure to hold configuration and state for a single LED channel
+struct WS2812_Channel {
     uint8_t gpio_pin;              // GPIO pin identifier
     GPIO_TypeDef* port;            // Pointer to GPIO port (GPIOA, GPIOB, etc.)
     uint8_t pin_num;               // Pin number (0-15)
     uint32_t pin_mask;             // Bitmask for pin (1 << pin_num)
     uint16_t led_count;            // Number of LEDs on this channel
-    uint8_t (*led_buffer)[3];      // Pointer to LED color buffer [led_count][3]
+    uint8_t (*led_buffer)[3];      // LED colour buffer [led_count][3] in the pixel arena, index with WS2812_R/G/B
+                                   // (palette indices instead on indexed channels, see format)
+#if WS2812_DOUBLE_BUFFER
+    uint8_t (*front_buffer)[3];    // Frame being transmitted, swapped with led_buffer by WS2812_Commit()
+#endif
     uint8_t brightness;            // Brightness level (0-255)
+    uint8_t gamma;                 // Gamma curve x10 (10 = linear, 22 = 2.2, max 30)
+    uint8_t correction[4];         // Colour correction for red, green, blue, white (255 = none)
+    const uint8_t* lut[4];         // Output tables for red, green, blue, white (brightness, correction, gamma)
+    uint8_t chip;                  // WS2812_CHIP_* profile
+    uint8_t bytes_per_pixel;       // 3, or 4 for RGBW chips
+    uint8_t speed;                 // WS2812_SPEED_* bit rate
+    uint8_t flags;                 // WS2812_FLAG_*
+    uint8_t order[3];              // Colour (0 red, 1 green, 2 blue) sent in each wire position
+    uint8_t pixel_index[3];        // Byte of a stored pixel sent in each wire position
+    uint8_t* white_buffer;         // White level per LED for RGBW chips, in the pixel arena
+    uint8_t format;                // WS2812_FORMAT_*: what led_buffer holds
+    uint8_t palette_mask;          // Palette entries - 1 (a power of two)
+    uint8_t palette_offset;        // Added to every index when sending, rotates the palette
+    const uint8_t (*palette)[3];   // Colours of an indexed channel, stored like led_buffer pixels
+    WS2812_Shader_t shader;        // Generator of a shader channel
+    void* shader_state;            // State block passed to the generator
+    uint8_t (*send)(WS2812_Channel_t* channel, WS2812_IrqSection_t* irq);  // Bit-bang sender generated for the profile
     uint8_t active;                // 1 if configured, 0 if not
-} WS2812_Channel_t;
+    uint8_t backend;               // WS2812_BACKEND_* used to transmit this channel
+    uint8_t dirty;                 // 1 if the buffer changed since it was last committed
+    uint16_t reset_us;             // Low time needed to latch a frame
+    uint32_t tx_start;             // SysTick count when the last frame started
+    uint32_t tx_end;               // SysTick count when the last frame ended (latch starts)
+    uint32_t frame_ticks;          // Duration of the last frame in SysTick counts
+#if WS2812_STATS
+    WS2812_StatTimer_t stat_transmit;  // Bit-bang: frame on the wire; DMA: encoding and starting the transfer
+    WS2812_StatTimer_t stat_latch;     // Waiting for the previous frame to latch (or DMA transfer to finish)
+#endif
+#if WS2812_POWER_LIMIT
+    uint32_t power_sum[4];         // Output bytes of the last frame sent, per wire position (white last)
+#endif
+#if WS2812_SKIP_UNCHANGED
+    uint32_t sent_hash;            // WS2812_FrameHash() of the frame on the LEDs, 0 = unknown
+#endif
+};
+
+// Channel-frames sent and skipped by WS2812_Commit()
+typedef struct {
+    uint32_t sent;                 // Channel-frames transmitted because they were dirty
+    uint32_t skipped;              // Channel-frames skipped because nothing changed
+    uint32_t unchanged;            // Dirty channel-frames skipped because they matched the LEDs (WS2812_SKIP_UNCHANGED)
+} WS2812_CommitStats_t;
+
+// Interrupt masking of the bit-bang senders
+typedef struct {
+    uint32_t max_off_ticks;        // Longest time interrupts were masked, in SysTick counts
+    uint32_t restarts;             // Frames restarted because an interrupt window ran too long
+} WS2812_IrqStats_t;
+
+// Shader generator calls timed by the send paths
+typedef struct {
+    uint32_t max_ticks;            // Longest call, in SysTick counts
+    uint32_t overruns;             // Calls over WS2812_SHADER_BUDGET_NS
+} WS2812_ShaderStats_t;
+
+// Time spent in WS2812_SleepUntil()
+typedef struct {
+    uint32_t sleeps;               // Times the core was stopped
+    uint32_t early;                // Sleeps ended by another interrupt before the deadline
+    uint32_t ticks;                // SysTick counts spent stopped
+} WS2812_SleepStats_t;
+
+// Power limiter settings
+typedef struct {
+    uint16_t budget_ma;            // Budget for all channels together, 0 = unlimited
+    uint16_t idle_ua;              // Draw of an LED showing black
+    uint8_t ma[4];                 // Draw of red, green, blue, white at full output
+    uint8_t scale;                 // Factor applied to every channel (255 = none)
+} WS2812_Power_t;
+
+// How often and how far the power limiter throttled
+typedef struct {
+    uint32_t frames;               // Commits checked against the budget
+    uint32_t throttled;            // Commits that went out scaled down
+    uint32_t cuts;                 // Frames found over budget, scaled down and sent again at once
+    uint32_t lut_failures;         // Channels a scale change left on their old tables (0 while WS2812_LUTFitsUnscaled() holds)
+    uint32_t scale_sum;            // Sum of the scale over throttled commits (divide by throttled for the average)
+    uint16_t last_ma;              // Estimated draw of the frames on the LEDs now
+    uint16_t peak_ma;              // Highest draw the content asked for, before scaling
+    uint8_t min_scale;             // Lowest scale used (255 = never throttled)
+} WS2812_PowerStats_t;
+
+// Buffer the send paths read: the front buffer when double buffering
+#if WS2812_DOUBLE_BUFFER
+#define WS2812_TX_BUFFER(ch) ((ch)->front_buffer)
+#else
+#define WS2812_TX_BUFFER(ch) ((ch)->led_buffer)
+#endif
+
+// Arena blocks are whole words
+#define WS2812_ARENA_ROUND(size) (((size) + 3) & ~3)
+
+// One allocation in the pixel arena and the pointer that refers to it
+typedef struct {
+    void** owner;                  // Pointer updated when the block moves
+    uint16_t size;                 // Block size in bytes (multiple of 4)
+} WS2812_ArenaBlock_t;
+
+// Pixel arena. Blocks are packed in allocation order; freeing one slides the
+// later blocks down and updates their owners, so the arena never fragments.
+static uint8_t ws2812_arena[WS2812_ARENA_SIZE] __attribute__((aligned(4)));
+static WS2812_ArenaBlock_t ws2812_arena_blocks[WS2812_ARENA_MAX_BLOCKS];
+static uint8_t ws2812_arena_count = 0;
+static uint16_t ws2812_arena_used = 0;
 
 // Array of LED channels
 static WS2812_Channel_t ws2812_channels[MAX_LED_CHANNELS] = {0};
 static uint8_t num_channels = 0;
+static WS2812_CommitStats_t ws2812_commit_stats = {0};
+static WS2812_IrqStats_t ws2812_irq_stats = {0};
+static WS2812_ShaderStats_t ws2812_shader_stats = {0};
+#if WS2812_POWER_LIMIT
+static WS2812_Power_t ws2812_power = {
+    0, WS2812_POWER_IDLE_UA,
+    {WS2812_POWER_MA_RED, WS2812_POWER_MA_GREEN, WS2812_POWER_MA_BLUE, WS2812_POWER_MA_WHITE},
+    255
+};
+static WS2812_PowerStats_t ws2812_power_stats = {0, 0, 0, 0, 0, 0, 0, 255};
+
+// Start a channel's output sums for a frame about to be sent
+#define WS2812_POWER_RESET(ch) memset((ch)->power_sum, 0, sizeof((ch)->power_sum))
+#else
+#define WS2812_POWER_RESET(ch)
+#endif
+#if WS2812_SKIP_UNCHANGED
+// A send outside WS2812_Commit() leaves the LEDs showing a frame it did not hash
+#define WS2812_HASH_FORGET(ch) ((ch)->sent_hash = 0)
+#else
+#define WS2812_HASH_FORGET(ch)
+#endif
+#if WS2812_LOW_POWER
+static WS2812_SleepStats_t ws2812_sleep_stats = {0};
+#endif
 
 // Forward declarations
 static uint8_t WS2812_GetPortFromPin(uint8_t gpio_pin, GPIO_TypeDef** port, uint8_t* pin_num);
 static void WS2812_SendBit(WS2812_Channel_t* channel, uint8_t bit);
+static void WS2812_SelectSender(WS2812_Channel_t* channel);
 static void WS2812_SendColor(WS2812_Channel_t* channel, uint8_t red, uint8_t green, uint8_t blue);
 static void WS2812_SendChannel(WS2812_Channel_t* channel);
 static void WS2812_SendAll(void);
+static void WS2812_SendParallel(uint8_t channel_mask);
+static void WS2812_Commit(void);
+static void WS2812_WaitAllIdle(void);
+#if WS2812_USE_SPI_DMA
+static void WS2812_SPI_SendChannel(WS2812_Channel_t* channel);
+#endif
+#if WS2812_USE_PWM_DMA
+static void WS2812_PWM_SendChannel(WS2812_Channel_t* channel);
+#endif
+
+// Millisecond clock accumulated from SysTick by WS2812_Millis()
+static uint32_t ws2812_millis = 0;
+static uint32_t ws2812_millis_tick = 0;  // SysTick count of the last whole millisecond
+
+// Bytes still free in the pixel arena
+static uint16_t WS2812_ArenaRemaining(void) {
+    return WS2812_ARENA_SIZE - ws2812_arena_used;
+}
+
+// Release the block *owner points to (if any) and set *owner to NULL.
+// Compacting moves the later blocks, so it first waits for every DMA backend to
+// stop reading: a stream refilling from a channel buffer mid-move would send
+// half-moved pixels. Safe to call from a present callback.
+static void WS2812_ArenaFree(void** owner) {
+    uint8_t i;
+    for (i = 0; i < ws2812_arena_count; i++) {
+        if (ws2812_arena_blocks[i].owner == owner) break;
+    }
+    if (i == ws2812_arena_count) return;
+    if (i + 1 < ws2812_arena_count) WS2812_WaitAllIdle();
+    
+    uint8_t* start = (uint8_t*)*owner;
+    uint16_t size = ws2812_arena_blocks[i].size;
+    uint8_t* end = start + size;
+    
+    // Close the gap and move the later blocks' owners with their data
+    memmove(start, end, ws2812_arena + ws2812_arena_used - end);
+    for (uint8_t j = i + 1; j < ws2812_arena_count; j++) {
+        *ws2812_arena_blocks[j].owner = (uint8_t*)*ws2812_arena_blocks[j].owner - size;
+        ws2812_arena_blocks[j - 1] = ws2812_arena_blocks[j];
+    }
+    
+    ws2812_arena_count--;
+    ws2812_arena_used -= size;
+    *owner = NULL;
+}
+
+// Size of the block *owner points to, 0 if it has none
+static uint16_t WS2812_ArenaBlockSize(void** owner) {
+    for (uint8_t i = 0; i < ws2812_arena_count; i++) {
+        if (ws2812_arena_blocks[i].owner == owner) return ws2812_arena_blocks[i].size;
+    }
+    return 0;
+}
+
+// 1 if a block of size bytes would fit once *owner's current block is released
+static uint8_t WS2812_ArenaFits(void** owner, uint16_t size) {
+    uint16_t old_size = WS2812_ArenaBlockSize(owner);
+    if (!old_size && ws2812_arena_count >= WS2812_ARENA_MAX_BLOCKS) return 0;
+    return WS2812_ARENA_ROUND(size) <= WS2812_ArenaRemaining() + old_size;
+}
+
+// Allocate a zeroed, 4-byte aligned block and store it in *owner, replacing
+// any block *owner already had. Returns NULL (and leaves *owner alone) if it does not fit.
+static void* WS2812_ArenaAlloc(void** owner, uint16_t size) {
+    if (!WS2812_ArenaFits(owner, size)) return NULL;
+    
+    WS2812_ArenaFree(owner);
+    size = WS2812_ARENA_ROUND(size);
+    
+    ws2812_arena_blocks[ws2812_arena_count].owner = owner;
+    ws2812_arena_blocks[ws2812_arena_count].size = size;
+    ws2812_arena_count++;
+    
+    *owner = ws2812_arena + ws2812_arena_used;
+    ws2812_arena_used += size;
+    memset(*owner, 0, size);
+    return *owner;
+}
+
+// Exchange the blocks two owners point to, keeping the block table in step
+static void WS2812_ArenaSwap(void** a, void** b) {
+    for (uint8_t i = 0; i < ws2812_arena_count; i++) {
+        if (ws2812_arena_blocks[i].owner == a) {
+            ws2812_arena_blocks[i].owner = b;
+        } else if (ws2812_arena_blocks[i].owner == b) {
+            ws2812_arena_blocks[i].owner = a;
+        }
+    }
+    
+    void* t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// Start SysTick as a free-running counter at HCLK/8, used for latch deadlines
+// and frame timing. The SDK's Delay_Us/Delay_Ms would stop it, so below they
+// are replaced by the driver's delays.
+static void WS2812_TimeInit(void) {
+    if (SysTick->CTLR & 1) return;
+    
+    SysTick->SR = 0;
+    SysTick->CMP = 0xFFFFFFFF;
+    SysTick->CNT = 0;
+    SysTick->CTLR = 1;  // Enable, HCLK/8, no reload, no interrupt
+    ws2812_millis_tick = 0;
+}
+
+// Current SysTick count (WS2812_TICKS_PER_US per microsecond, wraps every ~12 minutes at 48MHz)
+static inline uint32_t WS2812_Now(void) {
+    return SysTick->CNT;
+}
+
+// Monotonic milliseconds since WS2812_TimeInit(). Whole milliseconds are moved
+// from the SysTick counter into the clock on each call, so it stays exact as
+// long as it is called at least once per SysTick wrap (~12 minutes at 48MHz).
+static uint32_t WS2812_Millis(void) {
+    uint32_t elapsed = WS2812_Now() - ws2812_millis_tick;
+    
+    if (elapsed >= WS2812_TICKS_PER_MS) {
+        uint32_t ms = elapsed / WS2812_TICKS_PER_MS;
+        ws2812_millis += ms;
+        ws2812_millis_tick += ms * WS2812_TICKS_PER_MS;
+    }
+    return ws2812_millis;
+}
+
+// Busy-wait on the SysTick counter
+static void WS2812_DelayUs(uint32_t us) {
+    uint32_t start = WS2812_Now();
+    while ((uint32_t)(WS2812_Now() - start) < WS2812_US_TO_TICKS(us));
+}
+
+static void WS2812_DelayMs(uint32_t ms) {
+    while (ms--) {
+        WS2812_DelayUs(1000);
+    }
+}
+
+// The SDK's Delay_Us/Delay_Ms reload SysTick and leave it stopped, freezing
+// the clock every deadline and animation runs on. Calls compiled after this
+// header busy-wait on the running counter instead (starting it if needed).
+// Define WS2812_SDK_DELAY to keep the SDK's versions.
+#ifndef WS2812_SDK_DELAY
+#define Delay_Us(n) (WS2812_TimeInit(), WS2812_DelayUs(n))
+#define Delay_Ms(n) (WS2812_TimeInit(), WS2812_DelayMs(n))
+#endif
+
+#if WS2812_LOW_POWER
+// SysTick CTLR: compare interrupt enable
+#define WS2812_SYSTICK_STIE (1 << 1)
+
+// Ends a WS2812_SleepUntil() at its deadline
+void SysTick_Handler(void) __attribute__((interrupt));
+void SysTick_Handler(void) {
+    SysTick->CTLR &= ~WS2812_SYSTICK_STIE;
+    SysTick->SR = 0;
+}
+
+// Stop the core with WFI until the SysTick count reaches deadline or another
+// interrupt comes in (received data, a DMA transfer ending, a button). Clocks,
+// peripherals and DMA keep running, so SysTick time and transfers carry on.
+// Returns 1 if it slept, 0 if the deadline was too close to bother.
+static uint8_t WS2812_SleepUntil(uint32_t deadline) {
+    WS2812_IRQ_DISABLE();
+    uint32_t start = WS2812_Now();
+    if ((int32_t)(deadline - start) < (int32_t)WS2812_US_TO_TICKS(WS2812_SLEEP_MIN_US)) {
+        WS2812_IRQ_ENABLE();
+        return 0;
+    }
+    
+    SysTick->CMP = deadline;
+    SysTick->SR = 0;
+    SysTick->CTLR |= WS2812_SYSTICK_STIE;
+    NVIC_EnableIRQ(SysTicK_IRQn);
+    
+    // Interrupts are masked, so one arriving before the WFI still ends it
+    // instead of being handled first and leaving the core asleep
+    __WFI();
+    uint32_t end = WS2812_Now();
+    SysTick->CTLR &= ~WS2812_SYSTICK_STIE;
+    SysTick->SR = 0;
+    WS2812_IRQ_ENABLE();
+    
+    ws2812_sleep_stats.sleeps++;
+    ws2812_sleep_stats.ticks += end - start;
+    if ((int32_t)(end - deadline) < 0) ws2812_sleep_stats.early++;
+    return 1;
+}
+
+// Sleeps and time asleep since the last WS2812_ResetSleepStats()
+static const WS2812_SleepStats_t* WS2812_GetSleepStats(void) {
+    return &ws2812_sleep_stats;
+}
+
+static void WS2812_ResetSleepStats(void) {
+    memset(&ws2812_sleep_stats, 0, sizeof(ws2812_sleep_stats));
+}
+#endif
 
 // Map GPIO pin to port and pin number
 static uint8_t WS2812_GetPortFromPin(uint8_t gpio_pin, GPIO_TypeDef** port, uint8_t* pin_num) {
@@ -76,6 +829,343 @@ static uint8_t WS2812_GetPortFromPin(uint8_t gpio_pin, GPIO_TypeDef** port, uint
     return 1;
 }
 
+// Shared colour lookup tables, their keys and how many channel colours use each
+static uint8_t ws2812_lut[WS2812_LUT_COUNT][256];
+static uint8_t ws2812_lut_scale[WS2812_LUT_COUNT];
+static uint8_t ws2812_lut_gamma[WS2812_LUT_COUNT] = {0};  // 0 = slot never built
+static uint8_t ws2812_lut_refs[WS2812_LUT_COUNT] = {0};
+
+// Fill a table with value^gamma scaled to 0..scale. Gamma is approximated by
+// blending integer powers (x, x^2, x^3), so no floating point is pulled in,
+// and no division either.
+static void WS2812_BuildLUT(uint8_t* table, uint8_t scale, uint8_t gamma) {
+    for (uint16_t x = 0; x < 256; x++) {
+        uint32_t x2 = WS2812_DIV255(x * x);
+        uint32_t x3 = WS2812_DIV255(x2 * x);
+        uint32_t curved;
+        
+        if (gamma <= 20) {
+            curved = WS2812_DIV10(x * (20 - gamma) + x2 * (gamma - 10));
+        } else {
+            curved = WS2812_DIV10(x2 * (30 - gamma) + x3 * (gamma - 20));
+        }
+        table[x] = WS2812_DIV255(curved * scale);
+    }
+}
+
+// Find the table built for a scale/gamma pair (used or cached), or -1
+static int8_t WS2812_FindLUT(uint8_t scale, uint8_t gamma) {
+    for (uint8_t t = 0; t < WS2812_LUT_COUNT; t++) {
+        if (ws2812_lut_gamma[t] == gamma && ws2812_lut_scale[t] == scale) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+#if WS2812_POWER_LIMIT
+// Add the unscaled tables of one channel's settings to a set of scale/gamma
+// pairs. Returns 0 if the set would outgrow the pool.
+static uint8_t WS2812_LUTSetAdd(uint8_t* scales, uint8_t* gammas, uint8_t* count,
+                                uint8_t bright_level, uint8_t gamma, const uint8_t correction[4]) {
+    for (uint8_t c = 0; c < 4; c++) {
+        uint8_t scale = WS2812_DIV255((uint16_t)bright_level * correction[c]);
+        uint8_t t = 0;
+        
+        while (t < *count && (scales[t] != scale || gammas[t] != gamma)) t++;
+        if (t < *count) continue;
+        if (*count == WS2812_LUT_COUNT) return 0;
+        scales[t] = scale;
+        gammas[t] = gamma;
+        (*count)++;
+    }
+    return 1;
+}
+
+// 1 if the tables of every active channel, with ch on the given settings, fit
+// the pool at full power. Settings are only accepted if they do, which keeps
+// room for the limiter: one factor applied to every table never needs more
+// distinct tables than that, so WS2812_SetPowerScale() cannot run out.
+static uint8_t WS2812_LUTFitsUnscaled(const WS2812_Channel_t* ch, uint8_t bright_level, uint8_t gamma, const uint8_t correction[4]) {
+    uint8_t scales[WS2812_LUT_COUNT];
+    uint8_t gammas[WS2812_LUT_COUNT];
+    uint8_t count = 0;
+    
+    for (uint8_t i = 0; i < MAX_LED_CHANNELS; i++) {
+        const WS2812_Channel_t* other = &ws2812_channels[i];
+        if (other == ch || !other->active || !other->lut[0]) continue;
+        if (!WS2812_LUTSetAdd(scales, gammas, &count, other->brightness, other->gamma, other->correction)) return 0;
+    }
+    return WS2812_LUTSetAdd(scales, gammas, &count, bright_level, gamma, correction);
+}
+#endif
+
+// Point a channel at the tables for colour settings (and the power limiter's
+// scale), building the ones that do not exist yet. Tables are only built here,
+// never in the send path. Returns 0 (settings unchanged) when the table pool
+// cannot hold them.
+static uint8_t WS2812_AssignLUT(WS2812_Channel_t* ch, uint8_t bright_level, uint8_t gamma, const uint8_t correction[4]) {
+    uint8_t scale[4];
+    uint8_t released[WS2812_LUT_COUNT] = {0};
+    uint8_t wanted[WS2812_LUT_COUNT] = {0};
+    uint8_t needed = 0;
+    uint8_t available = 0;
+    
+    // Tables this channel gives up
+    for (uint8_t c = 0; c < 4; c++) {
+        if (ch->lut[c]) released[(ch->lut[c] - ws2812_lut[0]) >> 8]++;
+    }
+    
+    // Distinct tables the new settings need that are not built yet
+    for (uint8_t c = 0; c < 4; c++) {
+        scale[c] = WS2812_DIV255((uint16_t)bright_level * correction[c]);
+#if WS2812_POWER_LIMIT
+        scale[c] = WS2812_DIV255((uint16_t)scale[c] * ws2812_power.scale);
+#endif
+        
+        int8_t t = WS2812_FindLUT(scale[c], gamma);
+        if (t >= 0) {
+            wanted[t] = 1;
+        } else {
+            uint8_t repeat = 0;
+            for (uint8_t e = 0; e < c; e++) {
+                if (scale[e] == scale[c]) repeat = 1;
+            }
+            if (!repeat) needed++;
+        }
+    }
+    
+    // Slots that will be unused and are not kept for one of the new settings
+    for (uint8_t t = 0; t < WS2812_LUT_COUNT; t++) {
+        if (ws2812_lut_refs[t] == released[t] && !wanted[t]) available++;
+    }
+    if (needed > available) return 0;
+    
+    for (uint8_t t = 0; t < WS2812_LUT_COUNT; t++) {
+        ws2812_lut_refs[t] -= released[t];
+    }
+    
+    for (uint8_t c = 0; c < 4; c++) {
+        int8_t t = WS2812_FindLUT(scale[c], gamma);
+        
+        if (t < 0) {
+            for (t = 0; ws2812_lut_refs[t] || wanted[t]; t++);
+            ws2812_lut_scale[t] = scale[c];
+            ws2812_lut_gamma[t] = gamma;
+            WS2812_BuildLUT(ws2812_lut[t], scale[c], gamma);
+            wanted[t] = 1;
+        }
+        ws2812_lut_refs[t]++;
+        ch->lut[c] = ws2812_lut[t];
+    }
+    
+    ch->brightness = bright_level;
+    ch->gamma = gamma;
+    ch->correction[0] = correction[0];
+    ch->correction[1] = correction[1];
+    ch->correction[2] = correction[2];
+    ch->correction[3] = correction[3];
+    return 1;
+}
+
+// Rebuild a channel's tables for new colour settings. Returns 0 (settings
+// unchanged) when the table pool cannot hold them (with the power limiter: at
+// full power).
+static uint8_t WS2812_UpdateLUT(WS2812_Channel_t* ch, uint8_t bright_level, uint8_t gamma, const uint8_t correction[4]) {
+    if (gamma < 10) gamma = 10;
+    if (gamma > 30) gamma = 30;
+#if WS2812_POWER_LIMIT
+    if (!WS2812_LUTFitsUnscaled(ch, bright_level, gamma, correction)) return 0;
+#endif
+    return WS2812_AssignLUT(ch, bright_level, gamma, correction);
+}
+
+// Set up a freshly configured channel's colour tables (no correction, linear)
+static uint8_t WS2812_InitChannelColor(WS2812_Channel_t* ch, uint8_t bright_level) {
+    static const uint8_t no_correction[4] = {255, 255, 255, 255};
+    return WS2812_UpdateLUT(ch, bright_level, 10, no_correction);
+}
+
+// Colour (0 red, 1 green, 2 blue) sent in each wire position, per WS2812_ORDER_*
+static const uint8_t ws2812_orders[6][3] = {
+    {1, 0, 2},   // GRB
+    {0, 1, 2},   // RGB
+    {2, 0, 1},   // BRG
+    {0, 2, 1},   // RBG
+    {1, 2, 0},   // GBR
+    {2, 1, 0},   // BGR
+};
+
+// Byte of a stored pixel holding red, green, blue
+static const uint8_t ws2812_storage_index[3] = {WS2812_R, WS2812_G, WS2812_B};
+
+static void WS2812_SetColorOrderOf(WS2812_Channel_t* ch, uint8_t order) {
+    for (uint8_t k = 0; k < 3; k++) {
+        ch->order[k] = ws2812_orders[order][k];
+        ch->pixel_index[k] = ws2812_storage_index[ch->order[k]];
+    }
+}
+
+// Bytes a pixel buffer of led_count LEDs needs in a WS2812_FORMAT_*
+static uint32_t WS2812_PixelBytes(uint16_t led_count, uint8_t format) {
+    if (format == WS2812_FORMAT_PAL8) return led_count;
+    if (format == WS2812_FORMAT_PAL4) return (led_count + 1) >> 1;
+    if (format == WS2812_FORMAT_SHADER) return 0;
+    return (uint32_t)led_count * 3;
+}
+
+// 1 if a channel holds palette indices (WS2812_FORMAT_PAL8 / PAL4)
+static inline uint8_t WS2812_IsIndexed(const WS2812_Channel_t* ch) {
+    return ch->format == WS2812_FORMAT_PAL8 || ch->format == WS2812_FORMAT_PAL4;
+}
+
+// 1 if a channel has pixels to send: a buffer, or a generator on shader channels
+static inline uint8_t WS2812_HasPixels(const WS2812_Channel_t* ch) {
+    return ch->led_buffer != NULL || ch->format == WS2812_FORMAT_SHADER;
+}
+
+#if WS2812_SKIP_UNCHANGED
+// CRC-32 (the Ethernet/zlib polynomial) of each 4-bit step, 64 bytes of flash
+// instead of the 1KB byte table; no multiply, two table loads per byte
+static const uint32_t ws2812_crc_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+// Run bytes through a CRC-32. Plain sums cost less but miss small changes
+// that cancel out: +1 -1 -1 +1 on four bytes in a row keeps a Fletcher pair.
+static void WS2812_HashBytes(uint32_t* crc, const uint8_t* data, uint32_t len) {
+    uint32_t c = *crc;
+    
+    while (len--) {
+        c ^= *data++;
+        c = (c >> 4) ^ ws2812_crc_nibble[c & 0x0F];
+        c = (c >> 4) ^ ws2812_crc_nibble[c & 0x0F];
+    }
+    *crc = c;
+}
+
+// Hash of everything that decides a channel's wire bytes: the pixels, the
+// white plane, the palette and the colour settings. 0 for shader channels,
+// whose frames are only known while they are sent; never 0 otherwise.
+static uint32_t WS2812_FrameHash(const WS2812_Channel_t* ch) {
+    uint32_t crc = 0xFFFFFFFF;
+    
+    if (!ch->led_buffer) return 0;
+    
+    uint8_t settings[] = {
+        ch->brightness, ch->gamma, ch->correction[0], ch->correction[1], ch->correction[2], ch->correction[3],
+        ch->chip, ch->flags, ch->order[0], ch->order[1], ch->format, ch->palette_offset,
+        (uint8_t)ch->led_count, (uint8_t)(ch->led_count >> 8),
+#if WS2812_POWER_LIMIT
+        ws2812_power.scale,
+#endif
+    };
+    WS2812_HashBytes(&crc, settings, sizeof(settings));
+    WS2812_HashBytes(&crc, (const uint8_t*)ch->led_buffer, WS2812_PixelBytes(ch->led_count, ch->format));
+    if (ch->white_buffer) WS2812_HashBytes(&crc, ch->white_buffer, ch->led_count);
+    if (ch->palette) WS2812_HashBytes(&crc, ch->palette[0], ((uint32_t)ch->palette_mask + 1) * 3);
+    
+    crc = ~crc;
+    return crc ? crc : 1;
+}
+#endif
+
+// Common channel setup for every backend: colour tables, an arena buffer and
+// the channel fields. Reconfiguring a channel reuses its arena space.
+static uint8_t WS2812_SetupChannel(uint8_t channel_idx, uint8_t gpio_pin, GPIO_TypeDef* port, uint8_t pin_num,
+                                   uint16_t led_count_param, uint8_t bright_level, uint8_t backend) {
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    WS2812_TimeInit();
+    
+    // Check the arena has room, counting the space the channel already holds
+    uint32_t size = WS2812_ARENA_ROUND(WS2812_PixelBytes(led_count_param, WS2812_FORMAT_RGB));
+    uint16_t held = WS2812_ArenaBlockSize((void**)&ch->led_buffer);
+#if WS2812_DOUBLE_BUFFER
+    held += WS2812_ArenaBlockSize((void**)&ch->front_buffer);
+#endif
+    if (size * WS2812_CHANNEL_BUFFERS > WS2812_ArenaRemaining() + held) return 0;
+    if (!held && ws2812_arena_count + WS2812_CHANNEL_BUFFERS > WS2812_ARENA_MAX_BLOCKS) return 0;
+    
+    // Build the colour tables for this channel's brightness
+    if (!WS2812_InitChannelColor(ch, bright_level)) return 0;
+    
+    // Allocate the buffer(s) for this channel, initialised to off (all zeros)
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaFree((void**)&ch->front_buffer);
+#endif
+    WS2812_ArenaAlloc((void**)&ch->led_buffer, led_count_param * 3);
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaAlloc((void**)&ch->front_buffer, led_count_param * 3);
+#endif
+    
+    // Store channel configuration
+    ch->gpio_pin = gpio_pin;
+    ch->port = port;
+    ch->pin_num = pin_num;
+    ch->pin_mask = 1 << pin_num;
+    ch->led_count = led_count_param;
+    ch->active = 1;
+    ch->backend = backend;
+    ch->dirty = 1;
+    WS2812_HASH_FORGET(ch);
+    ch->reset_us = WS2812_DEFAULT_RESET_US;
+    ch->tx_end = WS2812_Now();
+    
+    // Plain WS2812 until WS2812_SetChipProfile() says otherwise
+    WS2812_ArenaFree((void**)&ch->white_buffer);
+    ch->chip = WS2812_CHIP_WS2812;
+    ch->bytes_per_pixel = 3;
+    ch->speed = WS2812_SPEED_800K;
+    ch->flags = 0;
+    ch->format = WS2812_FORMAT_RGB;
+    ch->palette = NULL;
+    ch->palette_mask = 0;
+    ch->palette_offset = 0;
+    ch->shader = NULL;
+    ch->shader_state = NULL;
+    WS2812_SetColorOrderOf(ch, WS2812_ORDER_GRB);
+    WS2812_SelectSender(ch);
+    
+    if (channel_idx >= num_channels) {
+        num_channels = channel_idx + 1;
+    }
+    
+    return 1;
+}
+
+// Release a channel's buffer and colour tables so the space can be reused
+static void WS2812_FreeChannel(uint8_t channel_idx) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    WS2812_ArenaFree((void**)&ch->led_buffer);
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaFree((void**)&ch->front_buffer);
+#endif
+    WS2812_ArenaFree((void**)&ch->white_buffer);
+    for (uint8_t c = 0; c < 4; c++) {
+        if (ch->lut[c]) ws2812_lut_refs[(ch->lut[c] - ws2812_lut[0]) >> 8]--;
+        ch->lut[c] = NULL;
+    }
+    ch->active = 0;
+    ch->dirty = 0;
+}
+
+// Arena bytes a channel's pixel buffers use: round4(3 * LEDs), or less for
+// indexed channels, twice with WS2812_DOUBLE_BUFFER
+static uint16_t WS2812_GetChannelMemory(uint8_t channel_idx) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    uint16_t bytes = WS2812_ArenaBlockSize((void**)&ch->led_buffer);
+#if WS2812_DOUBLE_BUFFER
+    bytes += WS2812_ArenaBlockSize((void**)&ch->front_buffer);
+#endif
+    return bytes;
+}
+
 // Configure a new LED channel with independent buffer
 static uint8_t WS2812_ConfigureChannel(uint8_t channel_idx, uint8_t gpio_pin, uint16_t led_count_param, uint8_t bright_level) {
     if (channel_idx >= MAX_LED_CHANNELS) return 0;
@@ -89,22 +1179,9 @@ static uint8_t WS2812_ConfigureChannel(uint8_t channel_idx, uint8_t gpio_pin, ui
         return 0;
     }
     
-    // Allocate buffer for this channel
-    uint8_t (*buffer)[3] = (uint8_t (*)[3])malloc(led_count_param * 3);
-    if (!buffer) return 0;
-    
-    // Initialize buffer to off (all zeros)
-    memset(buffer, 0, led_count_param * 3);
-    
-    // Store channel configuration
-    ws2812_channels[channel_idx].gpio_pin = gpio_pin;
-    ws2812_channels[channel_idx].port = port;
-    ws2812_channels[channel_idx].pin_num = pin_num;
-    ws2812_channels[channel_idx].pin_mask = 1 << pin_num;
-    ws2812_channels[channel_idx].led_count = led_count_param;
-    ws2812_channels[channel_idx].led_buffer = buffer;
-    ws2812_channels[channel_idx].brightness = bright_level;
-    ws2812_channels[channel_idx].active = 1;
+    if (!WS2812_SetupChannel(channel_idx, gpio_pin, port, pin_num, led_count_param, bright_level, WS2812_BACKEND_BITBANG)) {
+        return 0;
+    }
     
     // Configure pin as output (50MHz, push-pull)
     uint32_t pin_config = (GPIO_Speed_50MHz | GPIO_Mode_Out_PP) << (pin_num * 4);
@@ -115,91 +1192,640 @@ static uint8_t WS2812_ConfigureChannel(uint8_t channel_idx, uint8_t gpio_pin, ui
     // Initial state is low
     port->BCR = ws2812_channels[channel_idx].pin_mask;
     
-    if (channel_idx >= num_channels) {
-        num_channels = channel_idx + 1;
+    return 1;
+}
+
+// Flag a channel for transmission on the next WS2812_Commit().
+// Call this after writing to a buffer obtained with LED_GetChannelBuffer().
+static void WS2812_MarkDirty(uint8_t channel_idx) {
+    if (channel_idx < MAX_LED_CHANNELS) {
+        ws2812_channels[channel_idx].dirty = 1;
     }
+}
+
+// Set one pixel and mark the channel dirty
+static void WS2812_SetPixel(uint8_t channel_idx, uint16_t position, uint8_t red, uint8_t green, uint8_t blue) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || ch->format != WS2812_FORMAT_RGB || position >= ch->led_count) return;
+    
+    ch->led_buffer[position][WS2812_R] = red;
+    ch->led_buffer[position][WS2812_G] = green;
+    ch->led_buffer[position][WS2812_B] = blue;
+    ch->dirty = 1;
+}
+
+// Set a channel's brightness (0-255). Returns 0 if the table pool is full.
+static uint8_t WS2812_SetBrightness(uint8_t channel_idx, uint8_t bright_level) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
     
+    if (!WS2812_UpdateLUT(ch, bright_level, ch->gamma, ch->correction)) return 0;
+    ch->dirty = 1;
     return 1;
 }
 
-// Utility
-int Map_Range(int value, int inMin, int inMax, int outMin, int outMax) {
-    // Make sure the input value is within the input range
-    value = value < inMin ? inMin : value;
-    value = value > inMax ? inMax : value;
-    // Map the value from the input range to the output range
-    return (value - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+// Set a channel's gamma curve x10 (10 = linear, 22 = gamma 2.2, up to 30).
+// Returns 0 if the table pool is full.
+static uint8_t WS2812_SetGamma(uint8_t channel_idx, uint8_t gamma) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    if (!WS2812_UpdateLUT(ch, ch->brightness, gamma, ch->correction)) return 0;
+    ch->dirty = 1;
+    return 1;
 }
 
-// Send a single bit on a specific channel
-static void WS2812_SendBit(WS2812_Channel_t* channel, uint8_t bit) {
-    if (bit) {
-        // Send a 1 bit (high for ~800ns, low for ~400ns)
-        channel->port->BSHR = channel->pin_mask;
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        
-        channel->port->BCR = channel->pin_mask;
-    } else {
-        // Send a 0 bit (high for ~400ns, low for ~400ns)
-        channel->port->BSHR = channel->pin_mask;
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");
-        
-        channel->port->BCR = channel->pin_mask;
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
-        __asm__("nop");__asm__("nop");__asm__("nop");__asm__("nop");
+// Set a channel's per-colour correction (255 = full). Returns 0 if the table pool is full.
+static uint8_t WS2812_SetColorCorrection(uint8_t channel_idx, uint8_t red, uint8_t green, uint8_t blue) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    uint8_t correction[4] = {red, green, blue, ch->correction[3]};
+    
+    if (!WS2812_UpdateLUT(ch, ch->brightness, ch->gamma, correction)) return 0;
+    ch->dirty = 1;
+    return 1;
+}
+
+// Set the low time a channel needs to latch (e.g. WS2812_RESET_US_WS2812)
+static void WS2812_SetResetTime(uint8_t channel_idx, uint16_t reset_us) {
+    if (channel_idx < MAX_LED_CHANNELS) {
+        ws2812_channels[channel_idx].reset_us = reset_us;
     }
 }
 
-// Send a single color for a single LED on a specific channel
-static void WS2812_SendColor(WS2812_Channel_t* channel, uint8_t red, uint8_t green, uint8_t blue) {
-    uint8_t g = Map_Range(green, 0, 255, 0, (channel->brightness - 100));
-    uint8_t r = Map_Range(red, 0, 255, 0, channel->brightness);
-    uint8_t b = Map_Range(blue, 0, 255, 0, (channel->brightness - 100));
+// Set a channel's colour order on the wire (WS2812_ORDER_*)
+static void WS2812_SetColorOrder(uint8_t channel_idx, uint8_t order) {
+    if (channel_idx >= MAX_LED_CHANNELS || order > WS2812_ORDER_BGR) return;
     
-    // Send green (MSB)
-    for (int i = 7; i >= 0; i--) {
-        WS2812_SendBit(channel, (g >> i) & 1);
-    }
-    // Send red
-    for (int i = 7; i >= 0; i--) {
-        WS2812_SendBit(channel, (r >> i) & 1);
+    WS2812_SetColorOrderOf(&ws2812_channels[channel_idx], order);
+    ws2812_channels[channel_idx].dirty = 1;
+}
+
+// Select a channel's chip (WS2812_CHIP_*): pixel size, colour order, bit rate and
+// reset time. RGBW chips get a white plane of one byte per LED from the arena,
+// so the RGB buffer layout stays the same. The DMA backends only send 3-byte
+// 800kHz chips. Returns 0 if the chip is not supported on this channel.
+static uint8_t WS2812_SetChipProfile(uint8_t channel_idx, uint8_t chip) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    uint8_t bytes = (chip == WS2812_CHIP_SK6812_RGBW) ? 4 : 3;
+    uint8_t speed = (chip == WS2812_CHIP_WS2811) ? WS2812_SPEED_400K : WS2812_SPEED_800K;
+    
+    if (chip > WS2812_CHIP_WS2811) return 0;
+    if (!WS2812_PROFILE_RGBW && bytes == 4) return 0;
+    if (!WS2812_PROFILE_400K && speed == WS2812_SPEED_400K) return 0;
+    if (ch->backend != WS2812_BACKEND_BITBANG && (bytes != 3 || speed != WS2812_SPEED_800K)) return 0;
+    if (ch->format != WS2812_FORMAT_RGB && bytes != 3) return 0;
+    
+    if (bytes == 4) {
+        if (!ch->white_buffer && !WS2812_ArenaAlloc((void**)&ch->white_buffer, ch->led_count)) return 0;
+    } else {
+        WS2812_ArenaFree((void**)&ch->white_buffer);
     }
-    // Send blue (LSB)
-    for (int i = 7; i >= 0; i--) {
-        WS2812_SendBit(channel, (b >> i) & 1);
+    
+    ch->chip = chip;
+    ch->bytes_per_pixel = bytes;
+    ch->speed = speed;
+    WS2812_SetColorOrderOf(ch, chip == WS2812_CHIP_WS2811 ? WS2812_ORDER_RGB : WS2812_ORDER_GRB);
+    
+    switch (chip) {
+        case WS2812_CHIP_WS2813: ch->reset_us = WS2812_RESET_US_WS2813; break;
+        case WS2812_CHIP_WS2811: ch->reset_us = WS2812_RESET_US_WS2811; break;
+        case WS2812_CHIP_SK6812:
+        case WS2812_CHIP_SK6812_RGBW: ch->reset_us = WS2812_RESET_US_SK6812; break;
+        default: ch->reset_us = WS2812_RESET_US_WS2812B; break;
     }
     
-    Delay_Us(150);
+    WS2812_SelectSender(ch);
+    ch->dirty = 1;
+    return 1;
 }
 
-// Send the entire buffer for a single channel
-static void WS2812_SendChannel(WS2812_Channel_t* channel) {
-    if (!channel->active || !channel->led_buffer) return;
+// RGBW chips: derive white from the common part of red, green and blue when
+// sending, on top of the white plane
+static void WS2812_SetAutoWhite(uint8_t channel_idx, uint8_t enable) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
     
-    for (uint16_t i = 0; i < channel->led_count; i++) {
-        WS2812_SendColor(channel, 
-                        channel->led_buffer[i][0],  // Red
-                        channel->led_buffer[i][1],  // Green
-                        channel->led_buffer[i][2]); // Blue
+    if (enable) {
+        ch->flags |= WS2812_FLAG_AUTO_WHITE;
+    } else {
+        ch->flags &= ~WS2812_FLAG_AUTO_WHITE;
     }
+    WS2812_SelectSender(ch);
+    ch->dirty = 1;
+}
+
+// Set the white level of one LED on an RGBW channel
+static void WS2812_SetWhite(uint8_t channel_idx, uint16_t position, uint8_t white) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || !ch->white_buffer || position >= ch->led_count) return;
     
-    Delay_Us(150); // Frame separator
+    ch->white_buffer[position] = white;
+    ch->dirty = 1;
 }
 
-// Send data to all configured channels
+// Palette-indexed channels
+// An indexed channel stores one byte (PAL8) or one nibble (PAL4) per LED
+// instead of three. The senders look every index up in the channel's palette
+// while the frame goes out, so no full-colour copy of the strip exists
+// anywhere. Adding palette_offset to every index rotates the colours of the
+// whole strip by changing one byte.
+
+// Point an indexed channel at a palette of entries colours: a power of two,
+// at most 16 for PAL4 and 256 for PAL8. The table is used in place (stored
+// like led_buffer pixels, see WS2812_RGB()), so it can be a const table in
+// flash or a RAM table changed at run time. Returns 0 if it does not fit the format.
+static uint8_t WS2812_SetPalette(uint8_t channel_idx, const uint8_t (*palette)[3], uint16_t entries) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    if (!ch->active || !WS2812_IsIndexed(ch) || !palette) return 0;
+    if (entries == 0 || (entries & (entries - 1)) || entries > (ch->format == WS2812_FORMAT_PAL4 ? 16 : 256)) return 0;
+    
+    ch->palette = palette;
+    ch->palette_mask = entries - 1;
+    ch->dirty = 1;
+    return 1;
+}
+
+// Switch a channel between full colour (WS2812_FORMAT_RGB) and palette indices
+// (WS2812_FORMAT_PAL8 / PAL4, with a palette as for WS2812_SetPalette()).
+// The pixel buffers are resized in the arena and cleared, so every LED starts
+// at index 0. Indexed channels need a 3-byte chip and take no segment effects,
+// only the LED_EFFECT_PALETTE_* ones. Also turns a shader channel back into a
+// buffered one, if the arena has room. Call while the channel is not being sent.
+// Returns 0 if the arguments or the arena do not allow it.
+static uint8_t WS2812_SetPaletteMode(uint8_t channel_idx, uint8_t format, const uint8_t (*palette)[3], uint16_t entries) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    if (format > WS2812_FORMAT_PAL4 || (!WS2812_PALETTE && format != WS2812_FORMAT_RGB)) return 0;
+    if (format != WS2812_FORMAT_RGB) {
+        if (ch->bytes_per_pixel != 3 || !palette) return 0;
+        if (entries == 0 || (entries & (entries - 1)) || entries > (format == WS2812_FORMAT_PAL4 ? 16 : 256)) return 0;
+    }
+    
+    // Check the arena has room for the resized buffer(s)
+    uint32_t size = WS2812_ARENA_ROUND(WS2812_PixelBytes(ch->led_count, format));
+    uint16_t held = WS2812_ArenaBlockSize((void**)&ch->led_buffer);
+#if WS2812_DOUBLE_BUFFER
+    held += WS2812_ArenaBlockSize((void**)&ch->front_buffer);
+#endif
+    if (size * WS2812_CHANNEL_BUFFERS > WS2812_ArenaRemaining() + held) return 0;
+    if (!held && ws2812_arena_count + WS2812_CHANNEL_BUFFERS > WS2812_ARENA_MAX_BLOCKS) return 0;
+    
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaFree((void**)&ch->front_buffer);
+#endif
+    WS2812_ArenaAlloc((void**)&ch->led_buffer, WS2812_PixelBytes(ch->led_count, format));
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaAlloc((void**)&ch->front_buffer, WS2812_PixelBytes(ch->led_count, format));
+#endif
+    
+    ch->format = format;
+    ch->palette = format == WS2812_FORMAT_RGB ? NULL : palette;
+    ch->palette_mask = format == WS2812_FORMAT_RGB ? 0 : entries - 1;
+    ch->palette_offset = 0;
+    ch->shader = NULL;
+    ch->shader_state = NULL;
+    WS2812_SelectSender(ch);
+    ch->dirty = 1;
+    return 1;
+}
+
+// Rotate an indexed channel's colours: every LED shows palette entry
+// (index + offset). Animates the whole strip in O(1).
+static void WS2812_SetPaletteOffset(uint8_t channel_idx, uint8_t offset) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || !WS2812_IsIndexed(ch)) return;
+    
+    ch->palette_offset = offset;
+    ch->dirty = 1;
+}
+
+// Set the palette index of one LED on an indexed channel
+static void WS2812_SetPixelIndexOf(WS2812_Channel_t* ch, uint16_t position, uint8_t index) {
+    uint8_t* indices = (uint8_t*)ch->led_buffer;
+    
+    if (ch->format == WS2812_FORMAT_PAL8) {
+        indices[position] = index;
+    } else {
+        uint8_t shift = (position & 1) << 2;
+        indices[position >> 1] = (indices[position >> 1] & ~(0x0F << shift)) | ((index & 0x0F) << shift);
+    }
+}
+
+// Set count LEDs from start to one palette index, a byte (or two nibbles) at a time
+static void WS2812_FillIndexOf(WS2812_Channel_t* ch, uint16_t start, uint16_t count, uint8_t index) {
+    uint8_t* indices = (uint8_t*)ch->led_buffer;
+    
+    if (ch->format == WS2812_FORMAT_PAL8) {
+        memset(indices + start, index, count);
+        return;
+    }
+    
+    // Odd first and last LEDs share their byte with a neighbour outside the range
+    if (count && (start & 1)) {
+        WS2812_SetPixelIndexOf(ch, start++, index);
+        count--;
+    }
+    memset(indices + (start >> 1), (index & 0x0F) * 0x11, count >> 1);
+    if (count & 1) {
+        WS2812_SetPixelIndexOf(ch, start + count - 1, index);
+    }
+}
+
+// Set one LED of an indexed channel to a palette index and mark the channel dirty
+static void WS2812_SetPixelIndex(uint8_t channel_idx, uint16_t position, uint8_t index) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || !WS2812_IsIndexed(ch) || position >= ch->led_count) return;
+    
+    WS2812_SetPixelIndexOf(ch, position, index);
+    ch->dirty = 1;
+}
+
+// Palette index of one LED on an indexed channel (0 if there is none)
+static uint8_t WS2812_GetPixelIndex(uint8_t channel_idx, uint16_t position) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || !WS2812_IsIndexed(ch) || position >= ch->led_count) return 0;
+    
+    const uint8_t* indices = (const uint8_t*)ch->led_buffer;
+    if (ch->format == WS2812_FORMAT_PAL8) return indices[position];
+    return (indices[position >> 1] >> ((position & 1) << 2)) & 0x0F;
+}
+
+// Set count LEDs of an indexed channel, from start, to one palette index and mark it dirty
+static void WS2812_FillIndex(uint8_t channel_idx, uint16_t start, uint16_t count, uint8_t index) {
+    if (channel_idx >= MAX_LED_CHANNELS) return;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    if (!ch->active || !WS2812_IsIndexed(ch) || start >= ch->led_count) return;
+    
+    if (count > ch->led_count - start) count = ch->led_count - start;
+    WS2812_FillIndexOf(ch, start, count, index);
+    ch->dirty = 1;
+}
+
+// 1 once a channel's last frame has latched and a new one can start
+static uint8_t WS2812_IsLatched(WS2812_Channel_t* channel) {
+    return (uint32_t)(WS2812_Now() - channel->tx_end) >= WS2812_US_TO_TICKS(channel->reset_us);
+}
+
+// Wait for the reset deadline of a channel's previous frame
+static void WS2812_WaitLatch(WS2812_Channel_t* channel) {
+    while (!WS2812_IsLatched(channel));
+}
+
+// Time the last frame of a channel took on the wire, in microseconds
+static uint32_t WS2812_GetFrameTimeUs(uint8_t channel_idx) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    return ws2812_channels[channel_idx].frame_ticks / WS2812_TICKS_PER_US;
+}
+
+#if WS2812_IRQ_GUARD
+// Mask interrupts and start timing a critical section
+static inline __attribute__((always_inline)) void WS2812_IrqBegin(WS2812_IrqSection_t* irq) {
+    WS2812_IRQ_DISABLE();
+    irq->off_start = WS2812_Now();
+}
+
+// Unmask interrupts, recording how long they were masked. Returns the SysTick count.
+static inline __attribute__((always_inline)) uint32_t WS2812_IrqEnd(WS2812_IrqSection_t* irq) {
+    uint32_t now = WS2812_Now();
+    if (now - irq->off_start > ws2812_irq_stats.max_off_ticks) {
+        ws2812_irq_stats.max_off_ticks = now - irq->off_start;
+    }
+    WS2812_IRQ_ENABLE();
+    return now;
+}
+
+// Let pending interrupts run while the line is low, then mask them again.
+// Returns 0, with interrupts unmasked, if they held the line low so long
+// that the strip may have latched.
+static uint8_t WS2812_IrqWindow(WS2812_IrqSection_t* irq) {
+    uint32_t opened = WS2812_IrqEnd(irq);
+    WS2812_IrqBegin(irq);
+    
+    if (irq->off_start - opened > irq->gap_ticks) {
+        WS2812_IRQ_ENABLE();
+        return 0;
+    }
+    return 1;
+}
+#else
+static inline void WS2812_IrqBegin(WS2812_IrqSection_t* irq) { (void)irq; }
+static inline uint32_t WS2812_IrqEnd(WS2812_IrqSection_t* irq) { (void)irq; return 0; }
+static inline uint8_t WS2812_IrqWindow(WS2812_IrqSection_t* irq) { (void)irq; return 1; }
+#endif
+
+// Longest time the bit-bang senders kept interrupts masked, in microseconds
+static uint32_t WS2812_GetMaxIrqOffUs(void) {
+    return ws2812_irq_stats.max_off_ticks / WS2812_TICKS_PER_US;
+}
+
+// Send a single bit on a specific channel
+static void WS2812_SendBit(WS2812_Channel_t* channel, uint8_t bit) {
+    if (bit) {
+        // Send a 1 bit (high for T1H, low for the rest of the bit)
+        WS2812_PORT_SET(channel->port, channel->pin_mask);
+        WS2812_NOPS(WS2812_T1H_NOPS);
+        
+        WS2812_PORT_CLR(channel->port, channel->pin_mask);
+        WS2812_NOPS(WS2812_T1L_NOPS);
+    } else {
+        // Send a 0 bit (high for T0H, low for the rest of the bit)
+        WS2812_PORT_SET(channel->port, channel->pin_mask);
+        WS2812_NOPS(WS2812_T0H_NOPS);
+        
+        WS2812_PORT_CLR(channel->port, channel->pin_mask);
+        WS2812_NOPS(WS2812_T0L_NOPS);
+    }
+}
+
+// Apply the channel's colour tables and return the colour in the channel's wire order
+static inline void WS2812_ScaleColor(WS2812_Channel_t* channel, uint8_t red, uint8_t green, uint8_t blue, uint8_t wire[3]) {
+    uint8_t rgb[3] = {red, green, blue};
+    
+    wire[0] = channel->lut[channel->order[0]][rgb[channel->order[0]]];
+    wire[1] = channel->lut[channel->order[1]][rgb[channel->order[1]]];
+    wire[2] = channel->lut[channel->order[2]][rgb[channel->order[2]]];
+}
+
+// Apply the channel's colour tables to a stored pixel and return it in the
+// channel's wire order. With WS2812_WIRE_ORDER_STORAGE and GRB chips the pixel
+// is read sequentially.
+static inline void WS2812_ScalePixel(WS2812_Channel_t* channel, const uint8_t pixel[3], uint8_t wire[3]) {
+    wire[0] = channel->lut[channel->order[0]][pixel[channel->pixel_index[0]]];
+    wire[1] = channel->lut[channel->order[1]][pixel[channel->pixel_index[1]]];
+    wire[2] = channel->lut[channel->order[2]][pixel[channel->pixel_index[2]]];
+}
+
+// Palette entry LED i of an indexed channel is sent as
+static inline __attribute__((always_inline)) const uint8_t* WS2812_PalettePixel(WS2812_Channel_t* channel, uint16_t i, uint8_t format) {
+    const uint8_t* indices = (const uint8_t*)WS2812_TX_BUFFER(channel);
+    uint8_t index = (format == WS2812_FORMAT_PAL8) ? indices[i] : indices[i >> 1] >> ((i & 1) << 2);
+    return channel->palette[(uint8_t)(index + channel->palette_offset) & channel->palette_mask];
+}
+
+// Wire bytes of LED i for a pixel size, white mode and buffer format known at
+// compile time, so the generated senders carry no per-pixel checks for them.
+// Returns the number of bytes. RGBW sends the three colours in channel order, then white.
+static inline __attribute__((always_inline)) uint8_t WS2812_FetchPixelAs(WS2812_Channel_t* channel, uint16_t i, uint8_t wire[4],
+                                                                          uint8_t bytes, uint8_t auto_white, uint8_t format) {
+    uint8_t generated[3];
+    const uint8_t* pixel;
+    
+    if (format == WS2812_FORMAT_SHADER) {
+        // Timed against WS2812_SHADER_BUDGET_NS, part of the low gap between two LEDs
+        uint32_t start = WS2812_Now();
+        channel->shader(channel->shader_state, i, generated);
+        uint32_t ticks = WS2812_Now() - start;
+        if (ticks > WS2812_SHADER_BUDGET_TICKS) ws2812_shader_stats.overruns++;
+        if (ticks > ws2812_shader_stats.max_ticks) ws2812_shader_stats.max_ticks = ticks;
+        pixel = generated;
+    } else if (format == WS2812_FORMAT_RGB) {
+        pixel = WS2812_TX_BUFFER(channel)[i];
+    } else {
+        pixel = WS2812_PalettePixel(channel, i, format);
+    }
+    
+    if (bytes == 3) {
+        WS2812_ScalePixel(channel, pixel, wire);
+#if WS2812_POWER_LIMIT
+        channel->power_sum[0] += wire[0];
+        channel->power_sum[1] += wire[1];
+        channel->power_sum[2] += wire[2];
+#endif
+        return 3;
+    }
+    
+    uint8_t rgb[3] = {pixel[WS2812_R], pixel[WS2812_G], pixel[WS2812_B]};
+    uint8_t white = channel->white_buffer[i];
+    
+    if (auto_white) {
+        // The part common to all three colours is sent as white instead
+        uint8_t common = rgb[0] < rgb[1] ? rgb[0] : rgb[1];
+        if (rgb[2] < common) common = rgb[2];
+        rgb[0] -= common;
+        rgb[1] -= common;
+        rgb[2] -= common;
+        white = (white > 255 - common) ? 255 : white + common;
+    }
+    
+    wire[0] = channel->lut[channel->order[0]][rgb[channel->order[0]]];
+    wire[1] = channel->lut[channel->order[1]][rgb[channel->order[1]]];
+    wire[2] = channel->lut[channel->order[2]][rgb[channel->order[2]]];
+    wire[3] = channel->lut[3][white];
+#if WS2812_POWER_LIMIT
+    channel->power_sum[0] += wire[0];
+    channel->power_sum[1] += wire[1];
+    channel->power_sum[2] += wire[2];
+    channel->power_sum[3] += wire[3];
+#endif
+    return 4;
+}
+
+// Wire bytes of LED i for any profile (used by the parallel and DMA paths)
+static uint8_t WS2812_FetchPixel(WS2812_Channel_t* channel, uint16_t i, uint8_t wire[4]) {
+#if WS2812_PROFILE_RGBW
+    if (channel->bytes_per_pixel == 4) {
+        if (channel->flags & WS2812_FLAG_AUTO_WHITE) return WS2812_FetchPixelAs(channel, i, wire, 4, 1, WS2812_FORMAT_RGB);
+        return WS2812_FetchPixelAs(channel, i, wire, 4, 0, WS2812_FORMAT_RGB);
+    }
+#endif
+#if WS2812_PALETTE
+    if (channel->format == WS2812_FORMAT_PAL8) return WS2812_FetchPixelAs(channel, i, wire, 3, 0, WS2812_FORMAT_PAL8);
+    if (channel->format == WS2812_FORMAT_PAL4) return WS2812_FetchPixelAs(channel, i, wire, 3, 0, WS2812_FORMAT_PAL4);
+#endif
+#if WS2812_SHADER
+    if (channel->format == WS2812_FORMAT_SHADER) return WS2812_FetchPixelAs(channel, i, wire, 3, 0, WS2812_FORMAT_SHADER);
+#endif
+    return WS2812_FetchPixelAs(channel, i, wire, 3, 0, WS2812_FORMAT_RGB);
+}
+
+// One bit with the delays of a bit rate (WS2812_800K or WS2812_400K), same shape as WS2812_SendBit()
+#define WS2812_SEND_BIT(port, mask, bit, timing) do { \
+        if (bit) {                                    \
+            WS2812_PORT_SET(port, mask);              \
+            WS2812_NOPS(timing##_T1H_NOPS);           \
+            WS2812_PORT_CLR(port, mask);              \
+            WS2812_NOPS(timing##_T1L_NOPS);           \
+        } else {                                      \
+            WS2812_PORT_SET(port, mask);              \
+            WS2812_NOPS(timing##_T0H_NOPS);           \
+            WS2812_PORT_CLR(port, mask);              \
+            WS2812_NOPS(timing##_T0L_NOPS);           \
+        }                                             \
+    } while (0)
+
+// Generate a bit-bang sender for one bit rate, pixel size, white mode and buffer format.
+// Everything that differs between chips is a constant inside the loops.
+// Returns 0 if an interrupt window ran too long and the frame must be restarted.
+#define WS2812_DEFINE_SENDER(name, timing, bytes, auto_white, format)        \
+static uint8_t name(WS2812_Channel_t* channel, WS2812_IrqSection_t* irq) {   \
+    GPIO_TypeDef* port = channel->port;                                      \
+    uint32_t mask = channel->pin_mask;                                       \
+    uint8_t section = WS2812_IRQ_OFF_BYTES;                                  \
+                                                                             \
+    WS2812_IrqBegin(irq);                                                    \
+    for (uint16_t i = 0; i < channel->led_count; i++) {                      \
+        uint8_t wire[4];                                                     \
+        WS2812_FetchPixelAs(channel, i, wire, bytes, auto_white, format);    \
+                                                                             \
+        /* Colour bytes in wire order, MSB first */                          \
+        for (uint8_t c = 0; c < bytes; c++) {                                \
+            for (int b = 7; b >= 0; b--) {                                   \
+                WS2812_SEND_BIT(port, mask, (wire[c] >> b) & 1, timing);     \
+            }                                                                \
+            /* End of a critical section: interrupts run in the low phase */ \
+            if (WS2812_IRQ_GUARD && --section == 0) {                        \
+                section = WS2812_IRQ_OFF_BYTES;                              \
+                if (!WS2812_IrqWindow(irq)) return 0;                        \
+            }                                                                \
+        }                                                                    \
+    }                                                                        \
+    WS2812_IrqEnd(irq);                                                      \
+    return 1;                                                                \
+}
+
+WS2812_DEFINE_SENDER(WS2812_Send800K, WS2812_800K, 3, 0, WS2812_FORMAT_RGB)
+#if WS2812_PROFILE_RGBW
+WS2812_DEFINE_SENDER(WS2812_Send800K_RGBW, WS2812_800K, 4, 0, WS2812_FORMAT_RGB)
+WS2812_DEFINE_SENDER(WS2812_Send800K_RGBW_Auto, WS2812_800K, 4, 1, WS2812_FORMAT_RGB)
+#endif
+#if WS2812_PALETTE
+WS2812_DEFINE_SENDER(WS2812_Send800K_PAL8, WS2812_800K, 3, 0, WS2812_FORMAT_PAL8)
+WS2812_DEFINE_SENDER(WS2812_Send800K_PAL4, WS2812_800K, 3, 0, WS2812_FORMAT_PAL4)
+#endif
+#if WS2812_SHADER
+WS2812_DEFINE_SENDER(WS2812_Send800K_SHADER, WS2812_800K, 3, 0, WS2812_FORMAT_SHADER)
+#endif
+#if WS2812_PROFILE_400K
+WS2812_DEFINE_SENDER(WS2812_Send400K, WS2812_400K, 3, 0, WS2812_FORMAT_RGB)
+#if WS2812_PROFILE_RGBW
+WS2812_DEFINE_SENDER(WS2812_Send400K_RGBW, WS2812_400K, 4, 0, WS2812_FORMAT_RGB)
+WS2812_DEFINE_SENDER(WS2812_Send400K_RGBW_Auto, WS2812_400K, 4, 1, WS2812_FORMAT_RGB)
+#endif
+#if WS2812_PALETTE
+WS2812_DEFINE_SENDER(WS2812_Send400K_PAL8, WS2812_400K, 3, 0, WS2812_FORMAT_PAL8)
+WS2812_DEFINE_SENDER(WS2812_Send400K_PAL4, WS2812_400K, 3, 0, WS2812_FORMAT_PAL4)
+#endif
+#if WS2812_SHADER
+WS2812_DEFINE_SENDER(WS2812_Send400K_SHADER, WS2812_400K, 3, 0, WS2812_FORMAT_SHADER)
+#endif
+#endif
+
+// Point a channel at the sender generated for its profile
+static void WS2812_SelectSender(WS2812_Channel_t* channel) {
+    uint8_t auto_white = (channel->flags & WS2812_FLAG_AUTO_WHITE) != 0;
+    
+    channel->send = WS2812_Send800K;
+#if WS2812_PROFILE_RGBW
+    if (channel->bytes_per_pixel == 4 && channel->speed == WS2812_SPEED_800K) {
+        channel->send = auto_white ? WS2812_Send800K_RGBW_Auto : WS2812_Send800K_RGBW;
+    }
+#endif
+#if WS2812_PROFILE_400K
+    if (channel->speed == WS2812_SPEED_400K) {
+        channel->send = WS2812_Send400K;
+#if WS2812_PROFILE_RGBW
+        if (channel->bytes_per_pixel == 4) {
+            channel->send = auto_white ? WS2812_Send400K_RGBW_Auto : WS2812_Send400K_RGBW;
+        }
+#endif
+    }
+#endif
+#if WS2812_PALETTE
+    // Indexed channels are always 3-byte chips
+    if (channel->format == WS2812_FORMAT_PAL8) {
+        channel->send = WS2812_Send800K_PAL8;
+#if WS2812_PROFILE_400K
+        if (channel->speed == WS2812_SPEED_400K) channel->send = WS2812_Send400K_PAL8;
+#endif
+    } else if (channel->format == WS2812_FORMAT_PAL4) {
+        channel->send = WS2812_Send800K_PAL4;
+#if WS2812_PROFILE_400K
+        if (channel->speed == WS2812_SPEED_400K) channel->send = WS2812_Send400K_PAL4;
+#endif
+    }
+#endif
+#if WS2812_SHADER
+    // So are shader channels
+    if (channel->format == WS2812_FORMAT_SHADER) {
+        channel->send = WS2812_Send800K_SHADER;
+#if WS2812_PROFILE_400K
+        if (channel->speed == WS2812_SPEED_400K) channel->send = WS2812_Send400K_SHADER;
+#endif
+    }
+#endif
+    (void)auto_white;
+}
+
+// Send a single color for a single LED on a specific channel
+static void WS2812_SendColor(WS2812_Channel_t* channel, uint8_t red, uint8_t green, uint8_t blue) {
+    WS2812_IrqSection_t irq;
+    uint8_t wire[3];
+    WS2812_ScaleColor(channel, red, green, blue, wire);
+    WS2812_HASH_FORGET(channel);
+    
+    // Send the colours in the channel's order, MSB first, as one critical section
+    WS2812_IrqBegin(&irq);
+    for (uint8_t c = 0; c < 3; c++) {
+        for (int i = 7; i >= 0; i--) {
+            WS2812_SendBit(channel, (wire[c] >> i) & 1);
+        }
+    }
+    WS2812_IrqEnd(&irq);
+}
+
+// Send the entire buffer for a single channel
+static void WS2812_SendChannel(WS2812_Channel_t* channel) {
+    if (!channel->active || !WS2812_HasPixels(channel)) return;
+    WS2812_HASH_FORGET(channel);
+    
+#if WS2812_USE_SPI_DMA
+    if (channel->backend == WS2812_BACKEND_SPI_DMA) {
+        WS2812_SPI_SendChannel(channel);
+        return;
+    }
+#endif
+#if WS2812_USE_PWM_DMA
+    if (channel->backend == WS2812_BACKEND_PWM_DMA) {
+        WS2812_PWM_SendChannel(channel);
+        return;
+    }
+#endif
+    
+    // Pixels are streamed back to back; the latch is a deadline checked before the next frame
+    WS2812_IrqSection_t irq;
+    for (uint8_t restarts = 0; ; restarts++) {
+        WS2812_STATS_START(wait_start);
+        WS2812_WaitLatch(channel);
+        WS2812_STATS_STOP(channel->stat_latch, wait_start);
+        channel->tx_start = WS2812_Now();
+        irq.gap_ticks = restarts < WS2812_MAX_RESTARTS ? WS2812_US_TO_TICKS(WS2812_IRQ_GAP_MAX_US) : UINT32_MAX;
+        WS2812_POWER_RESET(channel);
+        
+        if (channel->send(channel, &irq)) break;
+        
+        // An interrupt held the line low long enough to latch part of the
+        // frame: wait a full reset time and send it again from the first LED
+        channel->tx_end = WS2812_Now();
+        ws2812_irq_stats.restarts++;
+    }
+    
+    channel->tx_end = WS2812_Now();
+    channel->frame_ticks = channel->tx_end - channel->tx_start;
+    WS2812_STATS_ADD(channel->stat_transmit, channel->frame_ticks);
+}
+
+// Send data to all configured channels
 static void WS2812_SendAll(void) {
     for (uint8_t i = 0; i < num_channels; i++) {
         if (ws2812_channels[i].active) {
@@ -208,9 +1834,916 @@ static void WS2812_SendAll(void) {
     }
 }
 
-// Legacy single-channel functions (for backward compatibility if needed)
-// Send a single bit, Check mark/space ratio of the data on C4 with an oscilloscope
-void LED_SendBit(uint8_t bit){
-    // This function is deprecated - use WS2812_SendBit with channel instead
+// Work on the next LED position of a port group, done one slice per bit in
+// the low phases of the current position, so the line never waits on a
+// fetch or a transpose between LEDs. Masks are bytes: a CH32V003 port has 8 pins.
+typedef struct {
+    WS2812_Channel_t** group;
+    uint8_t* masks;                // Per-bit pin masks being filled for that position
+    uint32_t active_mask;          // Pins that have an LED at that position
+    uint16_t led;                  // LED position being prepared
+    uint8_t group_size;
+    uint8_t bytes;
+    uint8_t g;                     // Channel of the next slice
+    uint8_t c;                     // Wire byte of the next slice, WS2812_GROUP_FETCH while fetching
+    uint8_t wire[MAX_LED_CHANNELS][4];
+} WS2812_GroupNext_t;
+
+#define WS2812_GROUP_FETCH 0xFF
+
+// One fetch per channel and one transpose per channel and byte must fit in
+// the bits of one LED
+_Static_assert(MAX_LED_CHANNELS * 4 <= 24, "WS2812: too many channels to prepare a group LED in one LED time");
+
+static inline void WS2812_GroupNextStart(WS2812_GroupNext_t* next, uint16_t led, uint8_t* masks) {
+    next->led = led;
+    next->masks = masks;
+    next->active_mask = 0;
+    next->g = 0;
+    next->c = WS2812_GROUP_FETCH;
+}
+
+// Do one slice of the next position: fetch one channel's pixel, or transpose
+// one of its wire bytes into the bit masks. Returns at once when all is done.
+static inline __attribute__((always_inline)) void WS2812_GroupStep(WS2812_GroupNext_t* next) {
+    uint8_t c = next->c;
+    if (c == next->bytes) return;
+    
+    WS2812_Channel_t* ch = next->group[next->g];
+    uint8_t* wire = next->wire[next->g];
+    
+    if (c == WS2812_GROUP_FETCH) {
+        // Shorter strips are padded by holding their pin low, which they see as idle
+        if (next->led < ch->led_count) {
+            WS2812_FetchPixel(ch, next->led, wire);
+            next->active_mask |= ch->pin_mask;
+        } else {
+            memset(wire, 0, 4);
+        }
+        if (++next->g == next->group_size) {
+            next->g = 0;
+            next->c = 0;
+        }
+        WS2812_GROUP_STEP_DONE();
+        return;
+    }
+    
+    // Bit n of the byte (MSB first) sets the pin in mask n; the first channel clears the masks
+    uint8_t* masks = next->masks + (c << 3);
+    uint8_t pin = ch->pin_mask;
+    uint8_t value = wire[c];
+    if (next->g == 0) {
+        for (uint8_t b = 0; b < 8; b++) {
+            masks[b] = -(uint8_t)((value >> (7 - b)) & 1) & pin;
+        }
+    } else {
+        for (uint8_t b = 0; b < 8; b++) {
+            masks[b] |= -(uint8_t)((value >> (7 - b)) & 1) & pin;
+        }
+    }
+    if (++next->g == next->group_size) {
+        next->g = 0;
+        next->c = c + 1;
+    }
+    WS2812_GROUP_STEP_DONE();
+}
+
+// Generate a sender that clocks out one LED position on every pin of a port
+// group at once. bit_masks[n] holds the pins whose n-th wire bit (MSB of the
+// first colour first) is 1, active_mask the pins that still have an LED here.
+// Each low phase also does one slice of the next position's work.
+#define WS2812_DEFINE_GROUP_SENDER(name, timing)                                                      \
+static void name(GPIO_TypeDef* port, uint32_t active_mask, const uint8_t* bit_masks, uint8_t bits,    \
+                 WS2812_GroupNext_t* next) {                                                          \
+    for (uint8_t b = 0; b < bits; b++) {                                                              \
+        uint32_t zero_mask = active_mask & ~(uint32_t)bit_masks[b];                                   \
+                                                                                                      \
+        /* All pins high, drop the 0-bit pins after T0H and the 1-bit pins after T1H */               \
+        WS2812_PORT_SET(port, active_mask);                                                           \
+        WS2812_NOPS(timing##_T0H_NOPS);                                                               \
+        WS2812_PORT_CLR(port, zero_mask);                                                             \
+        WS2812_NOPS(timing##_T01H_NOPS);                                                              \
+        WS2812_PORT_CLR(port, active_mask);                                                           \
+        WS2812_GroupStep(next);                                                                       \
+        WS2812_NOPS(timing##_T0L_NOPS);                                                               \
+    }                                                                                                 \
+}
+
+WS2812_DEFINE_GROUP_SENDER(WS2812_SendGroupPixel, WS2812_800K)
+#if WS2812_PROFILE_400K
+WS2812_DEFINE_GROUP_SENDER(WS2812_SendGroupPixel400K, WS2812_400K)
+#endif
+
+// Clock one frame out of a port group. Returns 0 if an interrupt window ran
+// too long and the frame must be restarted.
+static uint8_t WS2812_SendGroupFrame(GPIO_TypeDef* port, WS2812_Channel_t** group, uint8_t group_size, uint16_t max_leds,
+                                     WS2812_IrqSection_t* irq) {
+    // One set of masks is sent while the other is filled for the next LED
+    uint8_t bit_masks[2][32];
+    uint8_t bytes = group[0]->bytes_per_pixel;
+    uint8_t bits = bytes * 8;
+    uint8_t section = 0;
+    uint8_t filling = 0;
+    WS2812_GroupNext_t next;
+    
+    next.group = group;
+    next.group_size = group_size;
+    next.bytes = bytes;
+    
+    // The first position is prepared before the line starts
+    WS2812_GroupNextStart(&next, 0, bit_masks[0]);
+    while (next.c != bytes) {
+        WS2812_GroupStep(&next);
+    }
+    
+    WS2812_IrqBegin(irq);
+    for (uint16_t led = 0; led < max_leds; led++) {
+        uint32_t active_mask = next.active_mask;
+        const uint8_t* masks = bit_masks[filling];
+        
+        filling ^= 1;
+        WS2812_GroupNextStart(&next, led + 1, bit_masks[filling]);
+        
+#if WS2812_PROFILE_400K
+        if (group[0]->speed == WS2812_SPEED_400K) {
+            WS2812_SendGroupPixel400K(port, active_mask, masks, bits, &next);
+        } else {
+            WS2812_SendGroupPixel(port, active_mask, masks, bits, &next);
+        }
+#else
+        WS2812_SendGroupPixel(port, active_mask, masks, bits, &next);
+#endif
+        
+        // End of a critical section: interrupts run in the low phase
+        section += bytes;
+        if (WS2812_IRQ_GUARD && section >= WS2812_IRQ_OFF_BYTES) {
+            section = 0;
+            if (!WS2812_IrqWindow(irq)) return 0;
+        }
+    }
+    WS2812_IrqEnd(irq);
+    return 1;
+}
+
+// Send a group of channels that share one GPIO port, bit rate and pixel size in parallel
+static void WS2812_SendGroup(GPIO_TypeDef* port, WS2812_Channel_t** group, uint8_t group_size, uint16_t max_leds) {
+    WS2812_IrqSection_t irq;
+    uint32_t start;
+    
+    for (uint8_t g = 0; g < group_size; g++) {
+        WS2812_HASH_FORGET(group[g]);
+    }
+    for (uint8_t restarts = 0; ; restarts++) {
+        WS2812_STATS_START(wait_start);
+        for (uint8_t g = 0; g < group_size; g++) {
+            WS2812_WaitLatch(group[g]);
+        }
+        start = WS2812_Now();
+#if WS2812_STATS
+        for (uint8_t g = 0; g < group_size; g++) {
+            WS2812_STATS_ADD(group[g]->stat_latch, start - wait_start);
+        }
+#endif
+        irq.gap_ticks = restarts < WS2812_MAX_RESTARTS ? WS2812_US_TO_TICKS(WS2812_IRQ_GAP_MAX_US) : UINT32_MAX;
+        for (uint8_t g = 0; g < group_size; g++) {
+            WS2812_POWER_RESET(group[g]);
+        }
+        
+        if (WS2812_SendGroupFrame(port, group, group_size, max_leds, &irq)) break;
+        
+        // Restart the whole group once every strip has seen a full reset
+        uint32_t now = WS2812_Now();
+        for (uint8_t g = 0; g < group_size; g++) {
+            group[g]->tx_end = now;
+        }
+        ws2812_irq_stats.restarts++;
+    }
+    
+    uint32_t end = WS2812_Now();
+    for (uint8_t g = 0; g < group_size; g++) {
+        group[g]->tx_start = start;
+        group[g]->tx_end = end;
+        group[g]->frame_ticks = end - start;
+        WS2812_STATS_ADD(group[g]->stat_transmit, end - start);
+    }
+}
+
+// Send the channels selected in channel_mask (bit n = channel n), clocking
+// channels that share a GPIO port out together so they cost about one strip's time
+static void WS2812_SendParallel(uint8_t channel_mask) {
+    uint8_t pending = 0;
+    
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!(channel_mask & (1 << i)) || !ws2812_channels[i].active || !WS2812_HasPixels(&ws2812_channels[i])) continue;
+        
+        // DMA driven channels are started first so they run while the rest are bit-banged
+        if (ws2812_channels[i].backend != WS2812_BACKEND_BITBANG) {
+            WS2812_SendChannel(&ws2812_channels[i]);
+            continue;
+        }
+        pending |= 1 << i;
+    }
+    
+    while (pending) {
+        WS2812_Channel_t* group[MAX_LED_CHANNELS];
+        uint8_t group_size = 0;
+        uint16_t max_leds = 0;
+        GPIO_TypeDef* port = NULL;
+        
+        // Collect every pending channel with the port and profile timing of the first pending one
+        for (uint8_t i = 0; i < num_channels; i++) {
+            if (!(pending & (1 << i))) continue;
+            if (port == NULL) port = ws2812_channels[i].port;
+            if (ws2812_channels[i].port != port) continue;
+            if (group_size && (ws2812_channels[i].speed != group[0]->speed ||
+                               ws2812_channels[i].bytes_per_pixel != group[0]->bytes_per_pixel)) continue;
+            
+            group[group_size++] = &ws2812_channels[i];
+            if (ws2812_channels[i].led_count > max_leds) {
+                max_leds = ws2812_channels[i].led_count;
+            }
+            pending &= ~(1 << i);
+        }
+        
+        if (group_size == 1) {
+            WS2812_SendChannel(group[0]);
+        } else {
+            WS2812_SendGroup(port, group, group_size, max_leds);
+        }
+    }
+}
+
+// Send data to all configured channels, in parallel where they share a port
+static void WS2812_SendAllParallel(void) {
+    WS2812_SendParallel((1 << MAX_LED_CHANNELS) - 1);
 }
 
+#if WS2812_USE_SPI_DMA
+// SPI + DMA backend
+// Each WS2812 bit becomes three SPI bits (100 = 0, 110 = 1). The prescaler is
+// picked so the SPI runs at 3MHz, giving 333ns / 667ns high times and a 1us
+// bit period. The CPU only encodes; DMA clocks the frame out.
+
+#ifndef WS2812_SPI_PRESCALER
+#if WS2812_F_CPU == 48000000
+#define WS2812_SPI_PRESCALER SPI_BaudRatePrescaler_16
+#elif WS2812_F_CPU == 24000000
+#define WS2812_SPI_PRESCALER SPI_BaudRatePrescaler_8
+#elif WS2812_F_CPU == 12000000
+#define WS2812_SPI_PRESCALER SPI_BaudRatePrescaler_4
+#else
+#error "WS2812: no SPI prescaler gives 3MHz at this core clock, define WS2812_SPI_PRESCALER"
+#endif
+#endif
+
+// Low bytes sent ahead of every frame so MOSI settles low (each byte is 2.67us at 3MHz).
+// The latch itself is the channel's reset deadline.
+#ifndef WS2812_SPI_RESET_BYTES
+#define WS2812_SPI_RESET_BYTES 1
+#endif
+
+// SPI buffer size needed for a strip of n LEDs
+#define WS2812_SPI_BUFFER_SIZE(n) ((n) * 9 + WS2812_SPI_RESET_BYTES)
+
+// SPI patterns for one nibble of WS2812 data (12 SPI bits)
+static const uint16_t ws2812_spi_nibble[16] = {
+    0x924, 0x926, 0x934, 0x936, 0x9A4, 0x9A6, 0x9B4, 0x9B6,
+    0xD24, 0xD26, 0xD34, 0xD36, 0xDA4, 0xDA6, 0xDB4, 0xDB6
+};
+
+static volatile uint8_t ws2812_spi_busy = 0;
+static volatile uint8_t ws2812_spi_channel = 0;
+static uint8_t* ws2812_spi_buffer = NULL;
+static uint16_t ws2812_spi_buffer_len = 0;
+static void (*ws2812_spi_callback)(uint8_t channel_idx) = NULL;
+
+// Encode src_len WS2812 bytes into SPI bit patterns (3 bytes out per byte in).
+// Pure function with no hardware access. Returns the number of bytes written.
+static uint16_t WS2812_SPI_Encode(const uint8_t* src, uint16_t src_len, uint8_t* dst) {
+    for (uint16_t i = 0; i < src_len; i++) {
+        uint32_t bits = ((uint32_t)ws2812_spi_nibble[src[i] >> 4] << 12) | ws2812_spi_nibble[src[i] & 0x0F];
+        dst[0] = bits >> 16;
+        dst[1] = bits >> 8;
+        dst[2] = bits;
+        dst += 3;
+    }
+    return src_len * 3;
+}
+
+// 1 while a DMA transfer is in flight
+static uint8_t WS2812_SPI_Busy(void) {
+    return ws2812_spi_busy;
+}
+
+// Register a function called from the DMA interrupt when a frame has been sent
+static void WS2812_SPI_SetCallback(void (*callback)(uint8_t channel_idx)) {
+    ws2812_spi_callback = callback;
+}
+
+// Configure a channel driven by SPI1 + DMA on PC6.
+// spi_buffer must hold WS2812_SPI_BUFFER_SIZE(led_count_param) bytes.
+static uint8_t WS2812_ConfigureChannelSPI(uint8_t channel_idx, uint16_t led_count_param, uint8_t bright_level,
+                                          uint8_t* spi_buffer, uint16_t spi_buffer_len) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    if (led_count_param == 0 || !spi_buffer) return 0;
+    if (spi_buffer_len < WS2812_SPI_BUFFER_SIZE(led_count_param)) return 0;
+    
+    // Only one SPI channel is possible, reject a second one
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (i != channel_idx && ws2812_channels[i].active && ws2812_channels[i].backend == WS2812_BACKEND_SPI_DMA) {
+            return 0;
+        }
+    }
+    
+    // Let a running transfer finish before the channel is changed
+    WS2812_DMA_WAIT(ws2812_spi_busy);
+    
+    if (!WS2812_SetupChannel(channel_idx, PC6, GPIOC, 6, led_count_param, bright_level, WS2812_BACKEND_SPI_DMA)) {
+        return 0;
+    }
+    
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_SPI1;
+    RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+    
+    ws2812_spi_buffer = spi_buffer;
+    ws2812_spi_buffer_len = spi_buffer_len;
+    ws2812_spi_channel = channel_idx;
+    
+    // PC6 as alternate function push-pull (SPI1 MOSI)
+    GPIOC->CFGLR = (GPIOC->CFGLR & ~(0xF << 24)) | ((GPIO_Speed_50MHz | (GPIO_Mode_AF_PP & 0x0F)) << 24);
+    
+    // Transmit-only master, 8 bit, MSB first, mode 0, TX requests through DMA
+    SPI1->CTLR1 = SPI_Mode_Master | SPI_Direction_1Line_Tx | WS2812_SPI_PRESCALER | SPI_NSS_Soft;
+    SPI1->CTLR2 = SPI_I2S_DMAReq_Tx;
+    SPI1->CTLR1 |= SPI_CTLR1_SPE;
+    
+    DMA1_Channel3->CFGR = 0;
+    DMA1_Channel3->PADDR = (uint32_t)&SPI1->DATAR;
+    NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    
+    return 1;
+}
+
+// Encode a channel into the SPI buffer and start the DMA transfer (returns immediately)
+static void WS2812_SPI_SendChannel(WS2812_Channel_t* channel) {
+    // Let the previous frame finish before its buffer is overwritten
+    WS2812_STATS_START(wait_start);
+    WS2812_DMA_WAIT(ws2812_spi_busy);
+    WS2812_WaitLatch(channel);
+    WS2812_STATS_STOP(channel->stat_latch, wait_start);
+    WS2812_STATS_START(send_start);
+    
+    uint8_t* out = ws2812_spi_buffer;
+    WS2812_POWER_RESET(channel);
+    memset(out, 0, WS2812_SPI_RESET_BYTES);
+    out += WS2812_SPI_RESET_BYTES;
+    
+    for (uint16_t i = 0; i < channel->led_count; i++) {
+        uint8_t wire[4];
+        out += WS2812_SPI_Encode(wire, WS2812_FetchPixel(channel, i, wire), out);
+    }
+    
+    ws2812_spi_busy = 1;
+    channel->tx_start = WS2812_Now();
+    
+    DMA1_Channel3->CFGR = 0;
+    DMA1->INTFCR = DMA1_IT_GL3;
+    DMA1_Channel3->MADDR = (uint32_t)ws2812_spi_buffer;
+    DMA1_Channel3->CNTR = out - ws2812_spi_buffer;
+    DMA1_Channel3->CFGR = DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_Priority_VeryHigh | DMA_IT_TC | DMA_CFGR1_EN;
+    WS2812_STATS_STOP(channel->stat_transmit, send_start);
+}
+
+void DMA1_Channel3_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel3_IRQHandler(void) {
+    if (DMA1->INTFR & DMA1_IT_TC3) {
+        DMA1->INTFCR = DMA1_IT_GL3;
+        DMA1_Channel3->CFGR = 0;
+        
+        // The last byte is still shifting out; it is covered by the reset time
+        WS2812_Channel_t* ch = &ws2812_channels[ws2812_spi_channel];
+        ch->tx_end = WS2812_Now();
+        ch->frame_ticks = ch->tx_end - ch->tx_start;
+        ws2812_spi_busy = 0;
+        
+        if (ws2812_spi_callback) {
+            ws2812_spi_callback(ws2812_spi_channel);
+        }
+    }
+}
+#endif // WS2812_USE_SPI_DMA
+
+#if WS2812_USE_PWM_DMA
+// Timer PWM + circular DMA backend
+// TIM2 runs at the WS2812 bit rate and every update event DMA loads the next
+// compare value (the high time of the next bit) into CH1CVR. The DMA ring
+// holds two halves of WS2812_PWM_RING_LEDS pixels each; the half-transfer and
+// transfer-complete interrupts encode the next pixels from led_buffer into the
+// half that just finished playing, so RAM use is constant whatever the strip length.
+
+// Timer ticks per bit and high times for 0 and 1 bits (1.25us, 350ns, 700ns)
+#ifndef WS2812_PWM_PERIOD
+#define WS2812_PWM_PERIOD (WS2812_F_CPU / 800000)
+#endif
+#ifndef WS2812_PWM_T0H
+#define WS2812_PWM_T0H ((350 * WS2812_CPU_MHZ + 500) / 1000)
+#endif
+#ifndef WS2812_PWM_T1H
+#define WS2812_PWM_T1H ((700 * WS2812_CPU_MHZ + 500) / 1000)
+#endif
+
+// Pixels per ring half
+#ifndef WS2812_PWM_RING_LEDS
+#define WS2812_PWM_RING_LEDS 2
+#endif
+
+#define WS2812_PWM_HALF_SIZE (WS2812_PWM_RING_LEDS * 24)
+
+// Streaming state for one frame
+typedef struct {
+    WS2812_Channel_t* channel;     // Channel being streamed
+    uint16_t next_led;             // Next pixel to encode
+    uint8_t idle_halves;           // Ring halves filled with reset slots since the data ran out
+} WS2812_PWM_Stream_t;
+
+static uint8_t ws2812_pwm_ring[2 * WS2812_PWM_HALF_SIZE];
+static WS2812_PWM_Stream_t ws2812_pwm_stream;
+static volatile uint8_t ws2812_pwm_busy = 0;
+
+// Encode the next pixels of the stream into one ring half, padding with low
+// slots (compare 0) once the strip is exhausted. Returns 0 once a low half has
+// played, so the last bit is out and the stream can stop; the latch itself is
+// the channel's reset deadline.
+// Pure function with no hardware access.
+static uint8_t WS2812_PWM_Refill(WS2812_PWM_Stream_t* s, uint8_t* half) {
+    WS2812_Channel_t* ch = s->channel;
+    
+    if (s->next_led >= ch->led_count) {
+        // The other half is playing low slots and the one before has played out
+        if (s->idle_halves > 1) return 0;
+        memset(half, 0, WS2812_PWM_HALF_SIZE);
+        s->idle_halves++;
+        return 1;
+    }
+    
+    for (uint8_t p = 0; p < WS2812_PWM_RING_LEDS; p++) {
+        if (s->next_led >= ch->led_count) {
+            memset(half, 0, (WS2812_PWM_RING_LEDS - p) * 24);
+            break;
+        }
+        
+        uint8_t wire[4];
+        WS2812_FetchPixel(ch, s->next_led, wire);
+        s->next_led++;
+        
+        for (uint8_t c = 0; c < 3; c++) {
+            for (uint8_t mask = 0x80; mask; mask >>= 1) {
+                *half++ = (wire[c] & mask) ? WS2812_PWM_T1H : WS2812_PWM_T0H;
+            }
+        }
+    }
+    return 1;
+}
+
+// Handle a DMA half-transfer (half_index 0) or transfer-complete (half_index 1)
+// event: the given half has just played and is refilled. Returns 0 when the frame is done.
+static uint8_t WS2812_PWM_Service(WS2812_PWM_Stream_t* s, uint8_t* ring, uint8_t half_index) {
+    return WS2812_PWM_Refill(s, ring + half_index * WS2812_PWM_HALF_SIZE);
+}
+
+// 1 while a frame is streaming
+static uint8_t WS2812_PWM_Busy(void) {
+    return ws2812_pwm_busy;
+}
+
+// Configure a channel driven by TIM2 CH1 PWM + DMA on PD4
+static uint8_t WS2812_ConfigureChannelPWM(uint8_t channel_idx, uint16_t led_count_param, uint8_t bright_level) {
+    if (channel_idx >= MAX_LED_CHANNELS) return 0;
+    if (led_count_param == 0) return 0;
+    
+    // Only one PWM channel is possible, reject a second one
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (i != channel_idx && ws2812_channels[i].active && ws2812_channels[i].backend == WS2812_BACKEND_PWM_DMA) {
+            return 0;
+        }
+    }
+    
+    // Let a running stream finish before the channel is changed
+    WS2812_DMA_WAIT(ws2812_pwm_busy);
+    
+    if (!WS2812_SetupChannel(channel_idx, PD4, GPIOD, 4, led_count_param, bright_level, WS2812_BACKEND_PWM_DMA)) {
+        return 0;
+    }
+    
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_AFIO;
+    RCC->APB1PCENR |= RCC_APB1Periph_TIM2;
+    RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+    
+    // PD4 as alternate function push-pull (TIM2 CH1)
+    GPIOD->CFGLR = (GPIOD->CFGLR & ~(0xF << 16)) | ((GPIO_Speed_50MHz | (GPIO_Mode_AF_PP & 0x0F)) << 16);
+    
+    // PWM mode 1 on CH1 with preloaded compare, one period per WS2812 bit, idle low
+    TIM2->CTLR1 = TIM_ARPE;
+    TIM2->PSC = 0;
+    TIM2->ATRLR = WS2812_PWM_PERIOD - 1;
+    TIM2->CHCTLR1 = TIM_OC1M_2 | TIM_OC1M_1 | TIM_OC1PE;
+    TIM2->CCER = TIM_CC1E;
+    TIM2->CH1CVR = 0;
+    TIM2->SWEVGR = TIM_UG;
+    
+    // TIM2 update requests are served by DMA1 channel 2
+    DMA1_Channel2->CFGR = 0;
+    DMA1_Channel2->PADDR = (uint32_t)&TIM2->CH1CVR;
+    NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    
+    return 1;
+}
+
+// Prime the ring and start streaming a channel (returns immediately)
+static void WS2812_PWM_SendChannel(WS2812_Channel_t* channel) {
+    WS2812_STATS_START(wait_start);
+    WS2812_DMA_WAIT(ws2812_pwm_busy);
+    WS2812_WaitLatch(channel);
+    WS2812_STATS_STOP(channel->stat_latch, wait_start);
+    WS2812_STATS_START(send_start);
+    
+    ws2812_pwm_stream.channel = channel;
+    ws2812_pwm_stream.next_led = 0;
+    ws2812_pwm_stream.idle_halves = 0;
+    WS2812_POWER_RESET(channel);
+    WS2812_PWM_Refill(&ws2812_pwm_stream, ws2812_pwm_ring);
+    WS2812_PWM_Refill(&ws2812_pwm_stream, ws2812_pwm_ring + WS2812_PWM_HALF_SIZE);
+    
+    ws2812_pwm_busy = 1;
+    channel->tx_start = WS2812_Now();
+    
+    DMA1_Channel2->CFGR = 0;
+    DMA1->INTFCR = DMA1_IT_GL2;
+    DMA1_Channel2->MADDR = (uint32_t)ws2812_pwm_ring;
+    DMA1_Channel2->CNTR = sizeof(ws2812_pwm_ring);
+    DMA1_Channel2->CFGR = DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_Mode_Circular |
+                          DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_Byte |
+                          DMA_Priority_VeryHigh | DMA_IT_HT | DMA_IT_TC | DMA_CFGR1_EN;
+    
+    TIM2->CNT = 0;
+    TIM2->DMAINTENR = TIM_UDE;
+    TIM2->CTLR1 |= TIM_CEN;
+    WS2812_STATS_STOP(channel->stat_transmit, send_start);
+}
+
+void DMA1_Channel2_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel2_IRQHandler(void) {
+    uint32_t flags = DMA1->INTFR;
+    uint8_t running = 1;
+    
+    if (flags & DMA1_IT_HT2) {
+        DMA1->INTFCR = DMA1_IT_HT2;
+        running = WS2812_PWM_Service(&ws2812_pwm_stream, ws2812_pwm_ring, 0);
+    }
+    if (flags & DMA1_IT_TC2) {
+        DMA1->INTFCR = DMA1_IT_TC2;
+        running = WS2812_PWM_Service(&ws2812_pwm_stream, ws2812_pwm_ring, 1);
+    }
+    
+    if (!running) {
+        // The line is low (compare 0) and the latch has started
+        TIM2->CTLR1 &= ~TIM_CEN;
+        TIM2->DMAINTENR = 0;
+        TIM2->CH1CVR = 0;
+        DMA1_Channel2->CFGR = 0;
+        
+        WS2812_Channel_t* ch = ws2812_pwm_stream.channel;
+        ch->tx_end = WS2812_Now();
+        ch->frame_ticks = ch->tx_end - ch->tx_start;
+        ws2812_pwm_busy = 0;
+    }
+}
+#endif // WS2812_USE_PWM_DMA
+
+// Wait until a DMA backend has stopped reading a channel (returns at once for bit-bang channels)
+static void WS2812_WaitIdle(const WS2812_Channel_t* channel) {
+#if WS2812_USE_SPI_DMA
+    if (channel->backend == WS2812_BACKEND_SPI_DMA) {
+        WS2812_DMA_WAIT(ws2812_spi_busy);
+    }
+#endif
+#if WS2812_USE_PWM_DMA
+    if (channel->backend == WS2812_BACKEND_PWM_DMA) {
+        WS2812_DMA_WAIT(ws2812_pwm_busy);
+    }
+#endif
+    (void)channel;
+}
+
+// Wait until no DMA backend is reading any channel
+static void WS2812_WaitAllIdle(void) {
+#if WS2812_USE_SPI_DMA
+    WS2812_DMA_WAIT(ws2812_spi_busy);
+#endif
+#if WS2812_USE_PWM_DMA
+    WS2812_DMA_WAIT(ws2812_pwm_busy);
+#endif
+}
+
+// Shader channels
+// A shader channel has no pixel buffer. Its generator is called for each LED
+// as the frame is sent, so the channel length is not limited by the arena and
+// one channel can drive thousands of LEDs; effects animate by changing the
+// generator's state block between frames. The bit-bang senders call it
+// between two LEDs with interrupts masked, so it must return within
+// WS2812_SHADER_BUDGET_NS (about 3us at 48MHz) or the strip latches part way;
+// calls over it are counted in WS2812_GetShaderStats(). On the PWM backend it
+// runs in the DMA interrupt, filling one half of the ring while the other half
+// is clocked out, the best fit for long strips. The SPI backend still encodes
+// the whole frame into its buffer, so there the length is limited by that
+// buffer and it saves no memory.
+
+#if WS2812_SHADER
+// Generator that sends every LED off
+static void WS2812_ShaderOff(void* state, uint16_t i, uint8_t pixel[3]) {
+    (void)state;
+    (void)i;
+    pixel[0] = pixel[1] = pixel[2] = 0;
+}
+
+// Generator calls timed since the last WS2812_ResetShaderStats()
+static const WS2812_ShaderStats_t* WS2812_GetShaderStats(void) {
+    return &ws2812_shader_stats;
+}
+
+static void WS2812_ResetShaderStats(void) {
+    ws2812_shader_stats.max_ticks = 0;
+    ws2812_shader_stats.overruns = 0;
+}
+
+// Turn a channel into a shader channel with led_count LEDs (0 keeps the
+// current count) whose pixels come from shader(state, i, pixel). The pixel
+// buffers go back to the arena; WS2812_SetPaletteMode(channel, WS2812_FORMAT_RGB, NULL, 0)
+// brings one back. Shader channels need a 3-byte chip and take no segment
+// effects, only the LED_EFFECT_SHADER_* ones. Can be called again to change
+// the generator; waits for a DMA transfer of the channel to finish first.
+// Returns 0 if the arguments do not allow it.
+static uint8_t WS2812_SetShader(uint8_t channel_idx, uint16_t led_count, WS2812_Shader_t shader, void* state) {
+    if (channel_idx >= MAX_LED_CHANNELS || !ws2812_channels[channel_idx].active) return 0;
+    WS2812_Channel_t* ch = &ws2812_channels[channel_idx];
+    
+    if (!shader || ch->bytes_per_pixel != 3) return 0;
+    if (led_count == 0) led_count = ch->led_count;
+#if WS2812_USE_SPI_DMA
+    if (ch->backend == WS2812_BACKEND_SPI_DMA && ws2812_spi_buffer_len < WS2812_SPI_BUFFER_SIZE(led_count)) return 0;
+#endif
+    
+    WS2812_WaitIdle(ch);
+    WS2812_ArenaFree((void**)&ch->led_buffer);
+#if WS2812_DOUBLE_BUFFER
+    WS2812_ArenaFree((void**)&ch->front_buffer);
+#endif
+    
+    ch->led_count = led_count;
+    ch->format = WS2812_FORMAT_SHADER;
+    ch->palette = NULL;
+    ch->palette_mask = 0;
+    ch->palette_offset = 0;
+    ch->shader = shader;
+    ch->shader_state = state;
+    WS2812_SelectSender(ch);
+    ch->dirty = 1;
+    return 1;
+}
+#endif
+
+#if WS2812_POWER_LIMIT
+// Power limiter
+// The draw of a frame is estimated from the output bytes summed while it is
+// sent, so it costs no pass over the buffers, but it is only known once the
+// frame is out: the estimate lags the frame by one send. WS2812_Commit()
+// checks it after sending, and a frame over budget is scaled down and every
+// channel sent again straight away, so the overload is on the wire for one
+// frame time, not for the whole frame period. Frames sent outside
+// WS2812_Commit() are counted too, and checked at the next commit.
+
+// Set the budget for all channels together in mA (0 = unlimited)
+static void WS2812_SetPowerBudget(uint16_t milliamps) {
+    ws2812_power.budget_ma = milliamps;
+}
+
+// Set the draw of one LED: red, green, blue and white at full output in mA,
+// and an LED showing black in uA
+static void WS2812_SetPowerModel(uint8_t red_ma, uint8_t green_ma, uint8_t blue_ma, uint8_t white_ma, uint16_t idle_ua) {
+    ws2812_power.ma[0] = red_ma;
+    ws2812_power.ma[1] = green_ma;
+    ws2812_power.ma[2] = blue_ma;
+    ws2812_power.ma[3] = white_ma;
+    ws2812_power.idle_ua = idle_ua;
+}
+
+// Colour draw of the frame a channel last sent, in mA
+static uint32_t WS2812_ChannelDrawMa(const WS2812_Channel_t* ch) {
+    uint32_t sum = ch->power_sum[0] * ws2812_power.ma[ch->order[0]] +
+                   ch->power_sum[1] * ws2812_power.ma[ch->order[1]] +
+                   ch->power_sum[2] * ws2812_power.ma[ch->order[2]] +
+                   ch->power_sum[3] * ws2812_power.ma[3];
+    return sum / 255;
+}
+
+// Rebuild every channel's tables for a new limiter scale and mark them for
+// sending. All tables are released first and built again from each channel's
+// settings; those are only accepted while their full power tables fit the
+// pool (WS2812_LUTFitsUnscaled()), so every channel gets its scaled tables.
+// Should one not, it keeps its old tables and is counted in lut_failures.
+// Waits for DMA transfers, which read the tables, to finish first.
+static void WS2812_SetPowerScale(uint8_t scale) {
+    const uint8_t* old[MAX_LED_CHANNELS][4];
+    
+    WS2812_WaitAllIdle();
+    ws2812_power.scale = scale;
+    
+    for (uint8_t i = 0; i < num_channels; i++) {
+        WS2812_Channel_t* ch = &ws2812_channels[i];
+        if (!ch->active) continue;
+        
+        for (uint8_t c = 0; c < 4; c++) {
+            old[i][c] = ch->lut[c];
+            if (ch->lut[c]) ws2812_lut_refs[(ch->lut[c] - ws2812_lut[0]) >> 8]--;
+            ch->lut[c] = NULL;
+        }
+    }
+    
+    for (uint8_t i = 0; i < num_channels; i++) {
+        WS2812_Channel_t* ch = &ws2812_channels[i];
+        if (!ch->active) continue;
+        
+        if (!WS2812_AssignLUT(ch, ch->brightness, ch->gamma, ch->correction)) {
+            for (uint8_t c = 0; c < 4; c++) {
+                ch->lut[c] = old[i][c];
+                if (ch->lut[c]) ws2812_lut_refs[(ch->lut[c] - ws2812_lut[0]) >> 8]++;
+            }
+            ws2812_power_stats.lut_failures++;
+        }
+        ch->dirty = 1;
+    }
+}
+
+// Colour draw of what every channel shows in mA, and the draw of its LEDs at black
+static uint32_t WS2812_PowerDrawMa(uint32_t* idle_ma) {
+    uint32_t colour_ma = 0;
+    uint32_t leds = 0;
+    
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!ws2812_channels[i].active) continue;
+        colour_ma += WS2812_ChannelDrawMa(&ws2812_channels[i]);
+        leds += ws2812_channels[i].led_count;
+    }
+    *idle_ma = leds * ws2812_power.idle_ua / 1000;
+    return colour_ma;
+}
+
+// Record the estimated draw of the frames on the LEDs now
+static void WS2812_PowerSetLast(uint32_t draw_ma) {
+    ws2812_power_stats.last_ma = draw_ma > 0xFFFF ? 0xFFFF : draw_ma;
+}
+
+// Estimate the draw of what every channel shows and move the scale towards
+// the budget: down at once, up only past the hysteresis (the channels are
+// then sent at the next commit). Returns 1 if the scale was cut.
+static uint8_t WS2812_PowerCheck(void) {
+    uint32_t idle_ma;
+    uint32_t colour_ma = WS2812_PowerDrawMa(&idle_ma);
+    
+    // Draw the content asks for before scaling, and the scale that fits it in the budget
+    uint8_t scale = ws2812_power.scale;
+    uint32_t full_ma = colour_ma * 255 / scale;
+    uint8_t target = 255;
+    
+    if (ws2812_power.budget_ma) {
+        uint32_t room = ws2812_power.budget_ma > idle_ma ? ws2812_power.budget_ma - idle_ma : 0;
+        if (full_ma > room) target = room * 255 / full_ma;
+        if (target == 0) target = 1;  // Keep some output to measure the content by
+    }
+    
+    uint8_t cut = target < scale;
+    if (cut || (target > scale && (target == 255 || target >= scale + WS2812_POWER_HYSTERESIS))) {
+        WS2812_SetPowerScale(target);
+    }
+    
+    WS2812_PowerStats_t* st = &ws2812_power_stats;
+    st->frames++;
+    WS2812_PowerSetLast(colour_ma + idle_ma);
+    if (full_ma + idle_ma > st->peak_ma) st->peak_ma = (full_ma + idle_ma > 0xFFFF) ? 0xFFFF : full_ma + idle_ma;
+    if (cut) st->cuts++;
+    if (ws2812_power.scale < 255) {
+        st->throttled++;
+        st->scale_sum += ws2812_power.scale;
+        if (ws2812_power.scale < st->min_scale) st->min_scale = ws2812_power.scale;
+    }
+    return cut;
+}
+
+// Throttling since the last WS2812_ResetPowerStats()
+static const WS2812_PowerStats_t* WS2812_GetPowerStats(void) {
+    return &ws2812_power_stats;
+}
+
+static void WS2812_ResetPowerStats(void) {
+    memset(&ws2812_power_stats, 0, sizeof(ws2812_power_stats));
+    ws2812_power_stats.min_scale = 255;
+}
+#endif
+
+#if WS2812_DOUBLE_BUFFER
+static void (*ws2812_present_callback)(uint8_t channel_mask) = NULL;
+
+// Register a function called by WS2812_Commit() after the buffers are swapped
+// and before anything is sent; it may change the front buffers of channel_mask
+static void WS2812_SetPresentCallback(void (*callback)(uint8_t channel_mask)) {
+    ws2812_present_callback = callback;
+}
+
+// Make the drawn frame of each channel in channel_mask the one transmitted.
+// The swap is a pointer exchange at the frame boundary, after any DMA stream
+// still reading the old front buffer has finished; the new frame is then
+// copied back so effects keep drawing on top of it. That copy is the cost of
+// double buffering: one word-aligned memcpy of the frame (3 bytes per LED,
+// less on indexed channels) per sent channel per commit, a few cycles per LED
+// against the 30us each LED takes on the wire.
+static void WS2812_SwapBuffers(uint8_t channel_mask) {
+    for (uint8_t i = 0; i < num_channels; i++) {
+        WS2812_Channel_t* ch = &ws2812_channels[i];
+        if (!(channel_mask & (1 << i)) || !ch->active || !ch->front_buffer) continue;
+        
+#if WS2812_USE_PWM_DMA
+        if (ch->backend == WS2812_BACKEND_PWM_DMA) {
+            WS2812_DMA_WAIT(ws2812_pwm_busy);
+        }
+#endif
+        WS2812_ArenaSwap((void**)&ch->led_buffer, (void**)&ch->front_buffer);
+        memcpy(ch->led_buffer, ch->front_buffer, WS2812_PixelBytes(ch->led_count, ch->format));
+    }
+}
+#endif
+
+// Send every dirty channel once, in parallel where possible, and clear the flags.
+// Call once per frame after all effects have updated their buffers.
+static void WS2812_Commit(void) {
+    uint8_t mask = 0;
+#if WS2812_SKIP_UNCHANGED
+    uint32_t hash[MAX_LED_CHANNELS];
+#endif
+    
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!ws2812_channels[i].active) continue;
+        
+        if (ws2812_channels[i].dirty) {
+            ws2812_channels[i].dirty = 0;
+#if WS2812_SKIP_UNCHANGED
+            // Redrawn, but to what the LEDs already show
+            hash[i] = WS2812_FrameHash(&ws2812_channels[i]);
+#if WS2812_DOUBLE_BUFFER
+            // A present callback changes the frame after it is hashed
+            if (ws2812_present_callback) hash[i] = 0;
+#endif
+            if (hash[i] && hash[i] == ws2812_channels[i].sent_hash) {
+                ws2812_commit_stats.unchanged++;
+                continue;
+            }
+#endif
+            mask |= 1 << i;
+            ws2812_commit_stats.sent++;
+        } else {
+            ws2812_commit_stats.skipped++;
+        }
+    }
+    
+#if WS2812_DOUBLE_BUFFER
+    if (mask) {
+        WS2812_SwapBuffers(mask);
+        if (ws2812_present_callback) ws2812_present_callback(mask);
+    }
+#endif
+    
+    if (mask) {
+        WS2812_SendParallel(mask);
+#if WS2812_SKIP_UNCHANGED
+        for (uint8_t i = 0; i < num_channels; i++) {
+            if (mask & (1 << i)) ws2812_channels[i].sent_hash = hash[i];
+        }
+#endif
+    }
+    
+#if WS2812_POWER_LIMIT
+    // Over budget: send everything again scaled down instead of leaving the
+    // frame on until the next commit
+    if (WS2812_PowerCheck()) {
+        mask = 0;
+        for (uint8_t i = 0; i < num_channels; i++) {
+            if (!ws2812_channels[i].active || !WS2812_HasPixels(&ws2812_channels[i])) continue;
+            ws2812_channels[i].dirty = 0;
+            mask |= 1 << i;
+        }
+        if (mask) WS2812_SendParallel(mask);
+        
+        uint32_t idle_ma;
+        WS2812_PowerSetLast(WS2812_PowerDrawMa(&idle_ma) + idle_ma);
+    }
+#endif
+}
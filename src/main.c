@@ -7,51 +7,119 @@
 // Include the colour and animation functions
 #include <LED_Functions.h>
 
+// Optional 2D matrix layer on top of the segments
+#include <LED_Matrix.h>
+
+// Optional live frames from a host over USART1 RX (PD6)
+//#include <LED_Stream.h>
+
+// Optional playback of compressed animations from flash, made with tools/ws2812_anim_encode.py
+//#include <LED_Playback.h>
+//#include "show_anim.h" // tools/ws2812_anim_encode.py show.rgb --leds 10 --frame-ms 40 --name show_anim -o src/show_anim.h
+//static LED_Playback_t playback;
+
 int main(void) {
 
-  Delay_Init();
+  WS2812_TimeInit(); // SysTick time base for latch deadlines; Delay_Ms/Delay_Us run on it from here on
 
   // Configure WS2812B channel(s)
   // GPIO pin options: PA1, PA2, PC1, PC2, PC4, PD4
   WS2812_ConfigureChannel(0, PC4, 10, 255);   // Initialize LED channel 0 with 10 LEDs on PC4 pin with brightness 255
   WS2812_ConfigureChannel(1, PC2, 10, 255);  // Initialize LED channel 1 with 10 LEDs on PC2 pin with brightness 255
 
-  Delay_Ms(10);
+  // Optional chip profile and colour order (defaults: WS2812, GRB)
+  //WS2812_SetChipProfile(1, WS2812_CHIP_SK6812_RGBW); // RGBW strip on channel 1; also WS2812_CHIP_WS2813, _SK6812, _WS2811 (400kHz)
+  //WS2812_SetAutoWhite(1, 1); // drive the white LED from the common part of red, green and blue
+  //WS2812_SetColorOrder(0, WS2812_ORDER_RGB); // for strips wired in another order
+
+  // Optional colour settings, applied through lookup tables rebuilt only when they change
+  //WS2812_SetGamma(0, 22); // gamma 2.2 on channel 0 (10 = linear)
+  //WS2812_SetColorCorrection(0, 255, 155, 155); // scale red, green, blue on channel 0 (255 = unchanged)
+
+  // Optional power limit, with -D WS2812_POWER_LIMIT=1: all channels are dimmed together to stay in budget
+  //WS2812_SetPowerModel(20, 20, 20, 20, 1000); // mA per colour at full output (red, green, blue, white), uA per dark LED
+  //WS2812_SetPowerBudget(500); // mA for all LEDs together, 0 = unlimited
+
+  WS2812_DelayMs(10);
 
   LED_OFF(0); // Turn off all LEDs on channel 0
+  WS2812_Commit(); // Transmit the channels that changed
+
+  WS2812_DelayMs(250);
+
+  LED_SchedulerInit(60); // Render and send at 60 frames per second
+
+  // Optional segments: effects run on segments, segment 0/1 are channels 0/1 by default
+  //LED_SegmentInit(4); // segment 4 = one 20 LED run: channel 0, then channel 1 reversed
+  //LED_SegmentAddSpan(4, 0, 0, 10, 0); // segment, channel, first LED, LED count, reverse
+  //LED_SegmentAddSpan(4, 1, 0, 10, 1);
+  //LED_SetEffect(4, &LED_EFFECT_COLOUR_WIPE, LED_PARAMS(0, 0, 255, 50, 0));
 
-  Delay_Ms(250);
+  // Optional matrix: channel 0 as a 5x2 serpentine panel running plasma
+  //LED_MatrixConfigure(0, 5, 2, 1, 1, LED_MATRIX_SERPENTINE, LED_MATRIX_ROTATE_0); // segment, panel width, height, tiles across, down, layout, rotation
+  //LED_SetEffect(0, &LED_EFFECT_MATRIX_PLASMA, LED_PARAMS(0, 0, 0, 20, 3)); // speed in ms, width = spatial scale 0-4
+
+  // Optional palette mode: 1 byte (PAL8) or 4 bits (PAL4) per LED instead of 3, coloured from a palette
+  //static uint8_t palette[16][3];
+  //LED_PaletteRainbow(palette, 16);
+  //WS2812_SetPaletteMode(1, WS2812_FORMAT_PAL4, palette, 16); // channel, format, palette, entries
+  //LED_SetEffect(1, &LED_EFFECT_PALETTE_CYCLE, LED_PARAMS(0, 0, 0, 50, 0)); // rotates the palette, O(1) per step
+
+  // Optional shader mode: no pixel buffer, each LED is generated while it is sent, so on the bit-bang and PWM backends the length is not limited by RAM (SPI still encodes into its buffer)
+  //WS2812_SetShader(1, 1000, WS2812_ShaderOff, NULL); // channel, LED count (0 = keep), generator, state
+  //LED_SetEffect(1, &LED_EFFECT_SHADER_RAINBOWS, LED_PARAMS(0, 0, 0, 20, 100)); // also _RAINBOW_CYCLE, _THEATER_CHASE, _PULSE
+
+  // Start one effect per channel; speeds are in milliseconds of real time
+  LED_SetEffect(0, &LED_EFFECT_RAINBOWS, LED_PARAMS(0, 0, 0, 10, 10)); // Channel 0: rainbow, 10ms steps, 10 LEDs per cycle
+  LED_SetEffect(1, &LED_EFFECT_RAINBOW_CYCLE, LED_PARAMS(0, 0, 0, 100, 0)); // Channel 1: rainbow cycle, 100ms steps
+
+  // Other effects (LED_PARAMS is red, green, blue, speed in ms, width/position):
+  //LED_SetEffect(0, &LED_EFFECT_FILL, LED_PARAMS(255, 127, 0, 0, 0)); // fill with a single colour
+  //LED_SetEffect(1, &LED_EFFECT_THEATER_CHASE, LED_PARAMS(0, 255, 0, 100, 0)); // theater chase
+  //LED_SetEffect(0, &LED_EFFECT_COLOUR_WIPE, LED_PARAMS(0, 0, 255, 250, 0)); // colour wipe
+  //LED_SetEffect(0, &LED_EFFECT_SINGLE_PIXEL, LED_PARAMS(255, 0, 0, 0, 1)); // single pixel at position 1
+  //LED_SetEffect(0, &LED_EFFECT_PULSE, LED_PARAMS(255, 0, 255, 25, 0)); // pulse
+  //LED_SetEffect(1, &LED_EFFECT_RGB_FLASH, LED_PARAMS(255, 0, 0, 500, 0)); // RGB flash, brightness in red
+  // With -D WS2812_DOUBLE_BUFFER=1, effects can also be changed with a crossfade:
+  //LED_SetEffectTransition(0, &LED_EFFECT_PULSE, LED_PARAMS(255, 0, 255, 25, 0), 1000); // fade over 1000 ms
+
+  // Optional streaming: frames received on PD6 replace the effects on their channel
+  //LED_StopEffect(0);
+  //LED_StreamInit(1000000); // baud rate
+
+  // Optional playback: frames decoded into channel 0, sent by LED_Update()
+  //LED_StopEffect(0);
+  //LED_PlaybackStart(&playback, 0, show_anim, sizeof(show_anim), 1); // playback state, channel, animation, its size in bytes, loop
 
   while(1){
-    // Non-blocking animations - call repeatedly for continuous animation
-    // Each function advances one frame when enough time has passed
+    //LED_StreamPoll(); // parse received bytes and commit complete frames
+    //LED_PlaybackUpdate(&playback); // decode the animation frames that are due
     
-    // Channel 0: Rainbow effect with configurable width
-    LED_RAINBOWS(0, 10, 10); // channel, speed (ticks), width (LEDs per cycle)
+    // Run the effects that are due and send the channels that changed, once per frame
+    if (LED_FrameDue()) {
+      LED_Update();
+    }
+    // With -D WS2812_LOW_POWER=1, sleep until the next frame instead of polling
+    // (and -D WS2812_SKIP_UNCHANGED=1 to leave the strips alone while the picture is static):
+    //else LED_Sleep();
     
-    // Channel 1: Rainbow cycle effect  
-    LED_RAINBOW_CYCLE(1, 100); // channel, speed (ticks)
+    // With -D WS2812_STATS=1, print where the time goes once a second:
+    //static uint32_t stats_ms = 0;
+    //if (WS2812_Millis() - stats_ms >= 1000) { stats_ms = WS2812_Millis(); LED_StatsDump(); LED_StatsReset(); }
     
-    // Uncomment other animations to run simultaneously on different channels:
+    // The call-every-loop functions still work and keep their slot running, e.g.:
+    //LED_RAINBOWS(0, 10, 10); // channel, speed (ms), width (LEDs per cycle)
+    //LED_RAINBOW_CYCLE(1, 100); // channel, speed (ms)
     //LED_OFF(0); // Turn off all LEDs on channel 0
-    //LED_RED(1, 255); // fill with red colour at specified brightness 0-255 on channel 0
+    //LED_RED(1, 255); // fill with red colour at specified brightness 0-255 on channel 1
     //LED_BLUE(0, 255); // fill with blue colour at specified brightness 0-255 on channel 0
     //LED_GREEN(0, 255); // fill with green colour at specified brightness 0-255 on channel 0
     //LED_FILL(0, 255, 127, 0); // fill with a single colour (red, green, blue) 0-255 RGB on channel 0
-    //LED_RAINBOWS(1, 10, 10); // variables are channel, delay speed in ticks and width (number of leds that cover one cycle)
-    //LED_RAINBOW_CYCLE(1, 100); // rainbow cycle with channel and delay in ticks
-    //LED_THEATER_CHASE(1, 0, 255, 0, 100); // theater chase with channel, RGB and delay in ticks
-    //LED_COLOUR_WIPE(0, 0, 0, 255, 250); // colour wipe with channel, RGB and delay in ticks
+    //LED_THEATER_CHASE(1, 0, 255, 0, 100); // theater chase with channel, RGB and delay in ms
+    //LED_COLOUR_WIPE(0, 0, 0, 255, 250); // colour wipe with channel, RGB and delay in ms
     //LED_SINGLE_PIXEL(0, 1, 255, 0, 0); // single pixel with channel, position and RGB
-    //LED_SINGLE_PIXEL(0, 2, 0, 255, 0); // single pixel with channel, position and RGB
-    //LED_SINGLE_PIXEL(0, 3, 0, 0, 255); // single pixel with channel, position and RGB
-    //LED_PULSE(0, 255, 0, 255, 25); // pulse with channel, RGB and delay in ticks
-
-    //RGB FLASH - THIS FUNCTION MAY CAUSE TIMING ISSUES WITH OTHER ANIMATIONS
-    //LED_RGB_FLASH(1, 500, 255); // RGB flash with channel, speed (ticks) and brightness 0-255
-    
-    // Small delay to prevent overwhelming the processor
-    Delay_Ms(1);
+    //LED_PULSE(0, 255, 0, 255, 25); // pulse with channel, RGB and delay in ms
+    //LED_RGB_FLASH(1, 500, 255); // RGB flash with channel, speed (ms) and brightness 0-255
   }
   return 0;
 }
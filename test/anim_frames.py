@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Frames for test_playback: writes them as a raw RGB dump, the input of
+tools/ws2812_anim_encode.py, and as a C header the test checks the decoded
+frames against.
+
+Usage: anim_frames.py out.rgb out.h
+"""
+
+import sys
+
+LEDS = 150
+FRAMES = 10
+COLOURS = [
+    (0x00, 0x00, 0x00), (0xFF, 0x40, 0x00), (0xC0, 0x30, 0x00), (0x80, 0x20, 0x00),
+    (0x40, 0x10, 0x00), (0x10, 0x04, 0x00), (0x00, 0x20, 0xFF), (0x12, 0x34, 0x56),
+]
+
+
+def frame(f):
+    """A comet over a dark strip, a blue bar that grows, and LEDs past the
+    first 128 that blink every other frame, so the encoder emits every op."""
+    px = [COLOURS[0]] * LEDS
+    for i in range(10, 20 + 3 * f):
+        px[i] = COLOURS[6]
+    for k in range(5):
+        px[(60 + 7 * f - k) % LEDS] = COLOURS[1 + k]
+    if f % 2:
+        for i in range(140, LEDS, 3):
+            px[i] = COLOURS[7]
+    return px
+
+
+def main():
+    frames = [frame(f) for f in range(FRAMES)]
+    with open(sys.argv[1], "wb") as out:
+        for px in frames:
+            out.write(b"".join(bytes(c) for c in px))
+    lines = [
+        "// Generated by anim_frames.py: the frames of the encoded test animations",
+        "#define ANIM_LEDS %d" % LEDS,
+        "#define ANIM_FRAMES %d" % FRAMES,
+        "static const uint8_t anim_frames[ANIM_FRAMES][ANIM_LEDS][3] = {",
+    ]
+    for px in frames:
+        lines.append("    {" + ", ".join("{%d, %d, %d}" % c for c in px) + "},")
+    lines.append("};")
+    with open(sys.argv[2], "w") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
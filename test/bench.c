@@ -0,0 +1,314 @@
+// Benchmarks on the simulated chip. Transmit times come from the cycle
+// model (the bit-bang senders keep the CPU busy for the whole frame), render
+// times are host nanoseconds and only useful to compare effects. Each result
+// is checked against a bound, so a slower sender fails the run.
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+#define FPS 60
+#define FRAMES 50
+
+// Longest modelled bit: a 1 bit whose low phase is shorter than the loop work
+#define BENCH_BIT_CYCLES WS2812_MAX(WS2812_BIT_CYCLES, WS2812_T1H_CYCLES + WS2812_BIT_LOOP_CYCLES)
+// Per-LED allowance for the interrupt windows and latch checks
+#define BENCH_LED_SLACK_CYCLES 64
+
+static const struct {
+    const char* name;
+    const LED_Effect_t* effect;
+    LED_EffectParams_t params;
+} bench_effects[] = {
+    {"fill", &LED_EFFECT_FILL, LED_PARAMS(255, 127, 0, 0, 0)},
+    {"rainbows", &LED_EFFECT_RAINBOWS, LED_PARAMS(0, 0, 0, 10, 10)},
+    {"rainbow_cycle", &LED_EFFECT_RAINBOW_CYCLE, LED_PARAMS(0, 0, 0, 10, 0)},
+    {"theater_chase", &LED_EFFECT_THEATER_CHASE, LED_PARAMS(0, 255, 0, 10, 0)},
+    {"pulse", &LED_EFFECT_PULSE, LED_PARAMS(255, 0, 255, 5, 0)},
+};
+
+static const uint16_t bench_lengths[] = {10, 60, 150};
+
+// Modelled cycles to send one frame of a channel
+static uint64_t bench_send_cycles(uint8_t channel_idx) {
+    uint64_t start;
+    WS2812_WaitLatch(&ws2812_channels[channel_idx]);
+    start = sim_cycles;
+    WS2812_SendChannel(&ws2812_channels[channel_idx]);
+    return sim_cycles - start;
+}
+
+// Load of the table pointer, index and table byte per colour byte
+#define BENCH_LUT_BYTE_CYCLES 3
+
+// Modelled cycles per pixel of the colour scaling the send path used to do
+// between pixels: Map_Range(v, 0, 255, 0, out), a multiply and a divide per
+// byte through libgcc, with green and blue at brightness - 100; or a plain
+// v * (brightness + 1) >> 8 per byte
+static uint32_t bench_map_range_cycles(const uint8_t (*rgb)[3], uint16_t leds, uint8_t brightness, uint8_t multiply_only) {
+    uint64_t cycles = 0;
+    for (uint16_t i = 0; i < leds; i++) {
+        for (uint8_t c = 0; c < 3; c++) {
+            uint8_t v = rgb[i][c];
+            if (multiply_only) {
+                cycles += sim_mul_cycles(v, brightness + 1);
+            } else {
+                int32_t out = c == 0 ? brightness : brightness - 100;
+                cycles += sim_mul_cycles(v, out) + sim_div_cycles(v * out, 255);
+            }
+        }
+    }
+    return cycles / leds;
+}
+
+static void bench_cycles_per_pixel(void) {
+    const uint16_t leds = 100;
+    static uint8_t rgb[100][3];
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+    for (uint16_t i = 0; i < leds; i++) {
+        rgb[i][0] = i;
+        rgb[i][1] = 255 - i;
+        rgb[i][2] = i * 3;
+        WS2812_SetPixel(0, i, rgb[i][0], rgb[i][1], rgb[i][2]);
+    }
+
+    uint64_t cycles = bench_send_cycles(0);
+    printf("bench: 800kHz RGB    %5llu cycles/pixel (bound %u)\n",
+           (unsigned long long)(cycles / leds), 24 * BENCH_BIT_CYCLES + BENCH_LED_SLACK_CYCLES);
+    SIM_CHECK(cycles / leds <= 24 * BENCH_BIT_CYCLES + BENCH_LED_SLACK_CYCLES);
+
+    // The tables are read in the bit loop's own low phase; Map_Range ran
+    // between pixels and held the line low for its whole time
+    uint32_t map_range = bench_map_range_cycles(rgb, leds, 255, 0);
+    uint32_t multiply = bench_map_range_cycles(rgb, leds, 255, 1);
+    printf("bench: colour scaling, modelled cycles/pixel: Map_Range %u, multiply %u, colour tables %u\n",
+           map_range, multiply, 3 * BENCH_LUT_BYTE_CYCLES);
+    printf("bench: 800kHz RGB send, cycles/pixel: with Map_Range %llu, with colour tables %llu\n",
+           (unsigned long long)(cycles / leds + map_range), (unsigned long long)(cycles / leds));
+    SIM_CHECK(3 * BENCH_LUT_BYTE_CYCLES < multiply && multiply < map_range);
+
+    SIM_CHECK(WS2812_SetChipProfile(0, WS2812_CHIP_WS2811));
+    cycles = bench_send_cycles(0);
+    printf("bench: 400kHz RGB    %5llu cycles/pixel\n", (unsigned long long)(cycles / leds));
+    SIM_CHECK(cycles / leds <= 24 * (WS2811_BIT_CYCLES + WS2812_BIT_LOOP_CYCLES) + BENCH_LED_SLACK_CYCLES);
+    WS2812_FreeChannel(0);
+}
+
+static void bench_effect_frames(void) {
+    uint32_t period_cycles = WS2812_F_CPU / FPS;
+
+    printf("bench: %-14s %5s %10s %10s %8s\n", "effect", "leds", "render ns", "tx us", "tx busy");
+    for (uint8_t e = 0; e < sizeof(bench_effects) / sizeof(bench_effects[0]); e++) {
+        for (uint8_t l = 0; l < sizeof(bench_lengths) / sizeof(bench_lengths[0]); l++) {
+            uint16_t leds = bench_lengths[l];
+            uint64_t tx = 0;
+            uint64_t render = 0;
+
+            SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+            LED_SegmentReset(0);
+            LED_SetEffect(0, bench_effects[e].effect, bench_effects[e].params);
+
+            for (uint16_t f = 0; f < FRAMES; f++) {
+                sim_cycles += period_cycles;
+                sim_log_clear();
+
+                uint64_t host = sim_host_ns();
+                LED_RunSlot(0, get_animation_ticks());
+                render += sim_host_ns() - host;
+
+                uint64_t start = sim_cycles;
+                WS2812_Commit();
+                tx += sim_cycles - start;
+            }
+            LED_StopEffect(0);
+            WS2812_FreeChannel(0);
+
+            // Effects that do not change every frame are not sent every frame
+            uint64_t tx_us = SIM_CYCLES_TO_NS(tx / FRAMES) / 1000;
+            uint32_t busy = (uint32_t)(tx / FRAMES * 1000 / period_cycles);
+            printf("bench: %-14s %5u %10llu %10llu %6u.%u%%\n", bench_effects[e].name, leds,
+                   (unsigned long long)(render / FRAMES), (unsigned long long)tx_us, busy / 10, busy % 10);
+            SIM_CHECK(tx / FRAMES <= (uint64_t)leds * (24 * BENCH_BIT_CYCLES + BENCH_LED_SLACK_CYCLES));
+        }
+    }
+}
+
+// LED_EFFECT_RAINBOWS as it was before the HSV kernel: Wheel() and a
+// division per pixel
+static void bench_rainbows_wheel(LED_Segment_t* seg, uint16_t width, uint8_t pos) {
+    LED_SegmentIter_t it;
+    uint8_t* px;
+    LED_SegmentBegin(&it, seg);
+    for (uint16_t i = 0; (px = LED_SegmentNext(&it)); i++) {
+        uint8_t* color = Wheel((uint8_t)((i * 256 / width + pos) & 255));
+        LED_SetRGB(px, color[0], color[1], color[2]);
+    }
+}
+
+// The rainbow per pixel: host ns, best of several runs to keep out noise,
+// and the modelled cycles of its divisions on the CH32V003. The host
+// divides in hardware, so its ns leave out what the division per pixel
+// costs the chip; the rest of both paths is table loads, shifts and adds.
+static void bench_rainbow_kernel(void) {
+    const uint16_t leds = 150;
+    const uint16_t passes = 200;
+    volatile uint16_t width = 37;  // not a constant the compiler can fold
+    uint64_t best_wheel = UINT64_MAX, best_hsv = UINT64_MAX;
+
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+    LED_SegmentReset(0);
+    LED_Segment_t* seg = LED_GetSegment(0);
+
+    for (uint8_t run = 0; run < 7; run++) {
+        uint64_t start = sim_host_ns();
+        for (uint16_t p = 0; p < passes; p++) bench_rainbows_wheel(seg, width, (uint8_t)p);
+        uint64_t wheel = sim_host_ns() - start;
+
+        start = sim_host_ns();
+        for (uint16_t p = 0; p < passes; p++) LED_SegmentRainbow(seg, p << 8, (uint16_t)(65536UL / width));
+        uint64_t hsv = sim_host_ns() - start;
+
+        if (wheel < best_wheel) best_wheel = wheel;
+        if (hsv < best_hsv) best_hsv = hsv;
+    }
+    WS2812_FreeChannel(0);
+
+    // Wheel divides per pixel, the kernel's step is one division per frame
+    uint64_t div_wheel = 0, div_hsv = sim_udiv_cycles(65536, width);
+    for (uint16_t i = 0; i < leds; i++) div_wheel += sim_div_cycles(i * 256, width);
+
+    uint32_t pixels = (uint32_t)leds * passes;
+    printf("bench: rainbow, host ns/pixel: Wheel + division %llu.%02llu, HSV kernel %llu.%02llu\n",
+           (unsigned long long)(best_wheel / pixels), (unsigned long long)(best_wheel * 100 / pixels % 100),
+           (unsigned long long)(best_hsv / pixels), (unsigned long long)(best_hsv * 100 / pixels % 100));
+    printf("bench: rainbow, modelled division cycles/pixel: Wheel + division %llu.%02llu, HSV kernel %llu.%02llu\n",
+           (unsigned long long)(div_wheel / leds), (unsigned long long)(div_wheel * 100 / leds % 100),
+           (unsigned long long)(div_hsv / leds), (unsigned long long)(div_hsv * 100 / leds % 100));
+    // The host, with its divider, runs the kernel a little slower than
+    // Wheel; on the chip it saves a division of over 100 cycles per pixel,
+    // more than the few dozen instructions of either path's other work
+    SIM_CHECK(best_hsv <= best_wheel * 2);
+    SIM_CHECK(div_hsv * 50 < div_wheel);
+}
+
+// Byte-at-a-time versions of the bulk operations, the way the effects used
+// to loop. Vectorising is off: the CH32V003 has no SIMD to do it.
+#define BENCH_BYTEWISE __attribute__((noinline, optimize("no-tree-vectorize")))
+
+BENCH_BYTEWISE static void bench_byte_fill(uint8_t* dst, uint16_t count, uint8_t red, uint8_t green, uint8_t blue) {
+    for (uint16_t i = 0; i < count; i++) LED_SetRGB(dst + i * 3, red, green, blue);
+}
+
+BENCH_BYTEWISE static void bench_byte_scale(uint8_t* buf, uint16_t count, uint8_t scale) {
+    for (uint16_t i = 0; i < count * 3; i++) buf[i] = buf[i] * (scale + 1) >> 8;
+}
+
+BENCH_BYTEWISE static void bench_byte_blend(uint8_t* dst, const uint8_t* src, uint16_t count, uint8_t amount) {
+    for (uint16_t i = 0; i < count * 3; i++) dst[i] = (dst[i] * (255 - amount) + src[i] * (amount + 1)) >> 8;
+}
+
+BENCH_BYTEWISE static void bench_byte_shift(uint8_t* buf, uint16_t count, uint16_t n) {
+    for (uint16_t i = count - 1; i >= n; i--) {
+        for (uint8_t c = 0; c < 3; c++) buf[i * 3 + c] = buf[(i - n) * 3 + c];
+    }
+    for (uint16_t i = 0; i < n * 3; i++) buf[i] = 0;
+}
+
+// Host ns for passes runs of one operation, best of several
+#define BENCH_BEST(best, passes, op) do { \
+    for (uint8_t run = 0; run < 7; run++) { \
+        uint64_t t = sim_host_ns(); \
+        for (uint16_t p = 0; p < (passes); p++) { op; } \
+        t = sim_host_ns() - t; \
+        if (t < (best)) (best) = t; \
+    } \
+} while (0)
+
+// Throughput of the word-wide bulk operations against byte loops, on a
+// channel buffer. The word versions must not be slower.
+static void bench_bulk_ops(void) {
+    const uint16_t leds = 150;
+    const uint16_t passes = 400;
+    static uint8_t other[150 * 3] __attribute__((aligned(4)));
+
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+    uint8_t* buf = ws2812_channels[0].led_buffer[0];
+    for (uint16_t i = 0; i < leds * 3; i++) other[i] = i * 7;
+
+    printf("bench: %-8s %12s %12s  (MB/s, %u pixels)\n", "bulk op", "bytewise", "LED_Buf", leds);
+    for (uint8_t op = 0; op < 4; op++) {
+        static const char* const names[4] = {"fill", "scale", "blend", "shift"};
+        uint64_t byte = UINT64_MAX, word = UINT64_MAX;
+        switch (op) {
+            case 0:
+                BENCH_BEST(byte, passes, bench_byte_fill(buf, leds, p, 2, 3));
+                BENCH_BEST(word, passes, LED_BufFill(buf, leds, p, 2, 3));
+                break;
+            case 1:
+                BENCH_BEST(byte, passes, bench_byte_scale(buf, leds, 250 - (p & 7)));
+                BENCH_BEST(word, passes, LED_BufScale(buf, leds, 250 - (p & 7)));
+                break;
+            case 2:
+                BENCH_BEST(byte, passes, bench_byte_blend(buf, other, leds, p));
+                BENCH_BEST(word, passes, LED_BufBlend(buf, other, leds, p));
+                break;
+            default:
+                BENCH_BEST(byte, passes, bench_byte_shift(buf, leds, 1 + (p & 3)));
+                BENCH_BEST(word, passes, LED_BufShift(buf, leds, 1 + (p & 3)));
+                break;
+        }
+        // bytes per ns * 1000 = MB/s
+        uint64_t bytes = (uint64_t)leds * 3 * passes * 1000;
+        printf("bench: %-8s %12llu %12llu\n", names[op], (unsigned long long)(bytes / byte), (unsigned long long)(bytes / word));
+        SIM_CHECK(word <= byte * 2);
+    }
+    WS2812_FreeChannel(0);
+}
+
+static void bench_parallel(void) {
+    const uint16_t leds = 40;
+    uint64_t serial = 0;
+
+    for (uint8_t c = 0; c < 3; c++) {
+        static const uint8_t pins[3] = {PC1, PC2, PC4};
+        SIM_CHECK(WS2812_ConfigureChannel(c, pins[c], leds, 255));
+        for (uint16_t i = 0; i < leds; i++) WS2812_SetPixel(c, i, i, c * 50, 255 - i);
+    }
+    sim_irq_off_max = 0;
+    for (uint8_t c = 0; c < 3; c++) serial += bench_send_cycles(c);
+    uint64_t serial_off = sim_irq_off_max;
+
+    for (uint8_t c = 0; c < 3; c++) WS2812_WaitLatch(&ws2812_channels[c]);
+    sim_irq_off_max = 0;
+    uint64_t start = sim_cycles;
+    WS2812_SendParallel(0x07);
+    uint64_t parallel = sim_cycles - start;
+    uint64_t parallel_off = sim_irq_off_max;
+
+    printf("bench: 3 x %u LEDs on port C: one by one %llu us, in parallel %llu us\n", leds,
+           (unsigned long long)(SIM_CYCLES_TO_NS(serial) / 1000), (unsigned long long)(SIM_CYCLES_TO_NS(parallel) / 1000));
+    // Three strips in well under the time of two, with every slice of the
+    // next LED's work charged its worst case
+    SIM_CHECK(parallel * 3 < serial * 2);
+
+    // A section is WS2812_IRQ_OFF_BYTES wire bytes of the longest modelled
+    // bit, longer than the nominal 1.25us; a group's bits add the T0H..T1H step
+    // and the next LED's work of three channels, four slices per wire byte
+    uint64_t one_bound = (uint64_t)WS2812_IRQ_OFF_BYTES * 8 * BENCH_BIT_CYCLES + BENCH_LED_SLACK_CYCLES;
+    uint64_t group_bound = (uint64_t)WS2812_IRQ_OFF_BYTES * (8 * (BENCH_BIT_CYCLES + WS2812_T1H_CYCLES) + 4 * WS2812_GROUP_STEP_CYCLES) +
+                           BENCH_LED_SLACK_CYCLES;
+    printf("bench: longest interrupt-off section: one pin %llu us (bound %llu), port group %llu us (bound %llu)\n",
+           (unsigned long long)(SIM_CYCLES_TO_NS(serial_off) / 1000), (unsigned long long)(SIM_CYCLES_TO_NS(one_bound) / 1000),
+           (unsigned long long)(SIM_CYCLES_TO_NS(parallel_off) / 1000), (unsigned long long)(SIM_CYCLES_TO_NS(group_bound) / 1000));
+    SIM_CHECK(serial_off <= one_bound);
+    SIM_CHECK(parallel_off <= group_bound);
+    for (uint8_t c = 0; c < 3; c++) WS2812_FreeChannel(c);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    bench_cycles_per_pixel();
+    bench_effect_frames();
+    bench_rainbow_kernel();
+    bench_bulk_ops();
+    bench_parallel();
+    return sim_finish("bench");
+}
@@ -0,0 +1,281 @@
+// Host stand-in for the CH32V003 noneos SDK (debug.h / ch32v00x.h).
+// Only the registers, bits and calls the driver and its layers use are
+// here. Peripherals are plain structs in RAM; SysTick is driven by the
+// modelled cycle count in sim_cycles, so every busy-wait on it ends.
+#ifndef SIM_DEBUG_H
+#define SIM_DEBUG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Core clock of the modelled chip, shared with the driver
+#ifndef WS2812_F_CPU
+#define WS2812_F_CPU 48000000
+#endif
+
+// Modelled core cycles since start. The port hooks in ws2812_sim.h and the
+// calls below add to it; each SysTick access costs SIM_SYSTICK_READ_CYCLES.
+static uint64_t sim_cycles;
+#ifndef SIM_SYSTICK_READ_CYCLES
+#define SIM_SYSTICK_READ_CYCLES 8
+#endif
+
+// The RISC-V interrupt attribute means nothing to a host compiler
+#define interrupt
+
+// GPIO
+typedef struct {
+    volatile uint32_t CFGLR;
+    volatile uint32_t CFGHR;
+    volatile uint32_t INDR;
+    volatile uint32_t OUTDR;
+    volatile uint32_t BSHR;
+    volatile uint32_t BCR;
+    volatile uint32_t LCKR;
+} GPIO_TypeDef;
+
+static GPIO_TypeDef sim_gpioa, sim_gpioc, sim_gpiod;
+#define GPIOA (&sim_gpioa)
+#define GPIOC (&sim_gpioc)
+#define GPIOD (&sim_gpiod)
+
+#define GPIO_Speed_50MHz 3
+#define GPIO_Mode_IPU 0x48
+#define GPIO_Mode_Out_PP 0x10
+#define GPIO_Mode_AF_PP 0x18
+
+// RCC
+typedef struct {
+    volatile uint32_t CTLR;
+    volatile uint32_t CFGR0;
+    volatile uint32_t INTR;
+    volatile uint32_t APB2PRSTR;
+    volatile uint32_t APB1PRSTR;
+    volatile uint32_t AHBPCENR;
+    volatile uint32_t APB2PCENR;
+    volatile uint32_t APB1PCENR;
+} RCC_TypeDef;
+
+static RCC_TypeDef sim_rcc;
+#define RCC (&sim_rcc)
+
+#define RCC_AHBPeriph_DMA1 0x0001
+#define RCC_APB2Periph_AFIO 0x0001
+#define RCC_APB2Periph_GPIOA 0x0004
+#define RCC_APB2Periph_GPIOC 0x0010
+#define RCC_APB2Periph_GPIOD 0x0020
+#define RCC_APB2Periph_SPI1 0x1000
+#define RCC_APB2Periph_USART1 0x4000
+#define RCC_APB1Periph_TIM2 0x0001
+
+// SysTick: counts up at HCLK/8 while CTLR bit 0 is set
+typedef struct {
+    volatile uint32_t CTLR;
+    volatile uint32_t SR;
+    volatile uint32_t CNT;
+    uint32_t RESERVED0;
+    volatile uint32_t CMP;
+    uint32_t RESERVED1;
+} SysTick_Type;
+
+static SysTick_Type sim_systick_regs;
+static uint64_t sim_systick_synced;
+
+// Bring CNT up to the modelled time, then hand out the registers
+static SysTick_Type* sim_systick(void) {
+    sim_cycles += SIM_SYSTICK_READ_CYCLES;
+    if (sim_systick_regs.CTLR & 1) {
+        uint64_t ticks = (sim_cycles - sim_systick_synced) / 8;
+        sim_systick_regs.CNT += (uint32_t)ticks;
+        sim_systick_synced += ticks * 8;
+    } else {
+        sim_systick_synced = sim_cycles;
+    }
+    return &sim_systick_regs;
+}
+#define SysTick (sim_systick())
+
+// DMA1
+typedef struct {
+    volatile uint32_t INTFR;
+    volatile uint32_t INTFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    volatile uint32_t CFGR;
+    volatile uint32_t CNTR;
+    volatile uint32_t PADDR;
+    volatile uint32_t MADDR;
+} DMA_Channel_TypeDef;
+
+static __attribute__((unused)) DMA_TypeDef sim_dma1;
+static __attribute__((unused)) DMA_Channel_TypeDef sim_dma1_channel[8];
+#define DMA1 (&sim_dma1)
+#define DMA1_Channel2 (&sim_dma1_channel[2])
+#define DMA1_Channel3 (&sim_dma1_channel[3])
+#define DMA1_Channel5 (&sim_dma1_channel[5])
+
+#define DMA1_IT_GL2 0x00000010
+#define DMA1_IT_TC2 0x00000020
+#define DMA1_IT_HT2 0x00000040
+#define DMA1_IT_GL3 0x00000100
+#define DMA1_IT_TC3 0x00000200
+#define DMA1_IT_HT3 0x00000400
+#define DMA1_IT_GL5 0x00010000
+#define DMA1_IT_TC5 0x00020000
+#define DMA1_IT_HT5 0x00040000
+
+#define DMA_CFGR1_EN 0x0001
+#define DMA_IT_TC 0x0002
+#define DMA_IT_HT 0x0004
+#define DMA_DIR_PeripheralSRC 0x0000
+#define DMA_DIR_PeripheralDST 0x0010
+#define DMA_Mode_Circular 0x0020
+#define DMA_MemoryInc_Enable 0x0080
+#define DMA_PeripheralDataSize_HalfWord 0x0100
+#define DMA_MemoryDataSize_Byte 0x0000
+#define DMA_Priority_High 0x2000
+#define DMA_Priority_VeryHigh 0x3000
+
+// SPI1
+typedef struct {
+    volatile uint32_t CTLR1;
+    volatile uint32_t CTLR2;
+    volatile uint32_t STATR;
+    volatile uint32_t DATAR;
+    volatile uint32_t CRCR;
+} SPI_TypeDef;
+
+static __attribute__((unused)) SPI_TypeDef sim_spi1;
+#define SPI1 (&sim_spi1)
+
+#define SPI_Mode_Master 0x0104
+#define SPI_Direction_1Line_Tx 0xC000
+#define SPI_NSS_Soft 0x0200
+#define SPI_BaudRatePrescaler_4 0x0008
+#define SPI_BaudRatePrescaler_8 0x0010
+#define SPI_BaudRatePrescaler_16 0x0018
+#define SPI_CTLR1_SPE 0x0040
+#define SPI_I2S_DMAReq_Tx 0x0002
+
+// TIM2
+typedef struct {
+    volatile uint32_t CTLR1;
+    volatile uint32_t CTLR2;
+    volatile uint32_t SMCFGR;
+    volatile uint32_t DMAINTENR;
+    volatile uint32_t INTFR;
+    volatile uint32_t SWEVGR;
+    volatile uint32_t CHCTLR1;
+    volatile uint32_t CHCTLR2;
+    volatile uint32_t CCER;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ATRLR;
+    volatile uint32_t RPTCR;
+    volatile uint32_t CH1CVR;
+    volatile uint32_t CH2CVR;
+    volatile uint32_t CH3CVR;
+    volatile uint32_t CH4CVR;
+} TIM_TypeDef;
+
+static __attribute__((unused)) TIM_TypeDef sim_tim2;
+#define TIM2 (&sim_tim2)
+
+#define TIM_CEN 0x0001
+#define TIM_ARPE 0x0080
+#define TIM_UG 0x0001
+#define TIM_UDE 0x0100
+#define TIM_CC1E 0x0001
+#define TIM_OC1PE 0x0008
+#define TIM_OC1M_1 0x0020
+#define TIM_OC1M_2 0x0040
+
+// USART1
+typedef struct {
+    volatile uint32_t STATR;
+    volatile uint32_t DATAR;
+    volatile uint32_t BRR;
+    volatile uint32_t CTLR1;
+    volatile uint32_t CTLR2;
+    volatile uint32_t CTLR3;
+    volatile uint32_t GPR;
+} USART_TypeDef;
+
+static __attribute__((unused)) USART_TypeDef sim_usart1;
+#define USART1 (&sim_usart1)
+
+#define USART_Mode_Rx 0x0004
+#define USART_CTLR1_IDLEIE 0x0010
+#define USART_CTLR1_UE 0x2000
+#define USART_DMAReq_Rx 0x0040
+
+// Interrupts
+#define SysTicK_IRQn 12
+#define DMA1_Channel2_IRQn 23
+#define DMA1_Channel3_IRQn 24
+#define DMA1_Channel5_IRQn 26
+#define USART1_IRQn 32
+
+static uint64_t sim_nvic_enabled;
+static uint8_t sim_irq_masked;
+static uint64_t sim_irq_masked_at;
+static uint64_t sim_irq_off_max;  // longest masked stretch, cycles
+
+static inline void NVIC_EnableIRQ(int irqn) {
+    sim_nvic_enabled |= 1ULL << irqn;
+}
+
+static inline void __disable_irq(void) {
+    if (!sim_irq_masked) sim_irq_masked_at = sim_cycles;
+    sim_irq_masked = 1;
+}
+
+static inline void __enable_irq(void) {
+    if (sim_irq_masked && sim_cycles - sim_irq_masked_at > sim_irq_off_max) {
+        sim_irq_off_max = sim_cycles - sim_irq_masked_at;
+    }
+    sim_irq_masked = 0;
+}
+
+// An interrupt a test has some other peripheral raise at a modelled cycle
+// (0 = none). A WFI before then ends there if the IRQ is enabled in the NVIC,
+// and the handler runs.
+static uint64_t sim_wake_at;
+static int sim_wake_irqn;
+static void (*sim_wake_handler)(void);
+
+// Sleep until the SysTick compare if its interrupt is armed, or the interrupt
+// above if it comes first; else return at once
+static inline void __WFI(void) {
+    SysTick_Type* st = SysTick;
+    uint64_t deadline = UINT64_MAX;
+    if (st->CTLR & (1 << 1)) deadline = sim_cycles + (uint64_t)(uint32_t)(st->CMP - st->CNT) * 8;
+
+    if (sim_wake_at && sim_wake_at < deadline && (sim_nvic_enabled >> sim_wake_irqn & 1)) {
+        if (sim_wake_at > sim_cycles) sim_cycles = sim_wake_at;
+        sim_wake_at = 0;
+        if (sim_wake_handler) sim_wake_handler();
+        return;
+    }
+    if (deadline != UINT64_MAX) {
+        sim_cycles = deadline;
+        (void)SysTick;
+        st->SR = 1;
+    }
+}
+
+// SDK delays: like the real ones they stop SysTick when done
+static inline void Delay_Init(void) {
+}
+
+static inline void Delay_Us(uint32_t n) {
+    sim_cycles += (uint64_t)n * (WS2812_F_CPU / 1000000);
+    sim_systick_regs.CTLR = 0;
+}
+
+static inline void Delay_Ms(uint32_t n) {
+    Delay_Us(n * 1000);
+}
+
+#endif // SIM_DEBUG_H
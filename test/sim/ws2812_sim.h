@@ -0,0 +1,257 @@
+// Host simulation of the WS2812 driver.
+// A test includes this instead of <debug.h> and <WS2812B_Driver.h> (after
+// any WS2812_* configuration it wants). The bit-bang hooks record every
+// BSHR/BCR write with a modelled cycle stamp:
+//  - a port write costs WS2812_PORT_WRITE_CYCLES
+//  - WS2812_NOPS(n) costs n cycles
+//  - the per-bit loop work, WS2812_BIT_LOOP_CYCLES including the clearing
+//    write, is charged in front of every rising edge
+//  - a port group's slice of next-LED work costs WS2812_GROUP_STEP_CYCLES
+// Code outside the hooks (single-pin pixel fetch, ISRs) is free, so the
+// model gives the time on the wire, not the time of the C around it.
+// sim_decode() turns the recorded writes on one pin back into bytes.
+#ifndef WS2812_SIM_H
+#define WS2812_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "debug.h"
+
+// Recorded port write
+typedef struct {
+    uint64_t cycle;
+    GPIO_TypeDef* port;
+    uint32_t mask;
+    uint8_t level;  // 1 = BSHR (set), 0 = BCR (clear)
+} sim_event_t;
+
+static sim_event_t* sim_log;
+static uint32_t sim_log_len;
+static uint32_t sim_log_cap;
+
+static void sim_port_write(GPIO_TypeDef* port, uint32_t mask, uint8_t level, uint32_t before, uint32_t cost) {
+    sim_cycles += before;
+    if (sim_log_len == sim_log_cap) {
+        sim_log_cap = sim_log_cap ? sim_log_cap * 2 : 4096;
+        sim_log = realloc(sim_log, sim_log_cap * sizeof(sim_event_t));
+        if (!sim_log) {
+            fprintf(stderr, "sim: out of memory for the port log\n");
+            exit(2);
+        }
+    }
+    sim_log[sim_log_len++] = (sim_event_t){sim_cycles, port, mask, level};
+
+    if (level) {
+        port->OUTDR |= mask;
+    } else {
+        port->OUTDR &= ~mask;
+    }
+    sim_cycles += cost;
+}
+
+// Forget the recorded writes (the modelled clock keeps running)
+static void sim_log_clear(void) {
+    sim_log_len = 0;
+}
+
+#define WS2812_PORT_SET(port, mask) \
+    sim_port_write((port), (mask), 1, WS2812_BIT_LOOP_CYCLES - WS2812_PORT_WRITE_CYCLES, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_PORT_CLR(port, mask) \
+    sim_port_write((port), (mask), 0, 0, WS2812_PORT_WRITE_CYCLES)
+#define WS2812_NOPS(n) (sim_cycles += (n))
+// A port group's slice of next-LED work costs its worst case
+#define WS2812_GROUP_STEP_DONE() (sim_cycles += WS2812_GROUP_STEP_CYCLES)
+
+#include <WS2812B_Driver.h>
+
+#define SIM_CYCLES_TO_NS(c) ((uint64_t)(c) * 1000 / WS2812_CPU_MHZ)
+#define SIM_NS_TO_CYCLES(ns) ((uint64_t)(ns) * WS2812_CPU_MHZ / 1000)
+
+// A low time longer than this ends a frame (the strip has latched)
+#ifndef SIM_LATCH_NS
+#define SIM_LATCH_NS 50000
+#endif
+#ifndef SIM_FRAME_BYTES
+#define SIM_FRAME_BYTES 4096
+#endif
+
+// Shortest high time a WS2812 reliably sees as a 0 bit
+#define SIM_T0H_MIN_NS 150
+// WS2811 low speed 1 bit: 1.2us, with a wide margin
+#define SIM_WS2811_T1H_MIN_NS 1000
+#define SIM_WS2811_T1H_MAX_NS 1500
+
+// One frame decoded from a pin
+typedef struct {
+    uint8_t data[SIM_FRAME_BYTES];
+    uint32_t bits;
+    uint32_t bad_high;   // high times outside the chip's 0 and 1 windows
+    uint64_t start;      // cycle of the first rising edge
+    uint64_t end;        // cycle of the last falling edge
+    uint64_t max_low;    // longest low time between two bits, cycles
+    uint64_t high_min[2];  // shortest and longest high time of 0 and 1 bits, cycles
+    uint64_t high_max[2];
+} sim_frame_t;
+
+// Decode the writes to one pin into frames, split where the line stayed low
+// for SIM_LATCH_NS. speed is WS2812_SPEED_800K or WS2812_SPEED_400K.
+// Returns the number of frames found (at most max_frames are filled).
+static int sim_decode(GPIO_TypeDef* port, uint8_t pin, uint8_t speed, sim_frame_t* frames, int max_frames) {
+    uint32_t mask = 1u << pin;
+    uint32_t zero_max = speed == WS2812_SPEED_400K ? WS2811_T0H_MAX_NS : WS2812_T0H_MAX_NS;
+    uint32_t one_min = speed == WS2812_SPEED_400K ? SIM_WS2811_T1H_MIN_NS : WS2812_T1H_MIN_NS;
+    uint32_t one_max = speed == WS2812_SPEED_400K ? SIM_WS2811_T1H_MAX_NS : WS2812_T1H_MAX_NS;
+    uint32_t split = (zero_max + one_min) / 2;
+    sim_frame_t* f = NULL;
+    int count = 0;
+    uint8_t high = 0;
+    uint64_t rise = 0;
+
+    for (uint32_t e = 0; e < sim_log_len; e++) {
+        const sim_event_t* ev = &sim_log[e];
+        if (ev->port != port || !(ev->mask & mask)) continue;
+
+        if (ev->level) {
+            if (high) continue;
+            high = 1;
+            rise = ev->cycle;
+
+            if (f && SIM_CYCLES_TO_NS(rise - f->end) <= SIM_LATCH_NS) {
+                if (rise - f->end > f->max_low) f->max_low = rise - f->end;
+                continue;
+            }
+            // First edge, or the strip latched: a new frame
+            f = count < max_frames ? &frames[count] : NULL;
+            count++;
+            if (!f) break;
+            memset(f, 0, sizeof(*f));
+            f->start = rise;
+            f->high_min[0] = f->high_min[1] = UINT64_MAX;
+        } else {
+            if (!high) continue;
+            high = 0;
+            if (!f) continue;
+
+            uint64_t width = ev->cycle - rise;
+            uint64_t ns = SIM_CYCLES_TO_NS(width);
+            uint8_t bit = ns >= split;
+            if (width < f->high_min[bit]) f->high_min[bit] = width;
+            if (width > f->high_max[bit]) f->high_max[bit] = width;
+            if (bit ? (ns < one_min || ns > one_max) : (ns < SIM_T0H_MIN_NS || ns > zero_max)) f->bad_high++;
+            if (f->bits < SIM_FRAME_BYTES * 8) f->data[f->bits >> 3] |= bit << (7 - (f->bits & 7));
+            f->bits++;
+            f->end = ev->cycle;
+        }
+    }
+    return count < max_frames ? count : max_frames;
+}
+
+// Decode exactly one frame from a pin, or fail the calling check
+static int sim_decode_one(GPIO_TypeDef* port, uint8_t pin, uint8_t speed, sim_frame_t* frame) {
+    return sim_decode(port, pin, speed, frame, 1) == 1;
+}
+
+// Checks
+static unsigned sim_checks;
+static unsigned sim_failures;
+
+static void sim_check(int ok, const char* what, const char* file, int line) {
+    sim_checks++;
+    if (!ok) {
+        sim_failures++;
+        printf("%s:%d: check failed: %s\n", file, line, what);
+    }
+}
+
+static void sim_check_eq(long long a, long long b, const char* what, const char* file, int line) {
+    sim_checks++;
+    if (a != b) {
+        sim_failures++;
+        printf("%s:%d: check failed: %s (%lld != %lld)\n", file, line, what, a, b);
+    }
+}
+
+static void sim_check_mem(const void* a, const void* b, size_t n, const char* what, const char* file, int line) {
+    sim_checks++;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t x = ((const uint8_t*)a)[i];
+        uint8_t y = ((const uint8_t*)b)[i];
+        if (x != y) {
+            sim_failures++;
+            printf("%s:%d: check failed: %s (byte %zu: 0x%02x != 0x%02x)\n", file, line, what, i, x, y);
+            return;
+        }
+    }
+}
+
+#define SIM_CHECK(cond) sim_check(!!(cond), #cond, __FILE__, __LINE__)
+#define SIM_CHECK_EQ(a, b) sim_check_eq((long long)(a), (long long)(b), #a " == " #b, __FILE__, __LINE__)
+#define SIM_CHECK_MEM(a, b, n) sim_check_mem((a), (b), (n), #a " == " #b, __FILE__, __LINE__)
+
+// Print the result line and return the process exit code
+static int sim_finish(const char* name) {
+    printf("%s: %u checks, %u failed\n", name, sim_checks, sim_failures);
+    free(sim_log);
+    return sim_failures ? 1 : 0;
+}
+
+// Host wall clock in nanoseconds, for the host-side benchmarks
+static uint64_t sim_host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Modelled cost of the libgcc routines the RV32EC core calls for a multiply
+// or divide, having no M extension: the loops of __mulsi3 and __udivsi3 run
+// instruction by instruction, one cycle each and one more for a taken branch,
+// call and return included. Host code that stands in for the chip's C adds
+// these up to compare algorithms by what they would cost on the CH32V003.
+#define SIM_CALL_CYCLES 4
+
+static uint32_t sim_mul_cycles(uint32_t a, uint32_t b) {
+    uint32_t cycles = SIM_CALL_CYCLES + 2;
+    (void)a;
+    do {
+        cycles += 3;          // andi, beqz, then the add or the taken branch
+        cycles += 3 + (b > 1);  // srli, slli, bnez (taken unless done)
+        b >>= 1;
+    } while (b);
+    return cycles;
+}
+
+static uint32_t sim_udiv_cycles(uint32_t n, uint32_t d) {
+    uint32_t cycles = SIM_CALL_CYCLES + 6;
+    uint32_t bit = 1;
+    if (d == 0) return cycles;
+    if (d < n) {
+        // Line the divisor up under the dividend
+        do {
+            cycles += 5;  // blez, slli, slli, bgtu (taken while below)
+            d <<= 1;
+            bit <<= 1;
+        } while (d < n && !(d & 0x80000000u));
+    }
+    cycles++;
+    do {
+        cycles += 1 + (n < d);  // bltu, taken when the divisor does not fit
+        if (n >= d) {
+            n -= d;
+            cycles += 2;        // sub, or
+        }
+        cycles += 4;            // srli, srli, bnez (taken unless done)
+        d >>= 1;
+        bit >>= 1;
+    } while (bit);
+    return cycles;
+}
+
+// __divsi3 tests both signs before handing over to __udivsi3
+static uint32_t sim_div_cycles(int32_t n, int32_t d) {
+    uint32_t un = n < 0 ? -(uint32_t)n : (uint32_t)n, ud = d < 0 ? -(uint32_t)d : (uint32_t)d;
+    return 3 + (n < 0) * 2 + (d < 0) * 2 + sim_udiv_cycles(un, ud);
+}
+
+#endif // WS2812_SIM_H
@@ -0,0 +1,117 @@
+// Pixel arena: freeing a channel slides the later buffers down and points
+// their channels at the moved pixels, reconfiguring a channel reuses its space
+// and refuses a size that does not fit without touching the old buffer, and
+// WS2812_ArenaRemaining() follows every step down to a full arena
+#include "ws2812_sim.h"
+
+static const uint8_t pins[3] = {PC1, PC2, PC4};
+static const uint16_t leds[3] = {5, 7, 10};
+
+static void draw(uint8_t c) {
+    for (uint16_t i = 0; i < ws2812_channels[c].led_count; i++) WS2812_SetPixel(c, i, 0x40 * c + i, 0x80 ^ i, 0x11 * c);
+}
+
+// The channel's pixels, read back from its pin
+static void check_pixels(uint8_t c) {
+    WS2812_Channel_t* ch = &ws2812_channels[c];
+    uint8_t grb[SIM_FRAME_BYTES];
+    sim_frame_t frame;
+
+    for (uint16_t i = 0; i < ch->led_count; i++) {
+        grb[i * 3 + 0] = 0x80 ^ i;
+        grb[i * 3 + 1] = 0x40 * c + i;
+        grb[i * 3 + 2] = 0x11 * c;
+    }
+    WS2812_WaitLatch(ch);
+    sim_log_clear();
+    WS2812_SendChannel(ch);
+    SIM_CHECK(sim_decode_one(GPIOC, pins[c] & 0x0F, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bits, ch->led_count * 24);
+    SIM_CHECK_MEM(frame.data, grb, ch->led_count * 3);
+}
+
+static void test_free(void) {
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK(WS2812_ConfigureChannel(c, pins[c], leds[c], 255));
+        draw(c);
+    }
+    // 5, 7 and 10 LEDs take 16, 24 and 32 bytes, packed in order
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 72);
+    SIM_CHECK(ws2812_channels[0].led_buffer == (void*)ws2812_arena);
+    SIM_CHECK(ws2812_channels[1].led_buffer == (void*)(ws2812_arena + 16));
+    SIM_CHECK(ws2812_channels[2].led_buffer == (void*)(ws2812_arena + 40));
+
+    // Freeing the first moves the other two down, pixels and all
+    WS2812_FreeChannel(0);
+    SIM_CHECK(ws2812_channels[0].led_buffer == NULL);
+    SIM_CHECK(ws2812_channels[1].led_buffer == (void*)ws2812_arena);
+    SIM_CHECK(ws2812_channels[2].led_buffer == (void*)(ws2812_arena + 24));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 56);
+    check_pixels(1);
+    check_pixels(2);
+
+    // A white plane sits after them and moves too
+    SIM_CHECK(WS2812_SetChipProfile(2, WS2812_CHIP_SK6812_RGBW));
+    SIM_CHECK(ws2812_channels[2].white_buffer == (void*)(ws2812_arena + 56));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 68);
+    WS2812_SetWhite(2, 9, 0x5A);
+    WS2812_FreeChannel(1);
+    SIM_CHECK(ws2812_channels[2].led_buffer == (void*)ws2812_arena);
+    SIM_CHECK(ws2812_channels[2].white_buffer == (void*)(ws2812_arena + 32));
+    SIM_CHECK_EQ(ws2812_channels[2].white_buffer[9], 0x5A);
+    SIM_CHECK(WS2812_SetChipProfile(2, WS2812_CHIP_WS2812));
+    SIM_CHECK(ws2812_channels[2].white_buffer == NULL);
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 32);
+    check_pixels(2);
+}
+
+static void test_reconfigure(void) {
+    SIM_CHECK(WS2812_ConfigureChannel(0, pins[0], leds[0], 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, pins[1], leds[1], 255));
+    draw(0);
+    draw(1);
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 72);
+
+    // Channel 2, first in the arena, grows: it moves to the end, the others
+    // slide down, and it starts dark
+    SIM_CHECK(WS2812_ConfigureChannel(2, pins[2], 20, 255));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 100);
+    SIM_CHECK(ws2812_channels[0].led_buffer == (void*)ws2812_arena);
+    SIM_CHECK(ws2812_channels[1].led_buffer == (void*)(ws2812_arena + 16));
+    SIM_CHECK(ws2812_channels[2].led_buffer == (void*)(ws2812_arena + 40));
+    SIM_CHECK_EQ(ws2812_channels[2].led_count, 20);
+    uint8_t zero[60] = {0};
+    SIM_CHECK_MEM(ws2812_channels[2].led_buffer, zero, sizeof(zero));
+    check_pixels(0);
+    check_pixels(1);
+
+    // Exactly filling the arena fits, one LED more does not and leaves the
+    // channel as it was
+    uint16_t fill = (WS2812_ArenaRemaining() + 60) / 3;
+    draw(2);
+    SIM_CHECK(!WS2812_ConfigureChannel(2, pins[2], fill + 1, 255));
+    SIM_CHECK_EQ(ws2812_channels[2].led_count, 20);
+    SIM_CHECK(ws2812_channels[2].led_buffer == (void*)(ws2812_arena + 40));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 100);
+    check_pixels(2);
+
+    SIM_CHECK(WS2812_ConfigureChannel(2, pins[2], fill, 255));
+    SIM_CHECK(WS2812_ArenaRemaining() < 4);
+    SIM_CHECK_EQ(WS2812_GetChannelMemory(2), WS2812_ARENA_ROUND(fill * 3));
+    SIM_CHECK(!WS2812_SetChipProfile(0, WS2812_CHIP_SK6812_RGBW));
+    SIM_CHECK(!WS2812_ConfigureChannel(3, PD4, 1, 255));
+
+    // Shrinking gives the space back
+    SIM_CHECK(WS2812_ConfigureChannel(2, pins[2], 1, 255));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 44);
+    SIM_CHECK(WS2812_ConfigureChannel(3, PD4, 1, 255));
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE - 48);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK_EQ(WS2812_ArenaRemaining(), WS2812_ARENA_SIZE);
+    test_free();
+    test_reconfigure();
+    return sim_finish("arena");
+}
@@ -0,0 +1,192 @@
+// Bulk pixel operations: every LED_Buf* routine against a byte-at-a-time
+// reference, at each pointer alignment and across the word boundaries, with
+// the bytes around the range left untouched
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+#define BUF_PIXELS 48
+#define BUF_GUARD 8
+#define BUF_BYTES (BUF_GUARD + BUF_PIXELS * 3 + BUF_GUARD)
+
+static uint32_t buf_seed = 12345;
+
+static uint8_t buf_random(void) {
+    buf_seed = buf_seed * 1103515245 + 12345;
+    return buf_seed >> 16;
+}
+
+static void buf_randomize(uint8_t* buf, uint32_t bytes) {
+    for (uint32_t i = 0; i < bytes; i++) buf[i] = buf_random();
+}
+
+// The routine's result (got) and the reference (want) start out equal; every
+// op runs on both at the same offset, then the whole buffers are compared
+static uint8_t got[BUF_BYTES] __attribute__((aligned(4)));
+static uint8_t want[BUF_BYTES] __attribute__((aligned(4)));
+static uint8_t src[BUF_BYTES] __attribute__((aligned(4)));
+static uint32_t buf_mismatches;
+
+static void buf_start(void) {
+    buf_randomize(got, BUF_BYTES);
+    memcpy(want, got, BUF_BYTES);
+}
+
+static void buf_compare(void) {
+    if (memcmp(got, want, BUF_BYTES)) buf_mismatches++;
+}
+
+static void ref_fill(uint8_t* dst, uint16_t count, uint8_t red, uint8_t green, uint8_t blue) {
+    for (uint16_t i = 0; i < count; i++) LED_SetRGB(dst + i * 3, red, green, blue);
+}
+
+static void ref_scale(uint8_t* buf, uint16_t count, uint8_t scale) {
+    for (uint32_t i = 0; i < (uint32_t)count * 3; i++) buf[i] = buf[i] * (scale + 1) >> 8;
+}
+
+static void ref_blend(uint8_t* dst, const uint8_t* s, uint16_t count, uint8_t amount) {
+    for (uint32_t i = 0; i < (uint32_t)count * 3; i++) dst[i] = (dst[i] * (255 - amount) + s[i] * (amount + 1)) >> 8;
+}
+
+static void ref_rotate(uint8_t* buf, uint16_t count, uint16_t n) {
+    uint8_t tmp[BUF_PIXELS * 3];
+    for (uint16_t i = 0; i < count; i++) memcpy(tmp + ((i + n) % count) * 3, buf + i * 3, 3);
+    memcpy(buf, tmp, count * 3);
+}
+
+static void ref_shift(uint8_t* buf, uint16_t count, int16_t n) {
+    uint8_t tmp[BUF_PIXELS * 3] = {0};
+    for (int32_t i = 0; i < count; i++) {
+        int32_t to = i + n;
+        if (to >= 0 && to < count) memcpy(tmp + to * 3, buf + i * 3, 3);
+    }
+    memcpy(buf, tmp, count * 3);
+}
+
+static void test_fill_scale(void) {
+    static const uint8_t scales[] = {0, 1, 127, 128, 200, 254, 255};
+
+    for (uint8_t off = 0; off < 4; off++) {
+        for (uint16_t count = 0; count + 2 < BUF_PIXELS; count++) {
+            uint8_t* g = got + BUF_GUARD + off;
+            uint8_t* w = want + BUF_GUARD + off;
+
+            buf_start();
+            LED_BufFill(g, count, 0x12, 0xA5, 0xFE);
+            ref_fill(w, count, 0x12, 0xA5, 0xFE);
+            buf_compare();
+
+            for (uint8_t s = 0; s < sizeof(scales); s++) {
+                buf_start();
+                LED_BufScale(g, count, scales[s]);
+                ref_scale(w, count, scales[s]);
+                buf_compare();
+
+                buf_start();
+                LED_BufFade(g, count, scales[s]);
+                ref_scale(w, count, 255 - scales[s]);
+                buf_compare();
+            }
+        }
+    }
+}
+
+static void test_pattern(void) {
+    uint8_t pattern[7 * 3];
+    buf_randomize(pattern, sizeof(pattern));
+
+    for (uint8_t off = 0; off < 4; off++) {
+        for (uint16_t count = 0; count + 2 < BUF_PIXELS; count++) {
+            for (uint16_t len = 1; len <= 7; len++) {
+                uint8_t* g = got + BUF_GUARD + off;
+                uint8_t* w = want + BUF_GUARD + off;
+
+                buf_start();
+                LED_BufFillPattern(g, count, pattern, len);
+                for (uint16_t i = 0; i < count; i++) memcpy(w + i * 3, pattern + (i % len) * 3, 3);
+                buf_compare();
+
+                // LED_BufRepeat leaves the first period pixels as they are
+                buf_start();
+                LED_BufRepeat(g, count, len);
+                if (len < count) {
+                    for (uint16_t i = len; i < count; i++) memcpy(w + i * 3, w + (i % len) * 3, 3);
+                }
+                buf_compare();
+            }
+        }
+    }
+}
+
+static void test_blend(void) {
+    static const uint8_t amounts[] = {0, 1, 64, 128, 254, 255};
+
+    for (uint8_t off = 0; off < 4; off++) {
+        for (uint8_t src_off = 0; src_off < 4; src_off++) {
+            for (uint16_t count = 0; count + 2 < BUF_PIXELS; count += 3) {
+                for (uint8_t a = 0; a < sizeof(amounts); a++) {
+                    buf_randomize(src, BUF_BYTES);
+                    buf_start();
+                    LED_BufBlend(got + BUF_GUARD + off, src + BUF_GUARD + src_off, count, amounts[a]);
+                    ref_blend(want + BUF_GUARD + off, src + BUF_GUARD + src_off, count, amounts[a]);
+                    buf_compare();
+                }
+            }
+        }
+    }
+}
+
+static void test_move(void) {
+    for (uint8_t off = 0; off < 4; off++) {
+        for (uint16_t count = 0; count + 2 < BUF_PIXELS; count++) {
+            uint8_t* g = got + BUF_GUARD + off;
+            uint8_t* w = want + BUF_GUARD + off;
+
+            // Copies overlapping both ways
+            buf_start();
+            LED_BufCopy(g + 3, g, count);
+            for (int32_t i = count - 1; i >= 0; i--) memcpy(w + 3 + i * 3, w + i * 3, 3);
+            buf_compare();
+
+            buf_start();
+            LED_BufCopy(g, g + 6, count);
+            for (uint16_t i = 0; i < count; i++) memcpy(w + i * 3, w + 6 + i * 3, 3);
+            buf_compare();
+
+            buf_start();
+            LED_BufReverse(g, count);
+            for (uint16_t i = 0; i < count / 2; i++) {
+                uint8_t t[3];
+                memcpy(t, w + i * 3, 3);
+                memcpy(w + i * 3, w + (count - 1 - i) * 3, 3);
+                memcpy(w + (count - 1 - i) * 3, t, 3);
+            }
+            buf_compare();
+
+            for (uint16_t n = 0; n <= 2 * count + 1; n += 1 + count / 5) {
+                buf_start();
+                LED_BufRotate(g, count, n);
+                if (count) ref_rotate(w, count, n);
+                buf_compare();
+
+                for (int8_t sign = -1; sign <= 1; sign += 2) {
+                    buf_start();
+                    LED_BufShift(g, count, sign * n);
+                    ref_shift(w, count, sign * n);
+                    buf_compare();
+                }
+            }
+        }
+    }
+}
+
+int main(void) {
+    test_fill_scale();
+    SIM_CHECK_EQ(buf_mismatches, 0);
+    test_pattern();
+    SIM_CHECK_EQ(buf_mismatches, 0);
+    test_blend();
+    SIM_CHECK_EQ(buf_mismatches, 0);
+    test_move();
+    SIM_CHECK_EQ(buf_mismatches, 0);
+    return sim_finish("buf");
+}
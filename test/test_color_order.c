@@ -0,0 +1,109 @@
+// Colour orders and RGBW: every WS2812_ORDER_* puts red, green and blue in the
+// wire positions its name gives, and an RGBW chip sends white as the 4th byte,
+// from the white plane or with auto-white from the part common to all three
+// colours; alone and as a port group
+#include "ws2812_sim.h"
+
+#define LEDS 4
+
+static const struct {
+    uint8_t order;
+    const char* name;
+} orders[] = {
+    {WS2812_ORDER_GRB, "GRB"}, {WS2812_ORDER_RGB, "RGB"}, {WS2812_ORDER_BRG, "BRG"},
+    {WS2812_ORDER_RBG, "RBG"}, {WS2812_ORDER_GBR, "GBR"}, {WS2812_ORDER_BGR, "BGR"},
+};
+
+static const uint8_t colours[LEDS][3] = {{0x10, 0x20, 0x30}, {0xFF, 0x00, 0x80}, {0x20, 0xFE, 0x7F}, {0xC8, 0x64, 0x32}};
+static const uint8_t whites[LEDS] = {0x00, 0x05, 0xF0, 0x1E};
+
+// Wire bytes of one LED, in the order the name spells
+static void spell(uint8_t* wire, const char* name, uint8_t r, uint8_t g, uint8_t b) {
+    for (uint8_t k = 0; k < 3; k++) wire[k] = name[k] == 'R' ? r : name[k] == 'G' ? g : b;
+}
+
+static void check_pin(uint8_t pin, const uint8_t* wire, uint16_t bytes) {
+    sim_frame_t frame;
+    SIM_CHECK(sim_decode_one(GPIOC, pin, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bits, bytes * 8);
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_MEM(frame.data, wire, bytes);
+}
+
+static void test_orders(void) {
+    uint8_t wire[LEDS * 3];
+
+    for (uint8_t o = 0; o < sizeof(orders) / sizeof(orders[0]); o++) {
+        WS2812_SetColorOrder(0, orders[o].order);
+        for (uint8_t i = 0; i < LEDS; i++) spell(&wire[i * 3], orders[o].name, colours[i][0], colours[i][1], colours[i][2]);
+        WS2812_WaitLatch(&ws2812_channels[0]);
+        sim_log_clear();
+        WS2812_SendChannel(&ws2812_channels[0]);
+        check_pin(4, wire, sizeof(wire));
+    }
+    WS2812_SetColorOrder(0, WS2812_ORDER_GRB);
+}
+
+// RGBW wire bytes: the colours in the channel's order, then white
+static void expect_rgbw(uint8_t* wire, const char* name, uint8_t auto_white) {
+    for (uint8_t i = 0; i < LEDS; i++) {
+        uint8_t r = colours[i][0], g = colours[i][1], b = colours[i][2];
+        uint16_t w = whites[i];
+        if (auto_white) {
+            uint8_t common = r < g ? (r < b ? r : b) : (g < b ? g : b);
+            r -= common;
+            g -= common;
+            b -= common;
+            w = w + common > 255 ? 255 : w + common;
+        }
+        spell(&wire[i * 4], name, r, g, b);
+        wire[i * 4 + 3] = w;
+    }
+}
+
+static void test_rgbw(void) {
+    uint8_t wire[LEDS * 4], wire3[LEDS * 3];
+
+    SIM_CHECK(WS2812_SetChipProfile(0, WS2812_CHIP_SK6812_RGBW));
+    for (uint8_t i = 0; i < LEDS; i++) WS2812_SetWhite(0, i, whites[i]);
+
+    // White plane only
+    expect_rgbw(wire, "GRB", 0);
+    WS2812_WaitLatch(&ws2812_channels[0]);
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[0]);
+    check_pin(4, wire, sizeof(wire));
+
+    // Auto-white, in another order; LED 2 saturates white at 255
+    WS2812_SetAutoWhite(0, 1);
+    WS2812_SetColorOrder(0, WS2812_ORDER_BRG);
+    expect_rgbw(wire, "BRG", 1);
+    SIM_CHECK_EQ(wire[2 * 4 + 3], 255);
+    WS2812_WaitLatch(&ws2812_channels[0]);
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[0]);
+    check_pin(4, wire, sizeof(wire));
+
+    // As a port group with a 3-byte BGR strip
+    WS2812_SetColorOrder(1, WS2812_ORDER_BGR);
+    for (uint8_t i = 0; i < LEDS; i++) spell(&wire3[i * 3], "BGR", colours[i][0], colours[i][1], colours[i][2]);
+    WS2812_WaitLatch(&ws2812_channels[0]);
+    WS2812_WaitLatch(&ws2812_channels[1]);
+    sim_log_clear();
+    WS2812_Commit();
+    check_pin(4, wire, sizeof(wire));
+    check_pin(2, wire3, sizeof(wire3));
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, LEDS, 255));
+    for (uint8_t i = 0; i < LEDS; i++) {
+        WS2812_SetPixel(0, i, colours[i][0], colours[i][1], colours[i][2]);
+        WS2812_SetPixel(1, i, colours[i][0], colours[i][1], colours[i][2]);
+    }
+    test_orders();
+    test_rgbw();
+    return sim_finish("color_order");
+}
@@ -0,0 +1,134 @@
+// HSV kernel: LED_HSV16ToRGB() against a floating-point HSV reference, and
+// the segment rainbows against the kernel called pixel by pixel
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+// Largest error of the fixed-point kernel on any channel: the ramp is hue * 6
+// truncated to 8 bits, and saturation and value scale by (n + 1) >> 8
+#define HSV_MAX_ERROR 3
+
+static void hsv_reference(uint16_t hue, uint8_t sat, uint8_t val, double rgb[3]) {
+    double h = hue * 6.0 / 65536.0;
+    double f = h - (int)h;
+    double v = val, s = sat / 255.0;
+    double p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+
+    switch ((int)h) {
+        case 0:  rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+        case 1:  rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+        case 2:  rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+        case 3:  rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+        case 4:  rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+        default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+    }
+}
+
+static void test_kernel(void) {
+    static const uint8_t levels[] = {255, 254, 200, 128, 1, 0};
+    double worst = 0;
+
+    for (uint8_t s = 0; s < sizeof(levels); s++) {
+        for (uint8_t v = 0; v < sizeof(levels); v++) {
+            for (uint32_t hue = 0; hue < 65536; hue += 7) {
+                uint8_t rgb[3];
+                double ref[3];
+                LED_HSV16ToRGB(hue, levels[s], levels[v], rgb);
+                hsv_reference(hue, levels[s], levels[v], ref);
+                for (uint8_t c = 0; c < 3; c++) {
+                    double err = rgb[c] > ref[c] ? rgb[c] - ref[c] : ref[c] - rgb[c];
+                    if (err > worst) worst = err;
+                }
+            }
+        }
+    }
+    printf("hsv: largest error against the reference %.2f\n", worst);
+    SIM_CHECK(worst <= HSV_MAX_ERROR);
+
+    // The primaries are exact, and a full turn is continuous
+    uint8_t rgb[3], prev[3];
+    LED_HSV16ToRGB(0, 255, 255, rgb);
+    SIM_CHECK(rgb[0] == 255 && rgb[1] == 0 && rgb[2] == 0);
+    LED_HSV16ToRGB(21845, 255, 255, rgb);
+    SIM_CHECK(rgb[0] == 0 && rgb[1] == 255 && rgb[2] == 0);
+    LED_HSV16ToRGB(43690, 255, 255, rgb);
+    SIM_CHECK(rgb[0] == 0 && rgb[1] == 0 && rgb[2] == 255);
+
+    uint32_t jumps = 0;
+    LED_HSV16ToRGB(65535, 255, 255, prev);
+    for (uint32_t hue = 0; hue < 65536; hue++) {
+        LED_HSV16ToRGB(hue, 255, 255, rgb);
+        for (uint8_t c = 0; c < 3; c++) {
+            if (rgb[c] - prev[c] > 1 || prev[c] - rgb[c] > 1) jumps++;
+        }
+        memcpy(prev, rgb, 3);
+    }
+    SIM_CHECK_EQ(jumps, 0);
+}
+
+// Segment pixel as R, G, B
+static void segment_rgb(uint8_t seg_idx, uint16_t position, uint8_t rgb[3]) {
+    const uint8_t* px = LED_SegmentPixel(LED_GetSegment(seg_idx), position);
+    rgb[0] = px[WS2812_R];
+    rgb[1] = px[WS2812_G];
+    rgb[2] = px[WS2812_B];
+}
+
+static void test_rainbows(void) {
+    const uint16_t leds = 40;
+    uint32_t mismatches = 0;
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, leds, 255));
+
+    // Two spans, the second one backwards, with the hue wrapping past 65535
+    SIM_CHECK(LED_SegmentInit(4));
+    SIM_CHECK(LED_SegmentAddSpan(4, 0, 5, 20, 0));
+    SIM_CHECK(LED_SegmentAddSpan(4, 1, 0, 30, 1));
+    LED_FillRainbow(4, 60000, 1000);
+    for (uint16_t i = 0; i < 50; i++) {
+        uint8_t got[3], want[3];
+        segment_rgb(4, i, got);
+        LED_HSV16ToRGB((uint16_t)(60000 + i * 1000), 255, 255, want);
+        if (memcmp(got, want, 3)) mismatches++;
+    }
+    SIM_CHECK_EQ(mismatches, 0);
+    SIM_CHECK(ws2812_channels[0].dirty && ws2812_channels[1].dirty);
+
+    // LED_EFFECT_RAINBOWS repeats every params.width LEDs
+    LED_SegmentReset(0);
+    LED_SetEffect(0, &LED_EFFECT_RAINBOWS, LED_PARAMS(0, 0, 0, 10, 16));
+    LED_RunSlot(0, get_animation_ticks());
+    mismatches = 0;
+    for (uint16_t i = 0; i + 16 < leds; i++) {
+        uint8_t a[3], b[3];
+        segment_rgb(0, i, a);
+        segment_rgb(0, i + 16, b);
+        if (memcmp(a, b, 3)) mismatches++;
+    }
+    SIM_CHECK_EQ(mismatches, 0);
+
+    // The rainbow starts on a whole step of the animation, and neighbours
+    // are a sixteenth of a turn apart
+    uint8_t first[3], second[3], want[3];
+    uint32_t start = 65536;
+    segment_rgb(0, 0, first);
+    segment_rgb(0, 1, second);
+    for (uint32_t hue = 0; hue < 65536 && start == 65536; hue += 256) {
+        LED_HSV16ToRGB(hue, 255, 255, want);
+        if (!memcmp(first, want, 3)) start = hue;
+    }
+    SIM_CHECK(start < 65536);
+    LED_HSV16ToRGB((uint16_t)(start + 4096), 255, 255, want);
+    SIM_CHECK_MEM(second, want, 3);
+    LED_StopEffect(0);
+
+    WS2812_FreeChannel(0);
+    WS2812_FreeChannel(1);
+}
+
+int main(void) {
+    test_kernel();
+    test_rainbows();
+    return sim_finish("hsv");
+}
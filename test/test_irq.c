@@ -0,0 +1,111 @@
+// Interrupt windows: an ISR that holds the line low for longer than
+// WS2812_IRQ_GAP_MAX_US restarts the frame, which then goes out whole, on one
+// pin and on a port group; a shorter one leaves the frame and the gap legal
+#include "debug.h"
+
+// The ISR runs for isr_cycles when interrupts are let in for the isr_at'th
+// time (0 = never, UINT32_MAX = every time)
+static uint32_t isr_at, isr_cycles, windows;
+
+static void isr_enable(void) {
+    __enable_irq();
+    windows++;
+    if (isr_at == UINT32_MAX || windows == isr_at) sim_cycles += isr_cycles;
+}
+
+#define WS2812_IRQ_ENABLE() isr_enable()
+#include "ws2812_sim.h"
+
+#define LEDS 12
+
+static const uint8_t pins[3] = {PC1, PC2, PC4};
+static uint8_t expected[3][LEDS * 3];
+
+static void inject(uint32_t at, uint32_t ticks) {
+    isr_at = at;
+    isr_cycles = ticks * 8;
+    windows = 0;
+    ws2812_irq_stats.restarts = 0;
+    sim_log_clear();
+}
+
+// Frames on a pin: the last one must be the whole frame
+static int check_pin(uint8_t c, uint32_t* max_low_ns) {
+    static sim_frame_t frames[8];
+    int n = sim_decode(GPIOC, pins[c] & 0x0F, WS2812_SPEED_800K, frames, 8);
+    SIM_CHECK(n >= 1);
+    if (n < 1) return 0;
+    SIM_CHECK_EQ(frames[n - 1].bits, LEDS * 24);
+    SIM_CHECK_EQ(frames[n - 1].bad_high, 0);
+    SIM_CHECK_MEM(frames[n - 1].data, expected[c], LEDS * 3);
+    *max_low_ns = SIM_CYCLES_TO_NS(frames[n - 1].max_low);
+    // Cut short before the restart
+    if (n > 1) SIM_CHECK(frames[0].bits < LEDS * 24);
+    return n;
+}
+
+static void test_one_pin(void) {
+    uint32_t gap = WS2812_US_TO_TICKS(WS2812_IRQ_GAP_MAX_US), low;
+
+    // Just inside the limit: sent once, and the line never low past TL_MAX
+    inject(2, gap - 2);
+    WS2812_SendChannel(&ws2812_channels[0]);
+    SIM_CHECK_EQ(check_pin(0, &low), 1);
+    SIM_CHECK(low < WS2812_TL_MAX_NS);
+    SIM_CHECK(low > WS2812_CYCLES_TO_NS((gap - 2) * 8));
+    SIM_CHECK_EQ(ws2812_irq_stats.restarts, 0);
+
+    // Over it, part way through: cut off, restarted, sent whole
+    inject(2, gap + 1);
+    WS2812_SendChannel(&ws2812_channels[0]);
+    SIM_CHECK_EQ(check_pin(0, &low), 2);
+    SIM_CHECK(low < WS2812_TL_MAX_NS);
+    SIM_CHECK_EQ(ws2812_irq_stats.restarts, 1);
+
+    // In every window: WS2812_MAX_RESTARTS tries, then the frame is sent whatever the gaps
+    inject(UINT32_MAX, gap + 1);
+    WS2812_SendChannel(&ws2812_channels[0]);
+    SIM_CHECK_EQ(check_pin(0, &low), WS2812_MAX_RESTARTS + 1);
+    SIM_CHECK_EQ(ws2812_irq_stats.restarts, WS2812_MAX_RESTARTS);
+    inject(0, 0);
+}
+
+static void test_group(void) {
+    uint32_t gap = WS2812_US_TO_TICKS(WS2812_IRQ_GAP_MAX_US), low;
+
+    for (uint8_t c = 0; c < 3; c++) WS2812_WaitLatch(&ws2812_channels[c]);
+    inject(3, gap + 1);
+    WS2812_SendParallel(0x07);
+    SIM_CHECK_EQ(ws2812_irq_stats.restarts, 1);
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK_EQ(check_pin(c, &low), 2);
+        SIM_CHECK(low < WS2812_TL_MAX_NS);
+    }
+
+    for (uint8_t c = 0; c < 3; c++) WS2812_WaitLatch(&ws2812_channels[c]);
+    inject(3, gap - 2);
+    WS2812_SendParallel(0x07);
+    SIM_CHECK_EQ(ws2812_irq_stats.restarts, 0);
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK_EQ(check_pin(c, &low), 1);
+        SIM_CHECK(low < WS2812_TL_MAX_NS);
+    }
+    inject(0, 0);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK(WS2812_ConfigureChannel(c, pins[c], LEDS, 255));
+        for (uint16_t i = 0; i < LEDS; i++) {
+            uint8_t r = 0x21 * c + i, g = 0xFF - i, b = 0x55 ^ (i << c);
+            WS2812_SetPixel(c, i, r, g, b);
+            expected[c][i * 3 + 0] = g;
+            expected[c][i * 3 + 1] = r;
+            expected[c][i * 3 + 2] = b;
+        }
+    }
+    test_one_pin();
+    test_group();
+    return sim_finish("irq");
+}
@@ -0,0 +1,118 @@
+// Matrix mapping: logical (x, y) to the LED index along the segment for the
+// formula, table and generic paths, and matrices too big for a 16-bit table
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+#include <LED_Matrix.h>
+
+// Compare every logical pixel with a row-by-row table of expected indices
+static void expect_map(uint8_t width, uint8_t height, const uint16_t* expected) {
+    LED_Matrix_t* m = LED_GetMatrix(0);
+    SIM_CHECK(m != NULL);
+    if (!m) return;
+    SIM_CHECK_EQ(m->width, width);
+    SIM_CHECK_EQ(m->height, height);
+    for (uint8_t y = 0; y < height; y++) {
+        for (uint8_t x = 0; x < width; x++) {
+            SIM_CHECK_EQ(LED_MatrixXY(0, x, y), expected[y * width + x]);
+        }
+    }
+    SIM_CHECK_EQ(LED_MatrixXY(0, width, 0), 0xFFFF);
+    SIM_CHECK_EQ(LED_MatrixXY(0, 0, height), 0xFFFF);
+}
+
+static void test_hand_checked(void) {
+    // Single tile, formula paths
+    static const uint16_t progressive[4 * 3] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    SIM_CHECK(LED_MatrixConfigure(0, 4, 3, 1, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_0));
+    SIM_CHECK(LED_GetMatrix(0)->xy == LED_MatrixXY_Progressive);
+    expect_map(4, 3, progressive);
+
+    static const uint16_t serpentine[4 * 3] = {0, 1, 2, 3, 7, 6, 5, 4, 8, 9, 10, 11};
+    SIM_CHECK(LED_MatrixConfigure(0, 4, 3, 1, 1, LED_MATRIX_SERPENTINE, LED_MATRIX_ROTATE_0));
+    SIM_CHECK(LED_GetMatrix(0)->xy == LED_MatrixXY_Serpentine);
+    expect_map(4, 3, serpentine);
+
+    // Columns, down then up
+    static const uint16_t columns[3 * 2] = {0, 3, 4, 1, 2, 5};
+    SIM_CHECK(LED_MatrixConfigure(0, 3, 2, 1, 1, LED_MATRIX_COLUMNS | LED_MATRIX_SERPENTINE, LED_MATRIX_ROTATE_0));
+    SIM_CHECK(LED_GetMatrix(0)->xy == LED_MatrixXY_Table);
+    expect_map(3, 2, columns);
+
+    // 2 x 2 tiles of 2 x 2, the second row of tiles right to left
+    static const uint16_t tiles[4 * 4] = {0, 1, 4, 5, 2, 3, 6, 7, 12, 13, 8, 9, 14, 15, 10, 11};
+    SIM_CHECK(LED_MatrixConfigure(0, 2, 2, 2, 2, LED_MATRIX_TILE_SERPENTINE, LED_MATRIX_ROTATE_0));
+    expect_map(4, 4, tiles);
+
+    // A 3 x 2 panel turned clockwise: its first LED ends up top right
+    static const uint16_t rotate_90[2 * 3] = {3, 0, 4, 1, 5, 2};
+    SIM_CHECK(LED_MatrixConfigure(0, 3, 2, 1, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_90));
+    expect_map(2, 3, rotate_90);
+
+    static const uint16_t rotate_180[3 * 2] = {5, 4, 3, 2, 1, 0};
+    SIM_CHECK(LED_MatrixConfigure(0, 3, 2, 1, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_180));
+    expect_map(3, 2, rotate_180);
+
+    static const uint16_t rotate_270[2 * 3] = {2, 5, 1, 4, 0, 3};
+    SIM_CHECK(LED_MatrixConfigure(0, 3, 2, 1, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_270));
+    expect_map(2, 3, rotate_270);
+}
+
+// Every layout and rotation maps onto each LED exactly once, and the fast
+// paths agree with the generic mapping
+static void test_all_layouts(void) {
+    const uint8_t pw = 3, ph = 2, tx = 2, ty = 3;
+    const uint16_t count = pw * ph * tx * ty;
+
+    for (uint8_t layout = 0; layout < 8; layout++) {
+        for (uint8_t rotation = 0; rotation <= LED_MATRIX_ROTATE_270; rotation++) {
+            for (uint8_t tiled = 0; tiled < 2; tiled++) {
+                uint8_t seen[3 * 2 * 2 * 3] = {0};
+                uint16_t bad = 0;
+                SIM_CHECK(LED_MatrixConfigure(0, pw, ph, tiled ? tx : 1, tiled ? ty : 1, layout, rotation));
+                LED_Matrix_t* m = LED_GetMatrix(0);
+                uint16_t leds = tiled ? count : pw * ph;
+
+                for (uint8_t y = 0; y < m->height; y++) {
+                    for (uint8_t x = 0; x < m->width; x++) {
+                        uint16_t i = LED_MatrixXY(0, x, y);
+                        if (i >= leds || seen[i]++ || i != LED_MatrixXY_Generic(m, x, y)) bad++;
+                    }
+                }
+                SIM_CHECK_EQ(bad, 0);
+            }
+        }
+    }
+}
+
+static void test_oversize(void) {
+    LED_MatrixRemove(0);
+    uint16_t arena_used = ws2812_arena_used;
+
+    // Wider than a uint8_t coordinate
+    SIM_CHECK(!LED_MatrixConfigure(0, 16, 16, 16, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_0));
+    SIM_CHECK(!LED_MatrixConfigure(0, 1, 200, 1, 2, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_90));
+
+    // 255 x 129 LEDs: the table would be 65790 bytes, which wraps to 254 in a
+    // 16-bit size and would fit the arena. It must use the generic mapping.
+    SIM_CHECK(LED_MatrixConfigure(0, 255, 129, 1, 1, LED_MATRIX_COLUMNS | LED_MATRIX_SERPENTINE, LED_MATRIX_ROTATE_0));
+    LED_Matrix_t* m = LED_GetMatrix(0);
+    SIM_CHECK(m->map == NULL);
+    SIM_CHECK(m->xy == LED_MatrixXY_Generic);
+    SIM_CHECK_EQ(ws2812_arena_used, arena_used);
+    SIM_CHECK_EQ(LED_MatrixXY(0, 254, 128), 254u * 129 + 128);
+    SIM_CHECK_EQ(LED_MatrixXY(0, 253, 0), 253u * 129 + 128);
+
+    // A table that fits still goes in the arena, and comes back out on remove
+    SIM_CHECK(LED_MatrixConfigure(0, 4, 4, 2, 1, LED_MATRIX_PROGRESSIVE, LED_MATRIX_ROTATE_0));
+    SIM_CHECK(LED_GetMatrix(0)->map != NULL);
+    SIM_CHECK_EQ(ws2812_arena_used, arena_used + 4 * 4 * 2 * 2);
+    LED_MatrixRemove(0);
+    SIM_CHECK_EQ(ws2812_arena_used, arena_used);
+}
+
+int main(void) {
+    test_hand_checked();
+    test_all_layouts();
+    test_oversize();
+    return sim_finish("matrix");
+}
@@ -0,0 +1,99 @@
+// Palette channels: PAL4 strips of odd length, whose last byte holds one LED,
+// and PAL8 with the palette rotated by an offset, decoded from the pins and
+// compared with the palette colours, sent alone and as a port group
+#include "ws2812_sim.h"
+
+#define PAL4_LEDS 7
+#define PAL8_LEDS 9
+
+static const uint8_t pal16[16][3] = {
+    WS2812_RGB(0x00, 0x00, 0x00), WS2812_RGB(0xFF, 0x00, 0x00), WS2812_RGB(0x00, 0xFF, 0x00), WS2812_RGB(0x00, 0x00, 0xFF),
+    WS2812_RGB(0x11, 0x22, 0x33), WS2812_RGB(0x44, 0x55, 0x66), WS2812_RGB(0x77, 0x88, 0x99), WS2812_RGB(0xAA, 0xBB, 0xCC),
+    WS2812_RGB(0x01, 0x02, 0x04), WS2812_RGB(0x08, 0x10, 0x20), WS2812_RGB(0x40, 0x80, 0xC0), WS2812_RGB(0xDE, 0xAD, 0x01),
+    WS2812_RGB(0x5A, 0xA5, 0x0F), WS2812_RGB(0xF0, 0x0F, 0x3C), WS2812_RGB(0x12, 0x34, 0x56), WS2812_RGB(0xFE, 0xDC, 0xBA),
+};
+static uint8_t pal256[256][3];
+
+// Wire bytes (G R B) of palette entries for the given indices
+static void expect(uint8_t* grb, const uint8_t (*palette)[3], uint8_t mask, const uint8_t* indices, uint16_t leds, uint8_t offset) {
+    for (uint16_t i = 0; i < leds; i++) {
+        const uint8_t* c = palette[(uint8_t)(indices[i] + offset) & mask];
+        grb[i * 3 + 0] = c[WS2812_G];
+        grb[i * 3 + 1] = c[WS2812_R];
+        grb[i * 3 + 2] = c[WS2812_B];
+    }
+}
+
+static void check_pin(uint8_t pin, const uint8_t* grb, uint16_t leds) {
+    sim_frame_t frame;
+    SIM_CHECK(sim_decode_one(GPIOC, pin, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bits, leds * 24);
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_MEM(frame.data, grb, leds * 3);
+    SIM_CHECK(SIM_CYCLES_TO_NS(frame.max_low) < WS2812_TL_MAX_NS);
+}
+
+int main(void) {
+    uint8_t idx4[PAL4_LEDS], idx8[PAL8_LEDS];
+    uint8_t grb4[PAL4_LEDS * 3], grb8[PAL8_LEDS * 3];
+
+    for (uint16_t e = 0; e < 256; e++) {
+        pal256[e][WS2812_R] = e;
+        pal256[e][WS2812_G] = 255 - e;
+        pal256[e][WS2812_B] = e * 7;
+    }
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, PAL4_LEDS, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, PAL8_LEDS, 255));
+    SIM_CHECK(WS2812_SetPaletteMode(0, WS2812_FORMAT_PAL4, pal16, 16));
+    SIM_CHECK(WS2812_SetPaletteMode(1, WS2812_FORMAT_PAL8, pal256, 256));
+    SIM_CHECK_EQ(WS2812_PixelBytes(PAL4_LEDS, WS2812_FORMAT_PAL4), (PAL4_LEDS + 1) / 2);
+
+    // PAL4: every LED a different index, then a fill from an odd LED to the
+    // odd last one; the unused high nibble of the last byte is never sent
+    for (uint8_t i = 0; i < PAL4_LEDS; i++) {
+        idx4[i] = 15 - 2 * i;
+        WS2812_SetPixelIndex(0, i, idx4[i]);
+    }
+    ((uint8_t*)ws2812_channels[0].led_buffer)[PAL4_LEDS / 2] |= 0xF0;
+    for (uint8_t i = 0; i < PAL8_LEDS; i++) {
+        idx8[i] = 37 * i + 250;
+        WS2812_SetPixelIndex(1, i, idx8[i]);
+    }
+
+    // Alone, then with the offset wrapping past the end of each palette
+    expect(grb4, pal16, 15, idx4, PAL4_LEDS, 0);
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[0]);
+    check_pin(4, grb4, PAL4_LEDS);
+
+    WS2812_SetPaletteOffset(0, 3);
+    WS2812_SetPaletteOffset(1, 200);
+    expect(grb4, pal16, 15, idx4, PAL4_LEDS, 3);
+    expect(grb8, pal256, 255, idx8, PAL8_LEDS, 200);
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[1]);
+    check_pin(2, grb8, PAL8_LEDS);
+
+    // As a port group, with the strips of different lengths
+    WS2812_WaitLatch(&ws2812_channels[0]);
+    WS2812_WaitLatch(&ws2812_channels[1]);
+    sim_log_clear();
+    WS2812_Commit();
+    check_pin(4, grb4, PAL4_LEDS);
+    check_pin(2, grb8, PAL8_LEDS);
+
+    WS2812_FillIndex(0, 3, PAL4_LEDS, 9);
+    for (uint8_t i = 3; i < PAL4_LEDS; i++) idx4[i] = 9;
+    SIM_CHECK_EQ(WS2812_GetPixelIndex(0, 2), idx4[2]);
+    SIM_CHECK_EQ(WS2812_GetPixelIndex(0, PAL4_LEDS - 1), 9);
+    // A smaller palette masks the index: 8 entries after the offset of 3
+    SIM_CHECK(WS2812_SetPalette(0, pal16, 8));
+    expect(grb4, pal16, 7, idx4, PAL4_LEDS, 3);
+    sim_log_clear();
+    WS2812_Commit();
+    check_pin(4, grb4, PAL4_LEDS);
+
+    return sim_finish("palette");
+}
@@ -0,0 +1,136 @@
+// Parallel sender: channels sharing a port go out together, each pin
+// carrying its own strip, with shorter strips held low after their end, and
+// WS2812_Commit() sends the dirty channels only
+#include "ws2812_sim.h"
+
+static const uint8_t pins[3] = {PC1, PC2, PC4};
+static const uint16_t lengths[3] = {5, 8, 3};
+
+// Port writes recorded when the generator was asked for each LED
+static uint32_t fetched_at[8];
+
+static void record_fetch(void* state, uint16_t i, uint8_t pixel[3]) {
+    (void)state;
+    fetched_at[i] = sim_log_len;
+    pixel[0] = pixel[1] = pixel[2] = i;
+}
+
+static void expect_pin(uint8_t pin, uint8_t speed, const uint8_t* expected, uint32_t bytes) {
+    sim_frame_t frame;
+    SIM_CHECK(sim_decode_one(GPIOC, pin, speed, &frame));
+    SIM_CHECK_EQ(frame.bits, bytes * 8);
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_MEM(frame.data, expected, bytes);
+    // No long low stretch between LEDs: the next one is prepared while this one is sent
+    SIM_CHECK(SIM_CYCLES_TO_NS(frame.max_low) < WS2812_TL_MAX_NS);
+}
+
+int main(void) {
+    uint8_t expected[3][8 * 4];
+
+    WS2812_TimeInit();
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK(WS2812_ConfigureChannel(c, pins[c], lengths[c], 255));
+        for (uint16_t i = 0; i < lengths[c]; i++) {
+            uint8_t r = 0x11 * (c + 1) + i, g = 0x80 >> i, b = 0xF0 ^ (c << 2) ^ i;
+            WS2812_SetPixel(c, i, r, g, b);
+            expected[c][i * 3 + 0] = g;
+            expected[c][i * 3 + 1] = r;
+            expected[c][i * 3 + 2] = b;
+        }
+    }
+
+    // 800kHz, three strips of different lengths in one pass
+    for (uint8_t c = 0; c < 3; c++) WS2812_WaitLatch(&ws2812_channels[c]);
+    sim_log_clear();
+    uint64_t start = sim_cycles;
+    WS2812_SendParallel(0x07);
+    uint64_t parallel = sim_cycles - start;
+    for (uint8_t c = 0; c < 3; c++) {
+        expect_pin(pins[c] & 0x0F, WS2812_SPEED_800K, expected[c], lengths[c] * 3);
+    }
+    // The group takes the time of its longest strip; its bits are longer by
+    // the T0H..T1H step where the 0-bit pins drop, and the low phases by the
+    // slices of next-LED work: a fetch and three transposes per channel, for
+    // every position and the one after the last
+    SIM_CHECK(parallel < 8 * 24 * (WS2812_BIT_CYCLES + WS2812_T1H_CYCLES) + 9 * 3 * 4 * WS2812_GROUP_STEP_CYCLES);
+    SIM_CHECK_EQ(ws2812_channels[0].tx_end, ws2812_channels[1].tx_end);
+
+    // Commit sends the dirty channels only: all three after configuring, then
+    // the one redrawn, then none
+    const WS2812_CommitStats_t* st = &ws2812_commit_stats;
+    sim_frame_t frame;
+    for (uint8_t c = 0; c < 3; c++) WS2812_WaitLatch(&ws2812_channels[c]);
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(st->sent, 3);
+    SIM_CHECK_EQ(st->skipped, 0);
+    for (uint8_t c = 0; c < 3; c++) {
+        expect_pin(pins[c] & 0x0F, WS2812_SPEED_800K, expected[c], lengths[c] * 3);
+    }
+
+    WS2812_SetPixel(1, 3, 0x01, 0x02, 0x03);
+    expected[1][9] = 0x02;
+    expected[1][10] = 0x01;
+    expected[1][11] = 0x03;
+    WS2812_WaitLatch(&ws2812_channels[1]);
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(st->sent, 4);
+    SIM_CHECK_EQ(st->skipped, 2);
+    expect_pin(pins[1] & 0x0F, WS2812_SPEED_800K, expected[1], lengths[1] * 3);
+    SIM_CHECK_EQ(sim_decode(GPIOC, pins[0] & 0x0F, WS2812_SPEED_800K, &frame, 1), 0);
+    SIM_CHECK_EQ(sim_decode(GPIOC, pins[2] & 0x0F, WS2812_SPEED_800K, &frame, 1), 0);
+
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(sim_log_len, 0);
+    SIM_CHECK_EQ(st->sent, 4);
+    SIM_CHECK_EQ(st->skipped, 5);
+
+    // WS2811 at 400kHz, RGB order
+    for (uint8_t c = 0; c < 3; c++) {
+        SIM_CHECK(WS2812_SetChipProfile(c, WS2812_CHIP_WS2811));
+        for (uint16_t i = 0; i < lengths[c]; i++) {
+            uint8_t t = expected[c][i * 3];
+            expected[c][i * 3] = expected[c][i * 3 + 1];
+            expected[c][i * 3 + 1] = t;
+        }
+    }
+    sim_log_clear();
+    WS2812_SendParallel(0x07);
+    for (uint8_t c = 0; c < 3; c++) {
+        expect_pin(pins[c] & 0x0F, WS2812_SPEED_400K, expected[c], lengths[c] * 3);
+    }
+
+    // RGBW: four wire bytes per LED
+    for (uint8_t c = 0; c < 2; c++) {
+        SIM_CHECK(WS2812_SetChipProfile(c, WS2812_CHIP_SK6812_RGBW));
+        for (uint16_t i = 0; i < lengths[c]; i++) {
+            WS2812_SetPixel(c, i, i, 2 * i, 3 * i);
+            WS2812_SetWhite(c, i, 0xA0 + i);
+            expected[c][i * 4 + 0] = 2 * i;
+            expected[c][i * 4 + 1] = i;
+            expected[c][i * 4 + 2] = 3 * i;
+            expected[c][i * 4 + 3] = 0xA0 + i;
+        }
+    }
+    sim_log_clear();
+    WS2812_SendParallel(0x03);
+    for (uint8_t c = 0; c < 2; c++) {
+        expect_pin(pins[c] & 0x0F, WS2812_SPEED_800K, expected[c], lengths[c] * 4);
+    }
+
+    // LED n+1 is fetched while LED n is on the wire: every bit of a group is
+    // three writes, so the fetch falls inside the previous LED's 72 writes
+    for (uint8_t c = 0; c < 3; c++) SIM_CHECK(WS2812_SetChipProfile(c, WS2812_CHIP_WS2812));
+    SIM_CHECK(WS2812_SetShader(1, 8, record_fetch, NULL));
+    sim_log_clear();
+    WS2812_SendParallel(0x07);
+    SIM_CHECK_EQ(fetched_at[0], 0);
+    for (uint8_t i = 1; i < 8; i++) {
+        SIM_CHECK(fetched_at[i] > (i - 1) * 72u && fetched_at[i] < i * 72u);
+    }
+
+    return sim_finish("parallel");
+}
@@ -0,0 +1,293 @@
+// Animation playback: decoded frames against the frames they were built from,
+// in full colour and palette form, looping, data cut short at every length,
+// palette indices past the palette, the encoder's own output, and the decode
+// cost of a delta frame against a key frame
+#define WS2812_STATS 1
+#include "ws2812_sim.h"
+#include <LED_Playback.h>
+// Written by the Makefile with anim_frames.py and tools/ws2812_anim_encode.py
+#include "anim_frames.h"
+#include "anim_rgb.h"
+#include "anim_palette.h"
+
+#define LEDS 70
+#define FRAMES 3
+// Fills the bytes after the data: ends a frame early if read as an op, and
+// shows up in the LEDs if read as a colour
+#define GUARD LED_ANIM_END
+
+static uint8_t anim[512];
+static uint16_t anim_len;
+static uint8_t expected[FRAMES][LEDS][3];
+
+static void put(uint8_t byte) {
+    anim[anim_len++] = byte;
+}
+
+// A value: R G B, or the index of the colour in the palette
+static void put_value(const uint8_t* palette, uint8_t entries, uint8_t r, uint8_t g, uint8_t b) {
+    if (!palette) {
+        put(r);
+        put(g);
+        put(b);
+        return;
+    }
+    for (uint8_t e = 0; e < entries; e++) {
+        if (palette[e * 3] == r && palette[e * 3 + 1] == g && palette[e * 3 + 2] == b) put(e);
+    }
+}
+
+// Three frames over 70 LEDs, using every op: a key frame of a literal and
+// two runs, a delta after a long skip, and a delta after a short skip
+static void build(uint8_t with_palette) {
+    static const uint8_t colours[6][3] = {
+        {0x10, 0x20, 0x30}, {0x01, 0x02, 0x03}, {0xFF, 0x00, 0x80},
+        {0x00, 0xFF, 0x00}, {0x7E, 0x11, 0xC3}, {0x05, 0x50, 0xA0},
+    };
+    const uint8_t* palette = with_palette ? colours[0] : NULL;
+    const uint8_t* c;
+
+    anim_len = 0;
+    put('W'); put('A'); put(LED_ANIM_VERSION); put(with_palette ? LED_ANIM_FLAG_PALETTE : 0);
+    put(0); put(LEDS); put(0); put(FRAMES); put(0); put(40);
+    if (with_palette) {
+        put(6 - 1);
+        for (uint8_t e = 0; e < 6; e++) { put(colours[e][0]); put(colours[e][1]); put(colours[e][2]); }
+    }
+
+    // Key: LEDs 0-3 literal, 4-67 one run of 64, 68-69 a run of 2
+    put(LED_ANIM_KEY);
+    put(0x80 | (4 - 1));
+    for (uint8_t i = 0; i < 4; i++) {
+        c = colours[i];
+        put_value(palette, 6, c[0], c[1], c[2]);
+        memcpy(expected[0][i], c, 3);
+    }
+    put(0x40 | (64 - 1));
+    c = colours[4];
+    put_value(palette, 6, c[0], c[1], c[2]);
+    for (uint8_t i = 4; i < 68; i++) memcpy(expected[0][i], c, 3);
+    put(0x40 | (2 - 1));
+    c = colours[5];
+    put_value(palette, 6, c[0], c[1], c[2]);
+    for (uint8_t i = 68; i < 70; i++) memcpy(expected[0][i], c, 3);
+    put(LED_ANIM_END);
+
+    // Delta: skip 64, LEDs 64-65 literal
+    memcpy(expected[1], expected[0], sizeof(expected[0]));
+    put(LED_ANIM_DELTA);
+    put(LED_ANIM_END | 1);
+    put(0x80 | (2 - 1));
+    for (uint8_t i = 0; i < 2; i++) {
+        c = colours[i + 2];
+        put_value(palette, 6, c[0], c[1], c[2]);
+        memcpy(expected[1][64 + i], c, 3);
+    }
+    put(LED_ANIM_END);
+
+    // Delta: skip 2, LEDs 2-4 one run
+    memcpy(expected[2], expected[1], sizeof(expected[1]));
+    put(LED_ANIM_DELTA);
+    put(0x00 | (2 - 1));
+    put(0x40 | (3 - 1));
+    c = colours[1];
+    put_value(palette, 6, c[0], c[1], c[2]);
+    for (uint8_t i = 2; i < 5; i++) memcpy(expected[2][i], c, 3);
+    put(LED_ANIM_END);
+
+    memset(anim + anim_len, GUARD, sizeof(anim) - anim_len);
+}
+
+// 1 if channel 0 shows frame f
+static int shows(uint8_t f) {
+    for (uint8_t i = 0; i < LEDS; i++) {
+        const uint8_t* px = ws2812_channels[0].led_buffer[i];
+        if (px[WS2812_R] != expected[f][i][0] || px[WS2812_G] != expected[f][i][1] || px[WS2812_B] != expected[f][i][2]) return 0;
+    }
+    return 1;
+}
+
+static void test_frames(uint8_t with_palette) {
+    LED_Playback_t p;
+
+    build(with_palette);
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 1));
+    SIM_CHECK(p.palette == (with_palette ? anim + LED_ANIM_HEADER_SIZE + 1 : NULL));
+    for (uint8_t n = 0; n < 2 * FRAMES; n++) {
+        SIM_CHECK(LED_PlaybackDecode(&p));
+        SIM_CHECK(shows(n % FRAMES));
+    }
+    SIM_CHECK_EQ(p.stats.frames, 2 * FRAMES);
+    SIM_CHECK_EQ(p.stats.pixels, 2 * (LEDS + 2 + 3));
+    SIM_CHECK_EQ(p.stats.bytes, 2 * (anim_len - (p.frames - anim)));
+    SIM_CHECK_EQ(p.stats.decode.count, 2 * FRAMES);
+
+    // Without looping it stops after the last frame
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 0));
+    for (uint8_t n = 0; n < FRAMES; n++) SIM_CHECK(LED_PlaybackDecode(&p));
+    SIM_CHECK(!LED_PlaybackDecode(&p));
+    SIM_CHECK(!p.playing);
+    SIM_CHECK(shows(FRAMES - 1));
+}
+
+// Cut the data at every length: the frames that fit decode as before, the
+// first one cut short stops playback, and nothing past the end is read
+static void test_truncated(uint8_t with_palette) {
+    uint16_t frame_end[FRAMES];
+    uint32_t bad = 0;
+
+    build(with_palette);
+    LED_Playback_t p;
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 0));
+    for (uint8_t f = 0; f < FRAMES; f++) {
+        LED_PlaybackDecode(&p);
+        frame_end[f] = p.next - anim;
+    }
+    SIM_CHECK_EQ(frame_end[FRAMES - 1], anim_len);
+    uint16_t first = p.frames - anim;
+
+    for (uint16_t size = 0; size < anim_len; size++) {
+        uint8_t fits = 0;
+        while (fits < FRAMES && frame_end[fits] <= size) fits++;
+        // Only the header bytes the size covers are valid; the rest reads as guard
+        memset(anim + size, GUARD, sizeof(anim) - size);
+        memset(ws2812_channels[0].led_buffer, 0, LEDS * 3);
+
+        // Starting needs the whole header and the first frame's tag
+        if (!LED_PlaybackStart(&p, 0, anim, size, 1)) {
+            if (size > first + 1) bad++;
+            build(with_palette);
+            continue;
+        }
+        if (size <= first) bad++;
+        uint8_t decoded = 0;
+        while (decoded <= FRAMES && LED_PlaybackDecode(&p)) {
+            if (!shows(decoded)) bad++;
+            decoded++;
+        }
+        if (decoded != fits || p.playing) bad++;
+        // The failed decode was timed too
+        if (p.stats.decode.count != decoded + 1u) bad++;
+        for (uint8_t i = 0; i < LEDS; i++) {
+            if (!memcmp(ws2812_channels[0].led_buffer[i], (uint8_t[3]){GUARD, GUARD, GUARD}, 3)) bad++;
+        }
+        build(with_palette);
+    }
+    SIM_CHECK_EQ(bad, 0);
+}
+
+// An index one past the palette, in a literal and in a run, stops playback
+// before the frame is written
+static void test_bad_index(void) {
+    LED_Playback_t p;
+    uint16_t first = LED_ANIM_HEADER_SIZE + 1 + 6 * 3;
+
+    build(1);
+    anim[first + 2] = 6;  // LED 0 of the key frame's literal
+    memset(ws2812_channels[0].led_buffer, 0, LEDS * 3);
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 1));
+    SIM_CHECK_EQ(p.entries, 6);
+    SIM_CHECK(!LED_PlaybackDecode(&p));
+    SIM_CHECK(!p.playing);
+    SIM_CHECK_EQ(ws2812_channels[0].led_buffer[0][WS2812_G], 0);
+
+    build(1);
+    anim[first + 2 + 4 + 1] = 0xFF;  // the value of the run of 64
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 1));
+    SIM_CHECK(!LED_PlaybackDecode(&p));
+    SIM_CHECK(!p.playing);
+
+    // The last entry is still fine
+    build(1);
+    anim[first + 2] = 5;
+    SIM_CHECK(LED_PlaybackStart(&p, 0, anim, anim_len, 1));
+    SIM_CHECK(LED_PlaybackDecode(&p));
+}
+
+// The encoder's output, with key frames every 4 frames in full colour and
+// one key frame with a palette, plays back the frames it was made from
+static void test_encoded(const uint8_t* data, uint32_t size, uint8_t with_palette) {
+    LED_Playback_t p;
+    uint32_t bad = 0;
+
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, ANIM_LEDS, 255));
+    SIM_CHECK(LED_PlaybackStart(&p, 0, data, size, 1));
+    SIM_CHECK((p.palette != NULL) == with_palette);
+    SIM_CHECK_EQ(p.frame_count, ANIM_FRAMES);
+    for (uint8_t n = 0; n < 2 * ANIM_FRAMES; n++) {
+        SIM_CHECK(LED_PlaybackDecode(&p));
+        for (uint16_t i = 0; i < ANIM_LEDS; i++) {
+            const uint8_t* px = ws2812_channels[0].led_buffer[i];
+            const uint8_t* rgb = anim_frames[n % ANIM_FRAMES][i];
+            if (px[WS2812_R] != rgb[0] || px[WS2812_G] != rgb[1] || px[WS2812_B] != rgb[2]) bad++;
+        }
+    }
+    SIM_CHECK_EQ(bad, 0);
+    SIM_CHECK_EQ(p.next - data, size);
+    WS2812_FreeChannel(0);
+}
+
+// A delta frame costs what it changes: two LEDs of 150 take a fraction of a
+// key frame that writes all of them
+static void test_cost(void) {
+    static uint8_t data[32 + 150 * 3];
+    const uint16_t leds = 150;
+    uint16_t len = 0;
+    LED_Playback_t p;
+
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, leds, 255));
+    memcpy(data, (uint8_t[]){'W', 'A', LED_ANIM_VERSION, 0, 0, leds, 0, 2, 0, 0}, LED_ANIM_HEADER_SIZE);
+    len = LED_ANIM_HEADER_SIZE;
+    data[len++] = LED_ANIM_KEY;
+    for (uint16_t i = 0; i < leds; i += 50) {
+        data[len++] = 0x80 | (50 - 1);
+        for (uint16_t k = 0; k < 50 * 3; k++) data[len++] = (uint8_t)(i + k);
+    }
+    data[len++] = LED_ANIM_END;
+    uint16_t key_bytes = len - LED_ANIM_HEADER_SIZE;
+    data[len++] = LED_ANIM_DELTA;
+    data[len++] = LED_ANIM_END | 2;
+    data[len++] = 0x80 | (2 - 1);
+    for (uint8_t k = 0; k < 6; k++) data[len++] = 0xA0 + k;
+    data[len++] = LED_ANIM_END;
+
+    uint64_t key = UINT64_MAX, delta = UINT64_MAX;
+    for (uint8_t run = 0; run < 7; run++) {
+        SIM_CHECK(LED_PlaybackStart(&p, 0, data, len, 1));
+        uint64_t t0 = sim_host_ns();
+        for (uint16_t n = 0; n < 1000; n++) {
+            p.next = p.frames;
+            p.frame = 0;
+            LED_PlaybackDecode(&p);
+        }
+        uint64_t t1 = sim_host_ns();
+        for (uint16_t n = 0; n < 1000; n++) {
+            p.next = p.frames + key_bytes;
+            p.frame = 1;
+            LED_PlaybackDecode(&p);
+        }
+        uint64_t t2 = sim_host_ns();
+        if (t1 - t0 < key) key = t1 - t0;
+        if (t2 - t1 < delta) delta = t2 - t1;
+    }
+    SIM_CHECK_EQ(p.stats.pixels, 1000u * leds + 1000u * 2);
+    SIM_CHECK_EQ(p.stats.bytes, 1000u * key_bytes + 1000u * (len - LED_ANIM_HEADER_SIZE - key_bytes));
+    printf("playback: key frame of %u LEDs %.1f ns, delta of 2 LEDs %.1f ns\n", leds, key / 1000.0, delta / 1000.0);
+    SIM_CHECK(delta * 4 < key);
+    WS2812_FreeChannel(0);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    test_frames(0);
+    test_frames(1);
+    test_truncated(0);
+    test_truncated(1);
+    test_bad_index();
+    WS2812_FreeChannel(0);
+    test_encoded(anim_rgb, sizeof(anim_rgb), 0);
+    test_encoded(anim_palette, sizeof(anim_palette), 1);
+    test_cost();
+    return sim_finish("playback");
+}
@@ -0,0 +1,168 @@
+// Power limiter: a frame found over budget is sent again scaled down on every
+// channel in the same commit, the estimate takes no pass of its own over the
+// pixels, and the limiter gets scaled tables for every channel even with the
+// table pool full
+#define WS2812_POWER_LIMIT 1
+#include "ws2812_sim.h"
+
+#define LEDS 10
+#define BUDGET_MA 500
+
+static const uint8_t pins[2] = {4, 2};
+
+// Frames sent on each pin since the log was cleared, and the first and last
+static sim_frame_t first[2];
+
+static int frames_on(uint8_t c, sim_frame_t* last) {
+    static sim_frame_t frames[4];
+    int n = sim_decode(GPIOC, pins[c], WS2812_SPEED_800K, frames, 4);
+    if (n > 0) {
+        first[c] = frames[0];
+        *last = frames[n - 1];
+    }
+    return n;
+}
+
+// Draw of what the two pins show, from the bytes on the wire, in mA
+static uint32_t wire_ma(const sim_frame_t* a, const sim_frame_t* b) {
+    uint32_t sum = 0;
+    for (uint16_t k = 0; k < LEDS * 3; k++) sum += a->data[k] + b->data[k];
+    return sum * 20 / 255 + 2 * LEDS;
+}
+
+static void fill(uint8_t c, uint8_t level) {
+    for (uint16_t i = 0; i < LEDS; i++) WS2812_SetPixel(c, i, level, level, level);
+}
+
+static void commit(sim_frame_t* a, sim_frame_t* b, int* sent_a, int* sent_b) {
+    sim_log_clear();
+    WS2812_Commit();
+    *sent_a = frames_on(0, a);
+    *sent_b = frames_on(1, b);
+}
+
+static void test_budget(void) {
+    static sim_frame_t a, b;
+    int sent_a, sent_b;
+    const WS2812_PowerStats_t* st = WS2812_GetPowerStats();
+
+    WS2812_SetPowerModel(20, 20, 20, 20, 1000);
+    WS2812_SetPowerBudget(BUDGET_MA);
+
+    // Dim content fits: sent as it is
+    fill(0, 40);
+    fill(1, 40);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 1 && sent_b == 1);
+    SIM_CHECK_EQ(a.data[0], 40);
+    SIM_CHECK_EQ(st->cuts, 0);
+
+    // Full white on channel 0 only: 1200mA asked for. It goes out once at
+    // full scale, then both channels are sent again scaled, channel 1 included
+    // although it did not change.
+    fill(0, 255);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK_EQ(sent_a, 2);
+    SIM_CHECK_EQ(sent_b, 1);
+    SIM_CHECK_EQ(first[0].data[0], 255);
+    SIM_CHECK(a.data[0] < 255);
+    SIM_CHECK(b.data[0] < 40);
+    SIM_CHECK(wire_ma(&a, &b) <= BUDGET_MA);
+    SIM_CHECK(wire_ma(&a, &b) >= BUDGET_MA * 9 / 10);
+    SIM_CHECK_EQ(st->cuts, 1);
+    SIM_CHECK(st->last_ma <= BUDGET_MA);
+    SIM_CHECK(st->peak_ma >= 30 * LEDS + 6 * LEDS);
+
+    // Nothing changed: nothing sent
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 0 && sent_b == 0);
+
+    // Back to dim: it goes out still scaled, the scale lets go, and both
+    // channels go out at full scale with the next commit
+    fill(0, 40);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 1 && sent_b == 0);
+    SIM_CHECK(a.data[0] < 40);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 1 && sent_b == 1);
+    SIM_CHECK_EQ(a.data[0], 40);
+    SIM_CHECK_EQ(b.data[0], 40);
+    SIM_CHECK_EQ(st->cuts, 1);
+
+    WS2812_SetPowerBudget(0);
+}
+
+// Both channels share both tables of the pool: the limiter has to rebuild
+// them all at once, as neither channel can give up a table on its own
+static void test_full_pool(void) {
+    static sim_frame_t a, b;
+    int sent_a, sent_b;
+    const WS2812_PowerStats_t* st = WS2812_GetPowerStats();
+
+    SIM_CHECK(WS2812_SetColorCorrection(0, 255, 128, 255));
+    SIM_CHECK(WS2812_SetColorCorrection(1, 255, 128, 255));
+    fill(0, 255);
+    fill(1, 255);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK_EQ(a.data[0], 128);  // G R B
+    SIM_CHECK_EQ(a.data[1], 255);
+
+    WS2812_SetPowerBudget(BUDGET_MA);
+    WS2812_MarkDirty(0);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 2 && sent_b == 1);
+    SIM_CHECK(a.data[1] < 255 && b.data[1] < 255);
+    SIM_CHECK(a.data[0] < 128 && b.data[0] < 128);
+    SIM_CHECK(wire_ma(&a, &b) <= BUDGET_MA);
+    SIM_CHECK_EQ(st->lut_failures, 0);
+
+    // A third table is refused even while the scaled tables would have room,
+    // so the limiter can always go back to full power
+    SIM_CHECK(!WS2812_SetBrightness(0, 200));
+    SIM_CHECK_EQ(ws2812_channels[0].brightness, 255);
+
+    WS2812_SetPowerBudget(0);
+    fill(0, 10);
+    commit(&a, &b, &sent_a, &sent_b);
+    commit(&a, &b, &sent_a, &sent_b);
+    SIM_CHECK(sent_a == 1 && sent_b == 1);
+    SIM_CHECK_EQ(b.data[1], 255);
+    SIM_CHECK_EQ(st->lut_failures, 0);
+}
+
+static uint32_t generated;
+
+static void counting_generator(void* state, uint16_t i, uint8_t pixel[3]) {
+    (void)state;
+    generated++;
+    pixel[0] = pixel[1] = pixel[2] = (uint8_t)i;
+}
+
+// The draw is summed while the frame is sent: a shader channel's generator
+// runs once per LED per frame, and the sums match the wire bytes
+static void test_no_extra_pass(void) {
+    static sim_frame_t frame;
+
+    SIM_CHECK(WS2812_ConfigureChannel(2, PC1, LEDS, 255));
+    SIM_CHECK(WS2812_SetShader(2, 0, counting_generator, NULL));
+    generated = 0;
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(generated, LEDS);
+    SIM_CHECK(sim_decode_one(GPIOC, 1, WS2812_SPEED_800K, &frame));
+
+    uint32_t sum = 0;
+    for (uint16_t k = 0; k < LEDS * 3; k++) sum += frame.data[k];
+    SIM_CHECK_EQ(ws2812_channels[2].power_sum[0] + ws2812_channels[2].power_sum[1] + ws2812_channels[2].power_sum[2], sum);
+    WS2812_FreeChannel(2);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, LEDS, 255));
+    test_budget();
+    test_full_pool();
+    test_no_extra_pass();
+    return sim_finish("power");
+}
@@ -0,0 +1,96 @@
+// PWM + circular DMA backend: the DMA interrupt sequence is replayed
+// half by half and the compare values that reached the timer are decoded
+#define WS2812_USE_PWM_DMA 1
+#include "ws2812_sim.h"
+
+#define LEDS 7
+#define MAX_HALVES 64
+
+// Compare values in the order the timer loaded them
+static uint8_t played[MAX_HALVES * WS2812_PWM_HALF_SIZE];
+static uint32_t played_len;
+
+// Let DMA play one half of the ring, then raise its interrupt
+static void play_half(uint8_t half_index) {
+    memcpy(played + played_len, ws2812_pwm_ring + half_index * WS2812_PWM_HALF_SIZE, WS2812_PWM_HALF_SIZE);
+    played_len += WS2812_PWM_HALF_SIZE;
+    sim_cycles += (uint64_t)WS2812_PWM_HALF_SIZE * WS2812_PWM_PERIOD;
+
+    DMA1->INTFR = half_index ? DMA1_IT_TC2 : DMA1_IT_HT2;
+    DMA1_Channel2_IRQHandler();
+    DMA1->INTFR = 0;
+}
+
+// Run the stream to its end; returns the halves played
+static uint32_t run_stream(void) {
+    uint32_t halves = 0;
+    played_len = 0;
+    while (WS2812_PWM_Busy() && halves < MAX_HALVES) {
+        play_half(halves & 1);
+        halves++;
+    }
+    return halves;
+}
+
+int main(void) {
+    uint8_t expected[LEDS * 3];
+    uint8_t decoded[LEDS * 3 + 1];
+
+    // Compare values give in-spec high times in a 1.25us period
+    SIM_CHECK_EQ(WS2812_PWM_PERIOD * 1000 / WS2812_CPU_MHZ, 1250);
+    SIM_CHECK(WS2812_PWM_T0H * 1000 / WS2812_CPU_MHZ >= SIM_T0H_MIN_NS);
+    SIM_CHECK(WS2812_PWM_T0H * 1000 / WS2812_CPU_MHZ <= WS2812_T0H_MAX_NS);
+    SIM_CHECK(WS2812_PWM_T1H * 1000 / WS2812_CPU_MHZ >= WS2812_T1H_MIN_NS);
+    SIM_CHECK(WS2812_PWM_T1H * 1000 / WS2812_CPU_MHZ <= WS2812_T1H_MAX_NS);
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannelPWM(0, LEDS, 255));
+    SIM_CHECK(!WS2812_ConfigureChannelPWM(1, LEDS, 255));
+    for (uint8_t i = 0; i < LEDS; i++) {
+        WS2812_SetPixel(0, i, 0xC0 | i, 0x0F ^ i, 0x55 + i);
+        expected[i * 3 + 0] = 0x0F ^ i;
+        expected[i * 3 + 1] = 0xC0 | i;
+        expected[i * 3 + 2] = 0x55 + i;
+    }
+
+    for (uint8_t frame = 0; frame < 2; frame++) {
+        WS2812_Commit();
+        SIM_CHECK(WS2812_PWM_Busy());
+        SIM_CHECK(TIM2->CTLR1 & TIM_CEN);
+        SIM_CHECK_EQ(DMA1_Channel2->CNTR, sizeof(ws2812_pwm_ring));
+        SIM_CHECK(DMA1_Channel2->CFGR & DMA_Mode_Circular);
+
+        uint32_t halves = run_stream();
+        SIM_CHECK(!WS2812_PWM_Busy());
+        SIM_CHECK(!(TIM2->CTLR1 & TIM_CEN));
+        SIM_CHECK_EQ(TIM2->CH1CVR, 0);
+        SIM_CHECK_EQ(DMA1_Channel2->CFGR, 0);
+
+        // Data halves, then one whole low half so the last bit is out
+        uint32_t data_halves = (LEDS + WS2812_PWM_RING_LEDS - 1) / WS2812_PWM_RING_LEDS;
+        SIM_CHECK_EQ(halves, data_halves + 1);
+
+        // Every slot is a 0, a 1 or low; the bits end at the first low slot
+        uint32_t bits = 0;
+        uint8_t bad = 0;
+        memset(decoded, 0, sizeof(decoded));
+        for (uint32_t k = 0; k < played_len; k++) {
+            if (played[k] == 0) {
+                for (; k < played_len; k++) bad |= played[k] != 0;
+                break;
+            }
+            if (played[k] != WS2812_PWM_T0H && played[k] != WS2812_PWM_T1H) bad = 1;
+            if (bits < sizeof(decoded) * 8) decoded[bits >> 3] |= (played[k] == WS2812_PWM_T1H) << (7 - (bits & 7));
+            bits++;
+        }
+        SIM_CHECK(!bad);
+        SIM_CHECK_EQ(bits, LEDS * 24);
+        SIM_CHECK_MEM(decoded, expected, LEDS * 3);
+        SIM_CHECK(WS2812_GetFrameTimeUs(0) >= LEDS * 24 * 1250 / 1000);
+
+        // The next frame waits for the latch
+        WS2812_SetPixel(0, 0, 0xC0, 0x0F, 0x55);
+    }
+
+    return sim_finish("pwm");
+}
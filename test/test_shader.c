@@ -0,0 +1,101 @@
+// Shader channels: the LED_EFFECT_SHADER_* effects put the same bytes on the
+// wire as the buffered effects of the same name, and generator calls are timed
+// against WS2812_SHADER_BUDGET_NS, which keeps the low gap between LEDs legal
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+#define LEDS 40
+
+// Wire bytes of the last frame on a pin; 0 if none was sent
+static int last_frame(uint8_t pin, sim_frame_t* out) {
+    static sim_frame_t frames[8];
+    int n = sim_decode(GPIOC, pin, WS2812_SPEED_800K, frames, 8);
+    if (n < 1) return 0;
+    *out = frames[n - 1];
+    return 1;
+}
+
+// Run a shader effect on channel 0 and the buffered one on channel 1 for a
+// few steps, and compare what reaches the two pins after each
+static void compare_effect(const LED_Effect_t* shader, const LED_Effect_t* buffered, LED_EffectParams_t params) {
+    static sim_frame_t a, b;
+    uint32_t mismatches = 0, frames = 0;
+
+    LED_SetEffect(0, shader, params);
+    LED_SetEffect(1, buffered, params);
+    for (uint8_t step = 0; step < 5; step++) {
+        sim_log_clear();
+        LED_RunSlot(0, get_animation_ticks());
+        LED_RunSlot(1, get_animation_ticks());
+        WS2812_MarkDirty(0);
+        WS2812_MarkDirty(1);
+        WS2812_Commit();
+        if (!last_frame(4, &a) || !last_frame(2, &b)) continue;
+        frames++;
+        if (a.bits != LEDS * 24 || b.bits != LEDS * 24 || a.bad_high || memcmp(a.data, b.data, LEDS * 3)) mismatches++;
+        sim_cycles += (uint64_t)params.speed * (WS2812_F_CPU / 1000);
+    }
+    SIM_CHECK_EQ(frames, 5);
+    SIM_CHECK_EQ(mismatches, 0);
+    LED_StopEffect(0);
+    LED_StopEffect(1);
+}
+
+static void test_effects(void) {
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, LEDS, 255));
+    SIM_CHECK(WS2812_SetShader(0, 0, WS2812_ShaderOff, NULL));
+
+    compare_effect(&LED_EFFECT_SHADER_RAINBOWS, &LED_EFFECT_RAINBOWS, LED_PARAMS(0, 0, 0, 10, 12));
+    compare_effect(&LED_EFFECT_SHADER_RAINBOW_CYCLE, &LED_EFFECT_RAINBOW_CYCLE, LED_PARAMS(0, 0, 0, 10, 0));
+    compare_effect(&LED_EFFECT_SHADER_THEATER_CHASE, &LED_EFFECT_THEATER_CHASE, LED_PARAMS(0, 200, 40, 10, 0));
+    compare_effect(&LED_EFFECT_SHADER_PULSE, &LED_EFFECT_PULSE, LED_PARAMS(255, 0, 128, 10, 0));
+
+    WS2812_FreeChannel(0);
+    WS2812_FreeChannel(1);
+}
+
+// Generator that takes burn modelled cycles per LED
+static void slow_generator(void* state, uint16_t i, uint8_t pixel[3]) {
+    sim_cycles += *(const uint32_t*)state;
+    pixel[0] = pixel[1] = pixel[2] = (uint8_t)i;
+}
+
+static void test_budget(void) {
+    static sim_frame_t frame;
+    uint32_t burn;
+
+    SIM_CHECK(WS2812_SHADER_BUDGET_TICKS > 2);
+    SIM_CHECK(WS2812_ConfigureChannel(2, PC1, LEDS, 255));
+    SIM_CHECK(WS2812_SetShader(2, 0, slow_generator, &burn));
+
+    // Just inside the budget, SysTick read included: nothing counted, and the
+    // line is never low long enough for the strip to latch
+    burn = (WS2812_SHADER_BUDGET_TICKS - 2) * 8;
+    WS2812_ResetShaderStats();
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK(sim_decode_one(GPIOC, 1, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bits, LEDS * 24);
+    SIM_CHECK(SIM_CYCLES_TO_NS(frame.max_low) < WS2812_TL_MAX_NS);
+    SIM_CHECK_EQ(WS2812_GetShaderStats()->overruns, 0);
+    SIM_CHECK(WS2812_GetShaderStats()->max_ticks <= WS2812_SHADER_BUDGET_TICKS);
+    SIM_CHECK(WS2812_GetShaderStats()->max_ticks >= WS2812_SHADER_BUDGET_TICKS - 2);
+
+    // Over it: every call is counted
+    burn = (WS2812_SHADER_BUDGET_TICKS + 1) * 8;
+    WS2812_ResetShaderStats();
+    WS2812_MarkDirty(2);
+    WS2812_Commit();
+    SIM_CHECK_EQ(WS2812_GetShaderStats()->overruns, LEDS);
+    SIM_CHECK(WS2812_GetShaderStats()->max_ticks > WS2812_SHADER_BUDGET_TICKS);
+
+    WS2812_FreeChannel(2);
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    test_effects();
+    test_budget();
+    return sim_finish("shader");
+}
@@ -0,0 +1,168 @@
+// Skip unchanged frames and low power idle: a redrawn but identical frame is
+// not sent and is counted, a one-byte change and changes that cancel out in a
+// plain sum are sent, the frame hash is a standard CRC-32, and LED_Sleep()
+// ends at the next frame, or early when the stream's idle-line interrupt comes
+#define WS2812_SKIP_UNCHANGED 1
+#define WS2812_LOW_POWER 1
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+#include <LED_Stream.h>
+
+#define LEDS 8
+
+static uint8_t grb[LEDS * 3];
+
+static void set(uint8_t i, uint8_t r, uint8_t g, uint8_t b) {
+    WS2812_SetPixel(0, i, r, g, b);
+    grb[i * 3 + 0] = g;
+    grb[i * 3 + 1] = r;
+    grb[i * 3 + 2] = b;
+}
+
+// Commit, and check what reached the pin: nothing, or the whole frame
+static void commit(uint8_t sent) {
+    sim_frame_t frame;
+    sim_log_clear();
+    WS2812_Commit();
+    if (!sent) {
+        SIM_CHECK_EQ(sim_log_len, 0);
+        return;
+    }
+    SIM_CHECK(sim_decode_one(GPIOC, 4, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bits, LEDS * 24);
+    SIM_CHECK_MEM(frame.data, grb, sizeof(grb));
+}
+
+static void test_skip(void) {
+    const WS2812_CommitStats_t* st = &ws2812_commit_stats;
+
+    for (uint8_t i = 0; i < LEDS; i++) set(i, 10 * i, 20, 200 - i);
+    commit(1);
+    SIM_CHECK_EQ(st->sent, 1);
+
+    // Redrawn the same: dirty, hashed, not sent
+    for (uint8_t i = 0; i < LEDS; i++) set(i, 10 * i, 20, 200 - i);
+    SIM_CHECK(ws2812_channels[0].dirty);
+    commit(0);
+    SIM_CHECK_EQ(st->sent, 1);
+    SIM_CHECK_EQ(st->unchanged, 1);
+    SIM_CHECK(!ws2812_channels[0].dirty);
+
+    // One byte one step up
+    set(5, 50, 20, 196);
+    commit(1);
+    SIM_CHECK_EQ(st->sent, 2);
+    SIM_CHECK_EQ(st->unchanged, 1);
+
+    // +1 -1 -1 +1 on four bytes in a row (G B of LED 2, R G of LED 3): the
+    // same sum and weighted sum, which a Fletcher-style hash misses
+    set(2, 20, 21, 197);
+    set(3, 29, 21, 197);
+    commit(1);
+    SIM_CHECK_EQ(st->sent, 3);
+
+    // Not redrawn at all: skipped without a hash
+    commit(0);
+    SIM_CHECK_EQ(st->skipped, 1);
+    SIM_CHECK_EQ(st->unchanged, 1);
+
+    // A colour setting changes the wire bytes without touching the pixels
+    WS2812_SetColorOrder(0, WS2812_ORDER_RGB);
+    for (uint8_t i = 0; i < LEDS; i++) {
+        uint8_t g = grb[i * 3];
+        grb[i * 3] = grb[i * 3 + 1];
+        grb[i * 3 + 1] = g;
+    }
+    WS2812_MarkDirty(0);
+    commit(1);
+    SIM_CHECK_EQ(st->sent, 4);
+    WS2812_SetColorOrder(0, WS2812_ORDER_GRB);
+
+    // A direct send leaves the hash unknown: the next commit sends
+    WS2812_SendChannel(&ws2812_channels[0]);
+    for (uint8_t i = 0; i < LEDS; i++) set(i, 0, 0, 0);
+    for (uint8_t i = 0; i < LEDS; i++) set(i, 10 * i, 20, 200 - i);
+    commit(1);
+}
+
+// The CRC-32 check value of "123456789"
+static void test_crc(void) {
+    uint32_t crc = 0xFFFFFFFF;
+    WS2812_HashBytes(&crc, (const uint8_t*)"123456789", 9);
+    SIM_CHECK_EQ(~crc, 0xCBF43926u);
+}
+
+// The simulated UART delivers bytes into the stream ring at 1Mbaud
+static void receive(const uint8_t* data, uint16_t len) {
+    static uint16_t pos;
+    for (uint16_t i = 0; i < len; i++) {
+        led_stream_ring[pos] = data[i];
+        pos = (pos + 1) & (LED_STREAM_RING_SIZE - 1);
+        DMA1_Channel5->CNTR = LED_STREAM_RING_SIZE - pos;
+        sim_cycles += SIM_NS_TO_CYCLES(10000);
+    }
+}
+
+static uint8_t idle_irqs;
+
+static void line_idle(void) {
+    idle_irqs++;
+    USART1_IRQHandler();
+}
+
+static void test_sleep(void) {
+    const WS2812_SleepStats_t* st = WS2812_GetSleepStats();
+    uint32_t period = WS2812_US_TO_TICKS(20000);
+    uint8_t frame[7 + 3] = {'W', 'S', 0, 0, 3, 0 ^ 0 ^ 3 ^ LED_STREAM_HEADER_KEY, 0x11, 0x22, 0x33, 0x66};
+
+    LED_StreamInit(1000000);
+    SIM_CHECK(USART1->CTLR1 & USART_CTLR1_IDLEIE);
+    LED_SchedulerInit(50);
+    SIM_CHECK(LED_FrameDue());
+    WS2812_ResetSleepStats();
+
+    // Nothing comes in: asleep until the next frame is due
+    uint32_t start = WS2812_Now();
+    LED_Sleep();
+    SIM_CHECK(WS2812_Now() - start >= period - 1);
+    SIM_CHECK(LED_FrameDue());
+    SIM_CHECK_EQ(st->sleeps, 1);
+    SIM_CHECK_EQ(st->early, 0);
+
+    // A frame arrives and the line goes idle 1ms into the sleep: the core
+    // wakes then, long before the next frame, and the frame is parsed and sent
+    receive(frame, sizeof(frame));
+    start = WS2812_Now();
+    sim_wake_at = sim_cycles + SIM_NS_TO_CYCLES(1000000);
+    sim_wake_irqn = USART1_IRQn;
+    sim_wake_handler = line_idle;
+    LED_Sleep();
+    SIM_CHECK_EQ(idle_irqs, 1);
+    SIM_CHECK_EQ(st->early, 1);
+    uint32_t slept = WS2812_Now() - start;
+    SIM_CHECK(slept >= WS2812_US_TO_TICKS(1000) && slept < WS2812_US_TO_TICKS(1100));
+    SIM_CHECK(!LED_FrameDue());
+
+    sim_log_clear();
+    SIM_CHECK_EQ(LED_StreamPoll(), 1);
+    sim_frame_t out;
+    SIM_CHECK(sim_decode_one(GPIOC, 4, WS2812_SPEED_800K, &out));
+    SIM_CHECK_MEM(out.data, ((uint8_t[]){0x22, 0x11, 0x33}), 3);
+
+    // With the USART interrupt off in the NVIC the same line goes unseen
+    sim_nvic_enabled &= ~(1ULL << USART1_IRQn);
+    sim_wake_at = sim_cycles + SIM_NS_TO_CYCLES(1000000);
+    LED_Sleep();
+    SIM_CHECK_EQ(idle_irqs, 1);
+    SIM_CHECK(LED_FrameDue());
+    sim_wake_at = 0;
+}
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    test_crc();
+    test_skip();
+    test_sleep();
+    return sim_finish("skip");
+}
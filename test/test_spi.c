@@ -0,0 +1,88 @@
+// SPI + DMA backend: the encoder against a reference decoder of the SPI bit
+// stream, and a frame through the DMA registers and completion interrupt
+#define WS2812_USE_SPI_DMA 1
+#include "ws2812_sim.h"
+
+#define LEDS 12
+
+// Decode SPI bytes back into WS2812 bytes: every WS2812 bit is three SPI bits,
+// 100 for a 0 and 110 for a 1. Returns the bytes decoded, -1 on a bad pattern.
+static int spi_decode(const uint8_t* spi, uint32_t spi_len, uint8_t* out) {
+    uint32_t bits = spi_len * 8;
+    uint32_t n = 0;
+
+    for (uint32_t b = 0; b + 3 <= bits; b += 3, n++) {
+        uint8_t s[3];
+        for (uint8_t k = 0; k < 3; k++) {
+            s[k] = (spi[(b + k) >> 3] >> (7 - ((b + k) & 7))) & 1;
+        }
+        if (s[0] != 1 || s[2] != 0) return -1;
+        if ((n & 7) == 0) out[n >> 3] = 0;
+        out[n >> 3] |= s[1] << (7 - (n & 7));
+    }
+    return n / 8;
+}
+
+static uint8_t callback_channel = 0xFF;
+
+static void on_sent(uint8_t channel_idx) {
+    callback_channel = channel_idx;
+}
+
+int main(void) {
+    uint8_t src[256];
+    uint8_t spi[256 * 3];
+    uint8_t back[256];
+
+    // Every byte value round trips through the encoder
+    for (uint16_t i = 0; i < 256; i++) src[i] = i;
+    SIM_CHECK_EQ(WS2812_SPI_Encode(src, 256, spi), 256 * 3);
+    SIM_CHECK_EQ(spi_decode(spi, 256 * 3, back), 256);
+    SIM_CHECK_MEM(back, src, 256);
+
+    // High times at 3MHz: one SPI bit (333ns) for a 0, two (667ns) for a 1
+    uint32_t spi_hz = WS2812_F_CPU / (2u << ((WS2812_SPI_PRESCALER >> 3) & 7));
+    SIM_CHECK_EQ(spi_hz, 3000000);
+    SIM_CHECK(1000000000u / spi_hz >= SIM_T0H_MIN_NS && 1000000000u / spi_hz <= WS2812_T0H_MAX_NS);
+    SIM_CHECK(2000000000u / spi_hz >= WS2812_T1H_MIN_NS && 2000000000u / spi_hz <= WS2812_T1H_MAX_NS);
+
+    // A frame: reset bytes, then the pixels in GRB order, handed to DMA1 channel 3
+    static uint8_t buffer[WS2812_SPI_BUFFER_SIZE(LEDS)];
+    uint8_t expected[LEDS * 3];
+
+    WS2812_TimeInit();
+    SIM_CHECK(!WS2812_ConfigureChannelSPI(0, LEDS, 255, buffer, sizeof(buffer) - 1));
+    SIM_CHECK(WS2812_ConfigureChannelSPI(0, LEDS, 255, buffer, sizeof(buffer)));
+    WS2812_SPI_SetCallback(on_sent);
+    for (uint8_t i = 0; i < LEDS; i++) {
+        WS2812_SetPixel(0, i, 0x10 + i, 0xE0 - i, i * 21);
+        expected[i * 3 + 0] = 0xE0 - i;
+        expected[i * 3 + 1] = 0x10 + i;
+        expected[i * 3 + 2] = i * 21;
+    }
+
+    WS2812_Commit();
+    SIM_CHECK(WS2812_SPI_Busy());
+    SIM_CHECK_EQ(DMA1_Channel3->CNTR, sizeof(buffer));
+    SIM_CHECK((DMA1_Channel3->CFGR & (DMA_CFGR1_EN | DMA_IT_TC | DMA_DIR_PeripheralDST)) ==
+              (DMA_CFGR1_EN | DMA_IT_TC | DMA_DIR_PeripheralDST));
+    for (uint8_t i = 0; i < WS2812_SPI_RESET_BYTES; i++) SIM_CHECK_EQ(buffer[i], 0);
+    SIM_CHECK_EQ(spi_decode(buffer + WS2812_SPI_RESET_BYTES, LEDS * 9, back), LEDS * 3);
+    SIM_CHECK_MEM(back, expected, LEDS * 3);
+    SIM_CHECK_EQ(sim_log_len, 0);
+
+    // Transfer complete: the channel is free again and the callback runs
+    sim_cycles += SIM_NS_TO_CYCLES(LEDS * 24 * 1000);
+    DMA1->INTFR = DMA1_IT_TC3;
+    DMA1_Channel3_IRQHandler();
+    DMA1->INTFR = 0;
+    SIM_CHECK(!WS2812_SPI_Busy());
+    SIM_CHECK_EQ(DMA1_Channel3->CFGR, 0);
+    SIM_CHECK_EQ(callback_channel, 0);
+    SIM_CHECK(WS2812_GetFrameTimeUs(0) >= LEDS * 24);
+
+    // A second SPI channel is refused
+    SIM_CHECK(!WS2812_ConfigureChannelSPI(1, LEDS, 255, buffer, sizeof(buffer)));
+
+    return sim_finish("spi");
+}
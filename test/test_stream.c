@@ -0,0 +1,226 @@
+// UART stream: the parser gives the same result for any chunking of the
+// input, a dropped frame is not sent (and with WS2812_DOUBLE_BUFFER, built
+// a second time by the Makefile, leaves no trace), and LED_StreamPoll()
+// follows the DMA ring, including frames across the wrap, a full ring and an
+// overrun
+#include "ws2812_sim.h"
+#include <LED_Stream.h>
+
+#define LEDS 5
+
+// Append one frame for channel to out; returns its length
+static uint16_t make_frame(uint8_t* out, uint8_t channel, const uint8_t* payload, uint16_t len, uint8_t corrupt) {
+    uint8_t sum = 0;
+    out[0] = 'W';
+    out[1] = 'S';
+    out[2] = channel;
+    out[3] = len >> 8;
+    out[4] = len & 0xFF;
+    out[5] = channel ^ out[3] ^ out[4] ^ LED_STREAM_HEADER_KEY;
+    for (uint16_t i = 0; i < len; i++) {
+        out[6 + i] = payload[i];
+        sum += payload[i];
+    }
+    out[6 + len] = sum + corrupt;
+    return 7 + len;
+}
+
+// R G B of every LED of channel 0
+static void channel_rgb(uint8_t* rgb) {
+    for (uint8_t i = 0; i < LEDS; i++) {
+        rgb[i * 3 + 0] = ws2812_channels[0].led_buffer[i][WS2812_R];
+        rgb[i * 3 + 1] = ws2812_channels[0].led_buffer[i][WS2812_G];
+        rgb[i * 3 + 2] = ws2812_channels[0].led_buffer[i][WS2812_B];
+    }
+}
+
+static void test_chunks(void) {
+    uint8_t first[LEDS * 3], second[LEDS * 3], rgb[LEDS * 3];
+    uint8_t input[256];
+    uint16_t len = 0;
+
+    for (uint8_t i = 0; i < LEDS * 3; i++) {
+        first[i] = 0x10 + i;
+        second[i] = 0xF0 - i;
+    }
+    // Noise with a false header, a good frame, a bad checksum, a bad header, a
+    // frame for a missing channel, then the second good frame
+    static const uint8_t noise[] = {0x00, 'W', 'W', 'S', 0x07, 0x00, 0x03, 0x12};
+    memcpy(input, noise, sizeof(noise));
+    len += sizeof(noise);
+    len += make_frame(input + len, 0, first, LEDS * 3, 0);
+    len += make_frame(input + len, 0, second, LEDS * 3, 1);
+    uint16_t bad_header = len;
+    len += make_frame(input + len, 0, second, 3, 0);
+    input[bad_header + 5] ^= 0xFF;
+    len += make_frame(input + len, 5, second, 3, 0);
+    len += make_frame(input + len, 0, second, LEDS * 3, 0);
+
+    for (uint16_t chunk = 1; chunk <= len; chunk += chunk < 20 ? 1 : 37) {
+        LED_StreamParser_t p = {0};
+        uint8_t frames = 0;
+        uint8_t first_ok = 0;
+        uint16_t at = 0;
+
+        LED_StreamReset(&p);
+        memset(ws2812_channels[0].led_buffer, 0, LEDS * 3);
+        while (at < len) {
+            uint16_t n = len - at < chunk ? len - at : chunk;
+            at += LED_StreamFeed(&p, input + at, n);
+            if (p.completed) {
+                // Feeding stops at the end of each frame, before the next one writes
+                channel_rgb(rgb);
+                if (++frames == 1) first_ok = !memcmp(rgb, first, sizeof(rgb));
+            }
+        }
+        channel_rgb(rgb);
+        SIM_CHECK_EQ(frames, 2);
+        SIM_CHECK(first_ok);
+        SIM_CHECK_MEM(rgb, second, sizeof(rgb));
+        SIM_CHECK_EQ(p.stats.frames, 2);
+        SIM_CHECK_EQ(p.stats.dropped, 4);
+        SIM_CHECK_EQ(p.stats.bytes, len);
+    }
+}
+
+// A bad checksum after two and a third LEDs: the channel is not marked dirty,
+// and with double buffering the LEDs it reached get the committed frame back
+static void test_drop(void) {
+    uint8_t good[LEDS * 3], bad[LEDS * 3], rgb[LEDS * 3];
+    uint8_t input[LEDS * 3 + 7];
+    LED_StreamParser_t p = {0};
+
+    for (uint8_t i = 0; i < LEDS * 3; i++) {
+        good[i] = 0x30 + i;
+        bad[i] = 0xC0 + i;
+    }
+    uint16_t len = make_frame(input, 0, good, LEDS * 3, 0);
+    SIM_CHECK_EQ(LED_StreamFeed(&p, input, len), len);
+    SIM_CHECK(p.completed);
+    WS2812_Commit();
+
+    len = make_frame(input, 0, bad, 7, 1);
+    SIM_CHECK_EQ(LED_StreamFeed(&p, input, len), len);
+    SIM_CHECK(!p.completed);
+    SIM_CHECK_EQ(p.stats.dropped, 1);
+    SIM_CHECK(!ws2812_channels[0].dirty);
+    channel_rgb(rgb);
+#if WS2812_DOUBLE_BUFFER
+    SIM_CHECK_MEM(rgb, good, sizeof(rgb));
+#else
+    SIM_CHECK_MEM(rgb, bad, 7);
+    SIM_CHECK_MEM(rgb + 7, good + 7, sizeof(rgb) - 7);
+#endif
+
+    // Nothing goes out for it
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(sim_log_len, 0);
+}
+
+// Bytes the simulated UART has delivered through DMA channel 5
+static uint16_t dma_pos;
+
+// Let DMA write bytes into the ring, raising its half and full interrupts
+static void receive(const uint8_t* data, uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        led_stream_ring[dma_pos] = data[i];
+        dma_pos = (dma_pos + 1) & (LED_STREAM_RING_SIZE - 1);
+        DMA1_Channel5->CNTR = LED_STREAM_RING_SIZE - dma_pos;
+
+        uint32_t flag = dma_pos == LED_STREAM_HALF ? DMA1_IT_HT5 : dma_pos == 0 ? DMA1_IT_TC5 : 0;
+        if (flag) {
+            DMA1->INTFR = flag;
+            DMA1_Channel5_IRQHandler();
+            DMA1->INTFR = 0;
+        }
+        sim_cycles += SIM_NS_TO_CYCLES(10000);  // 10 bits at 1Mbaud
+    }
+}
+
+static void test_ring(void) {
+    uint8_t pixels[LEDS * 3], rgb[LEDS * 3];
+    uint8_t frame[LEDS * 3 + 7];
+    const LED_StreamStats_t* stats = LED_StreamGetStats();
+
+    LED_StreamInit(1000000);
+    dma_pos = 0;
+    SIM_CHECK(DMA1_Channel5->CFGR & DMA_IT_HT);
+    SIM_CHECK(DMA1_Channel5->CFGR & DMA_IT_TC);
+    SIM_CHECK_EQ(LED_StreamPoll(), 0);
+
+    // Frames one after another, across the wrap several times over
+    uint16_t frame_len = 0;
+    uint32_t sent = 0, mismatches = 0;
+    for (uint16_t f = 0; f < 3 * LED_STREAM_RING_SIZE / (LEDS * 3 + 7); f++) {
+        for (uint8_t i = 0; i < LEDS * 3; i++) pixels[i] = f * 7 + i;
+        frame_len = make_frame(frame, 0, pixels, LEDS * 3, 0);
+        receive(frame, frame_len);
+        sent++;
+        sim_log_clear();
+        if (LED_StreamPoll() != 1) mismatches++;
+        channel_rgb(rgb);
+        if (memcmp(rgb, pixels, sizeof(rgb))) mismatches++;
+    }
+    SIM_CHECK_EQ(mismatches, 0);
+    SIM_CHECK_EQ(stats->frames, sent);
+    SIM_CHECK_EQ(stats->overruns, 0);
+
+    // Auto commit: the last frame went out on the wire
+    sim_frame_t out;
+    uint8_t grb[LEDS * 3];
+    for (uint8_t i = 0; i < LEDS; i++) {
+        grb[i * 3 + 0] = pixels[i * 3 + 1];
+        grb[i * 3 + 1] = pixels[i * 3 + 0];
+        grb[i * 3 + 2] = pixels[i * 3 + 2];
+    }
+    SIM_CHECK(sim_decode_one(GPIOC, 4, WS2812_SPEED_800K, &out));
+    SIM_CHECK_MEM(out.data, grb, sizeof(grb));
+
+    // A ring filled right up, with nothing overwritten, is all parsed
+    uint8_t fill[LED_STREAM_RING_SIZE];
+    uint16_t used = 0;
+    while (used + frame_len <= LED_STREAM_RING_SIZE) used += make_frame(fill + used, 0, pixels, LEDS * 3, 0);
+    memset(fill + used, 0, LED_STREAM_RING_SIZE - used);
+    receive(fill, LED_STREAM_RING_SIZE);
+    SIM_CHECK_EQ(LED_StreamPoll(), used / frame_len);
+    SIM_CHECK_EQ(stats->overruns, 0);
+
+    // The DMA laps the parser in the middle of a frame: one overrun, the
+    // frame is dropped, and the next frame after it gets through
+    uint32_t dropped = stats->dropped;
+    receive(frame, 10);
+    SIM_CHECK_EQ(LED_StreamPoll(), 0);
+    receive(frame + 10, frame_len - 10);
+    receive(fill, LED_STREAM_RING_SIZE);
+    SIM_CHECK_EQ(LED_StreamPoll(), 0);
+    SIM_CHECK_EQ(stats->overruns, 1);
+    SIM_CHECK_EQ(stats->dropped, dropped + 1);
+
+    for (uint8_t i = 0; i < LEDS * 3; i++) pixels[i] = 0xA0 ^ i;
+    frame_len = make_frame(frame, 0, pixels, LEDS * 3, 0);
+    receive(frame, frame_len);
+    SIM_CHECK_EQ(LED_StreamPoll(), 1);
+    channel_rgb(rgb);
+    SIM_CHECK_MEM(rgb, pixels, sizeof(rgb));
+    SIM_CHECK_EQ(stats->overruns, 1);
+
+    // Exactly one lap: the DMA position is back where the parser stopped, and
+    // only the counted halves show the ring was overwritten
+    receive(frame, frame_len);
+    receive(fill, LED_STREAM_RING_SIZE);
+    SIM_CHECK_EQ(LED_StreamPoll(), 0);
+    SIM_CHECK_EQ(stats->overruns, 2);
+}
+
+int main(void) {
+    // The default ring holds what 1Mbaud delivers while a full arena is sent
+    SIM_CHECK(LED_STREAM_RING_SIZE >= (uint32_t)WS2812_ARENA_SIZE / 3 * 30 / 10 + 5);
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    test_chunks();
+    test_drop();
+    test_ring();
+    return sim_finish("stream");
+}
@@ -0,0 +1,38 @@
+// SysTick time base, the SDK delay shims and the frame scheduler
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+int main(void) {
+    WS2812_TimeInit();
+    SIM_CHECK(SysTick->CTLR & 1);
+
+    // Milliseconds follow the modelled clock
+    uint32_t ms = WS2812_Millis();
+    sim_cycles += (uint64_t)WS2812_F_CPU / 1000 * 25;
+    SIM_CHECK_EQ(WS2812_Millis() - ms, 25);
+
+    // Delay_Ms runs on the driver's counter and leaves it running
+    ms = WS2812_Millis();
+    Delay_Ms(3);
+    SIM_CHECK_EQ(WS2812_Millis() - ms, 3);
+    SIM_CHECK(SysTick->CTLR & 1);
+
+    // A stopped counter (as left by the SDK's own delay) is started again
+    sim_systick_regs.CTLR = 0;
+    uint64_t start = sim_cycles;
+    Delay_Us(100);
+    SIM_CHECK(SysTick->CTLR & 1);
+    SIM_CHECK(sim_cycles - start >= SIM_NS_TO_CYCLES(100000));
+
+    // The scheduler hands out frames at the set rate whatever the loop speed
+    uint32_t due = 0;
+    LED_SchedulerInit(50);
+    for (uint32_t i = 0; i < 100000; i++) {
+        if (LED_FrameDue()) due++;
+        sim_cycles += WS2812_F_CPU / 100000 - SIM_SYSTICK_READ_CYCLES;
+    }
+    SIM_CHECK(due >= 49 && due <= 51);
+    SIM_CHECK_EQ(led_scheduler.missed, 0);
+
+    return sim_finish("time");
+}
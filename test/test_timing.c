@@ -0,0 +1,61 @@
+// Generated bit timing: the NOP counts for the configured clock, and the
+// high times and bit period they give on the modelled wire. The Makefile
+// builds this at 48MHz and 24MHz, and checks 8MHz fails to compile.
+#include "ws2812_sim.h"
+
+int main(void) {
+    // Cycle counts expected at each supported clock
+#if WS2812_F_CPU == 48000000
+    SIM_CHECK_EQ(WS2812_T0H_CYCLES, 17);
+    SIM_CHECK_EQ(WS2812_T1H_CYCLES, 44);
+    SIM_CHECK_EQ(WS2812_BIT_CYCLES, 60);
+    SIM_CHECK_EQ(WS2812_T0H_NOPS, 13);
+    SIM_CHECK_EQ(WS2812_T1H_NOPS, 40);
+    SIM_CHECK_EQ(WS2812_T0L_NOPS, 12);
+    SIM_CHECK_EQ(WS2812_T1L_NOPS, 0);
+    SIM_CHECK_EQ(WS2812_400K_T0H_NOPS, 20);
+    SIM_CHECK_EQ(WS2812_400K_T1H_NOPS, 54);
+#elif WS2812_F_CPU == 24000000
+    SIM_CHECK_EQ(WS2812_T0H_CYCLES, 9);
+    SIM_CHECK_EQ(WS2812_T1H_CYCLES, 22);
+    SIM_CHECK_EQ(WS2812_BIT_CYCLES, 30);
+    SIM_CHECK_EQ(WS2812_T0H_NOPS, 5);
+    SIM_CHECK_EQ(WS2812_T1H_NOPS, 18);
+    SIM_CHECK_EQ(WS2812_T0L_NOPS, 0);
+    SIM_CHECK_EQ(WS2812_T1L_NOPS, 0);
+    SIM_CHECK_EQ(WS2812_400K_T0H_NOPS, 8);
+    SIM_CHECK_EQ(WS2812_400K_T1H_NOPS, 25);
+#else
+#error "test_timing: no expected values for this clock"
+#endif
+
+    // On the wire: high times are exactly the generated cycle counts, and
+    // both lie in the chip's windows
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, 4, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PA2, 4, 255));
+    SIM_CHECK(WS2812_SetChipProfile(1, WS2812_CHIP_WS2811));
+    for (uint8_t i = 0; i < 4; i++) {
+        WS2812_SetPixel(0, i, 0xA5, 0x5A, 0x0F);
+        WS2812_SetPixel(1, i, 0xA5, 0x5A, 0x0F);
+    }
+    WS2812_Commit();
+
+    sim_frame_t frame;
+    SIM_CHECK(sim_decode_one(GPIOC, 4, WS2812_SPEED_800K, &frame));
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_EQ(frame.high_min[0], WS2812_T0H_CYCLES);
+    SIM_CHECK_EQ(frame.high_max[0], WS2812_T0H_CYCLES);
+    SIM_CHECK_EQ(frame.high_min[1], WS2812_T1H_CYCLES);
+    SIM_CHECK_EQ(frame.high_max[1], WS2812_T1H_CYCLES);
+
+    SIM_CHECK(sim_decode_one(GPIOA, 2, WS2812_SPEED_400K, &frame));
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_EQ(frame.high_min[0], WS2811_T0H_CYCLES);
+    SIM_CHECK_EQ(frame.high_min[1], WS2811_T1H_CYCLES);
+
+    printf("timing: %uMHz T0H %u T1H %u bit %u cycles, NOPs %u/%u/%u/%u\n", WS2812_CPU_MHZ,
+           WS2812_T0H_CYCLES, WS2812_T1H_CYCLES, WS2812_BIT_CYCLES,
+           WS2812_T0H_NOPS, WS2812_T1H_NOPS, WS2812_T0L_NOPS, WS2812_T1L_NOPS);
+    return sim_finish("timing");
+}
@@ -0,0 +1,122 @@
+// Double buffering and crossfades: the fade reaches the wire blended, and a
+// transition that ends while the PWM DMA is streaming another channel waits
+// for the stream before the arena moves that channel's buffers
+#define WS2812_USE_PWM_DMA 1
+#define WS2812_DOUBLE_BUFFER 1
+// Busy-waits on a DMA backend play the PWM ring out half by half
+static void play_half(void);
+#define WS2812_DMA_WAIT(busy) while (busy) play_half()
+#include "ws2812_sim.h"
+#include <LED_Functions.h>
+
+#define PWM_LEDS 7
+#define MAX_HALVES 64
+
+static uint8_t played[MAX_HALVES * WS2812_PWM_HALF_SIZE];
+static uint32_t played_len;
+static uint32_t halves_played;
+
+// Let DMA play the next half of the ring, then raise its interrupt
+static void play_half(void) {
+    uint8_t half_index = halves_played & 1;
+    if (played_len + WS2812_PWM_HALF_SIZE <= sizeof(played)) {
+        memcpy(played + played_len, ws2812_pwm_ring + half_index * WS2812_PWM_HALF_SIZE, WS2812_PWM_HALF_SIZE);
+        played_len += WS2812_PWM_HALF_SIZE;
+    }
+    sim_cycles += (uint64_t)WS2812_PWM_HALF_SIZE * WS2812_PWM_PERIOD;
+    halves_played++;
+
+    DMA1->INTFR = half_index ? DMA1_IT_TC2 : DMA1_IT_HT2;
+    DMA1_Channel2_IRQHandler();
+    DMA1->INTFR = 0;
+}
+
+// Bytes carried by the played compare values, up to the first low slot
+static uint32_t decode_played(uint8_t* out, uint32_t max) {
+    uint32_t bits = 0;
+    memset(out, 0, max);
+    for (uint32_t k = 0; k < played_len && played[k]; k++, bits++) {
+        if (bits < max * 8 && played[k] == WS2812_PWM_T1H) out[bits >> 3] |= 0x80 >> (bits & 7);
+    }
+    return bits / 8;
+}
+
+// Last frame sent on the bit-bang channel, as G, R, B of its first LED
+static int last_pixel(uint8_t grb[3]) {
+    static sim_frame_t frames[4];
+    int n = sim_decode(GPIOC, 4, WS2812_SPEED_800K, frames, 4);
+    if (n < 1) return 0;
+    memcpy(grb, frames[n - 1].data, 3);
+    return 1;
+}
+
+static uint32_t ms_cycles(uint32_t ms) {
+    return ms * (WS2812_F_CPU / 1000);
+}
+
+int main(void) {
+    uint8_t grb[3];
+    uint8_t expected[PWM_LEDS * 3];
+    uint8_t decoded[PWM_LEDS * 3 + 1];
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC4, 4, 255));
+    LED_SetEffect(1, &LED_EFFECT_FILL, LED_PARAMS(255, 0, 0, 0, 0));
+    LED_RunSlot(1, get_animation_ticks());
+    WS2812_Commit();
+    SIM_CHECK(last_pixel(grb) && grb[0] == 0 && grb[1] == 255 && grb[2] == 0);
+
+    // Fade to blue over 100ms; the snapshot lands after channel 1's buffers
+    LED_SetEffectTransition(1, &LED_EFFECT_FILL, LED_PARAMS(0, 0, 255, 0, 0), 100);
+    SIM_CHECK(LED_InTransition(1));
+    SIM_CHECK(led_transitions[1].snapshot != NULL);
+
+    // A PWM channel set up now sits after the snapshot in the arena
+    SIM_CHECK(WS2812_ConfigureChannelPWM(0, PWM_LEDS, 255));
+    SIM_CHECK((uint8_t*)ws2812_channels[0].front_buffer > led_transitions[1].snapshot);
+    for (uint8_t i = 0; i < PWM_LEDS; i++) {
+        WS2812_SetPixel(0, i, 0x80 | i, 0x3C ^ i, 0x01 + i);
+        expected[i * 3 + 0] = 0x3C ^ i;
+        expected[i * 3 + 1] = 0x80 | i;
+        expected[i * 3 + 2] = 0x01 + i;
+    }
+
+    // Half way: the wire shows half red, half blue
+    sim_cycles += ms_cycles(50);
+    LED_RunSlot(1, get_animation_ticks());
+    sim_log_clear();
+    played_len = 0;
+    halves_played = 0;
+    WS2812_Commit();
+    SIM_CHECK(last_pixel(grb));
+    SIM_CHECK_EQ(grb[0], 0);
+    SIM_CHECK(grb[1] >= 120 && grb[1] <= 135);
+    SIM_CHECK(grb[2] >= 120 && grb[2] <= 135);
+    SIM_CHECK(LED_InTransition(1));
+
+    // The PWM frame is still streaming when the fade ends on a commit that
+    // only sends channel 1. Freeing the snapshot moves channel 0's buffers,
+    // so the free has to let the stream finish first.
+    SIM_CHECK(WS2812_PWM_Busy());
+    uint32_t halves_before = halves_played;
+    sim_cycles += ms_cycles(60);
+    WS2812_MarkDirty(1);
+    WS2812_Commit();
+    SIM_CHECK(!LED_InTransition(1));
+    SIM_CHECK(led_transitions[1].snapshot == NULL);
+    SIM_CHECK(halves_played > halves_before);
+    SIM_CHECK(!WS2812_PWM_Busy());
+    SIM_CHECK(last_pixel(grb) && grb[0] == 0 && grb[1] == 0 && grb[2] == 255);
+
+    // The stream played the whole frame, and the moved buffers kept it
+    SIM_CHECK_EQ(decode_played(decoded, sizeof(decoded)), PWM_LEDS * 3);
+    SIM_CHECK_MEM(decoded, expected, PWM_LEDS * 3);
+    for (uint8_t i = 0; i < PWM_LEDS; i++) {
+        const uint8_t* px = ws2812_channels[0].front_buffer[i];
+        SIM_CHECK(px[WS2812_G] == expected[i * 3] && px[WS2812_R] == expected[i * 3 + 1] && px[WS2812_B] == expected[i * 3 + 2]);
+    }
+
+    WS2812_FreeChannel(0);
+    WS2812_FreeChannel(1);
+    return sim_finish("transition");
+}
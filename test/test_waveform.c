@@ -0,0 +1,76 @@
+// Bit-bang waveform: pixels go out as the right bytes with in-spec pulses
+#include "ws2812_sim.h"
+
+#define LEDS 10
+
+static void expect_frame(GPIO_TypeDef* port, uint8_t pin, uint8_t speed, const uint8_t* expected, uint32_t bytes) {
+    sim_frame_t frame;
+    SIM_CHECK(sim_decode_one(port, pin, speed, &frame));
+    SIM_CHECK_EQ(frame.bits, bytes * 8);
+    SIM_CHECK_EQ(frame.bad_high, 0);
+    SIM_CHECK_MEM(frame.data, expected, bytes);
+}
+
+int main(void) {
+    uint8_t expected[LEDS * 3];
+
+    WS2812_TimeInit();
+    SIM_CHECK(WS2812_ConfigureChannel(0, PC4, LEDS, 255));
+    SIM_CHECK(WS2812_ConfigureChannel(1, PC2, LEDS, 255));
+    SIM_CHECK(WS2812_SetChipProfile(1, WS2812_CHIP_WS2811));
+
+    for (uint8_t i = 0; i < LEDS; i++) {
+        WS2812_SetPixel(0, i, i * 20, 255 - i * 20, i * 7);
+        WS2812_SetPixel(1, i, 255 - i, i, 0x5A);
+    }
+
+    // WS2812: GRB at 800kHz
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[0]);
+    for (uint8_t i = 0; i < LEDS; i++) {
+        expected[i * 3 + 0] = 255 - i * 20;
+        expected[i * 3 + 1] = i * 20;
+        expected[i * 3 + 2] = i * 7;
+    }
+    expect_frame(GPIOC, 4, WS2812_SPEED_800K, expected, sizeof(expected));
+
+    // Modelled bit period: the configured one, stretched where a 1 bit's low
+    // phase is shorter than the loop work, plus the interrupt windows
+    sim_frame_t frame;
+    sim_decode_one(GPIOC, 4, WS2812_SPEED_800K, &frame);
+    uint64_t bit_ns = SIM_CYCLES_TO_NS((frame.end - frame.start) / (frame.bits - 1));
+    uint64_t longest = WS2812_CYCLES_TO_NS(WS2812_MAX(WS2812_BIT_CYCLES, WS2812_T1H_CYCLES + WS2812_BIT_LOOP_CYCLES));
+    SIM_CHECK(bit_ns >= WS2812_BIT_NS && bit_ns <= longest + 50);
+    SIM_CHECK(WS2812_GetFrameTimeUs(0) >= LEDS * 24 * WS2812_BIT_NS / 1000);
+
+    // WS2811: RGB at 400kHz
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[1]);
+    for (uint8_t i = 0; i < LEDS; i++) {
+        expected[i * 3 + 0] = 255 - i;
+        expected[i * 3 + 1] = i;
+        expected[i * 3 + 2] = 0x5A;
+    }
+    expect_frame(GPIOC, 2, WS2812_SPEED_400K, expected, sizeof(expected));
+
+    // Two frames on one channel are separated by at least the reset time
+    sim_frame_t frames[3];
+    sim_log_clear();
+    WS2812_SendChannel(&ws2812_channels[0]);
+    WS2812_SendChannel(&ws2812_channels[0]);
+    SIM_CHECK_EQ(sim_decode(GPIOC, 4, WS2812_SPEED_800K, frames, 3), 2);
+    SIM_CHECK(SIM_CYCLES_TO_NS(frames[1].start - frames[0].end) >= ws2812_channels[0].reset_us * 1000u);
+
+    // Commit only sends channels that changed
+    WS2812_Commit();
+    sim_log_clear();
+    WS2812_SetPixel(1, 0, 1, 2, 3);
+    WS2812_Commit();
+    SIM_CHECK_EQ(sim_decode(GPIOC, 4, WS2812_SPEED_800K, frames, 3), 0);
+    SIM_CHECK_EQ(sim_decode(GPIOC, 2, WS2812_SPEED_400K, frames, 3), 1);
+    sim_log_clear();
+    WS2812_Commit();
+    SIM_CHECK_EQ(sim_decode(GPIOC, 4, WS2812_SPEED_800K, frames, 3), 0);
+
+    return sim_finish("waveform");
+}
@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+"""Encode a raw RGB frame dump into a compressed animation for LED_Playback.h.
+
+The input is frames of --leds pixels, 3 bytes each (R G B), back to back.
+The output is a C header with the animation as a const array, which the
+compiler places in flash. Each frame stores only the LEDs that changed since
+the frame before, as skips, runs and literals (key frames store every LED).
+With a palette, values are 1-byte indices instead of 3 bytes.
+
+The encoder decodes its own output to check it. It prints the compression
+ratio and the decode work per frame to stderr.
+
+Example:
+    tools/ws2812_anim_encode.py show.rgb --leds 60 --frame-ms 40 -o src/show_anim.h
+"""
+
+import argparse
+import os
+import re
+import sys
+
+MAGIC = b"WA"
+VERSION = 1
+FLAG_PALETTE = 0x01
+KEY = ord("K")
+DELTA = ord("D")
+OP_SKIP, OP_RUN, OP_LITERAL, OP_END = 0, 1, 2, 3
+END = 0xC0
+MAX_COUNT = 64
+
+# Decoder cost model for the estimate (CH32V003 cycles, measured figures vary
+# with the compiler): per frame, per op and per LED written
+FRAME_CYCLES = 60
+OP_CYCLES = 20
+PIXEL_CYCLES = 10
+PALETTE_PIXEL_CYCLES = 4
+F_CPU = 48000000
+
+
+def op(code, count):
+    return bytes([(code << 6) | (count - 1)])
+
+
+def skip_ops(count):
+    """Ops that skip count LEDs: long skips of n*64, then one short skip."""
+    out = bytearray()
+    while count >= MAX_COUNT:
+        n = min(count // MAX_COUNT, 63)
+        out.append(END | n)
+        count -= n * MAX_COUNT
+    if count:
+        out += op(OP_SKIP, count)
+    return bytes(out)
+
+
+def encode_frame(cur, prev, value_size):
+    """Encode one frame of values (bytes objects) against prev (None for a key frame).
+
+    Returns the frame bytes and (ops, LEDs written).
+    """
+    out = bytearray([KEY if prev is None else DELTA])
+    n = len(cur)
+    ops = 0
+    written = 0
+
+    def unchanged(i):
+        return prev is not None and cur[i] == prev[i]
+
+    def unchanged_len(i):
+        j = i
+        while j < n and unchanged(j):
+            j += 1
+        return j - i
+
+    def run_len(i):
+        r = 1
+        while i + r < n and r < MAX_COUNT and cur[i + r] == cur[i]:
+            r += 1
+        return r
+
+    i = 0
+    while i < n:
+        if unchanged(i):
+            k = unchanged_len(i)
+            if i + k == n:
+                break  # the end of the frame leaves the rest as it is
+            skips = skip_ops(k)
+            out += skips
+            ops += len(skips)
+            i += k
+            continue
+
+        r = run_len(i)
+        if r >= 2:
+            out += op(OP_RUN, r) + cur[i]
+            ops += 1
+            written += r
+            i += r
+            continue
+
+        # Literal until a run starts or an unchanged stretch is cheaper to skip
+        j = i + 1
+        while j < n and j - i < MAX_COUNT:
+            if run_len(j) >= 2:
+                break
+            if unchanged(j) and unchanged_len(j) * value_size > 2:
+                break
+            j += 1
+        out += op(OP_LITERAL, j - i) + b"".join(cur[i:j])
+        ops += 1
+        written += j - i
+        i = j
+
+    out.append(END)
+    return bytes(out), (ops + 1, written)
+
+
+def encode(frames, leds, frame_ms, palette, key_interval):
+    """Encode frames (lists of 3-byte colours). Returns (data, per-frame stats)."""
+    header = bytearray(MAGIC) + bytes([VERSION, FLAG_PALETTE if palette else 0])
+    header += leds.to_bytes(2, "big") + len(frames).to_bytes(2, "big") + frame_ms.to_bytes(2, "big")
+
+    if palette:
+        index = {c: bytes([i]) for i, c in enumerate(palette)}
+        header.append(len(palette) - 1)
+        header += b"".join(palette)
+        frames = [[index[c] for c in f] for f in frames]
+        value_size = 1
+    else:
+        value_size = 3
+
+    data = bytearray(header)
+    stats = []
+    prev = None
+    for f, cur in enumerate(frames):
+        key = f == 0 or (key_interval and f % key_interval == 0)
+        frame, (ops, written) = encode_frame(cur, None if key else prev, value_size)
+        data += frame
+        stats.append((len(frame), ops, written, key))
+        prev = cur
+    return bytes(data), stats
+
+
+def decode(data):
+    """Reference decoder, the same walk as LED_PlaybackDecode(). Returns the frames."""
+    assert data[:2] == MAGIC and data[2] == VERSION
+    leds = int.from_bytes(data[4:6], "big")
+    count = int.from_bytes(data[6:8], "big")
+    pos = 10
+    palette = None
+    if data[3] & FLAG_PALETTE:
+        entries = data[pos] + 1
+        pos += 1
+        palette = [data[pos + 3 * e:pos + 3 * e + 3] for e in range(entries)]
+        pos += 3 * entries
+    size = 1 if palette else 3
+
+    def value(at):
+        v = data[at:at + size]
+        return palette[v[0]] if palette else v
+
+    pixels = [b"\0\0\0"] * leds
+    frames = []
+    for _ in range(count):
+        assert data[pos] in (KEY, DELTA)
+        pos += 1
+        led = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            if b == END:
+                break
+            code, n = b >> 6, (b & 0x3F) + 1
+            if code == OP_END:
+                led += (n - 1) * MAX_COUNT
+            elif code == OP_SKIP:
+                led += n
+            elif code == OP_RUN:
+                v = value(pos)
+                pos += size
+                pixels[led:led + n] = [v] * n
+                led += n
+            else:
+                for k in range(n):
+                    pixels[led + k] = value(pos)
+                    pos += size
+                led += n
+            assert led <= leds
+        frames.append(list(pixels))
+    return frames
+
+
+def c_array(name, data, source, leds, frames, frame_ms, raw):
+    lines = [
+        "// Generated by tools/ws2812_anim_encode.py from %s" % source,
+        "// %d LEDs, %d frames, %d ms per frame: %d bytes (%d raw, %.1f:1)"
+        % (leds, frames, frame_ms, len(data), raw, raw / len(data)),
+        "// Play with LED_PlaybackStart(&playback, channel, %s, sizeof(%s), loop) from LED_Playback.h" % (name, name),
+        "static const uint8_t %s[%d] = {" % (name, len(data)),
+    ]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02X" % b for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", help="raw RGB frame dump (R G B per LED, frame after frame)")
+    parser.add_argument("--leds", type=int, required=True, help="LEDs per frame")
+    parser.add_argument("--frame-ms", type=int, default=33, help="frame period in ms (default 33)")
+    parser.add_argument("--palette", choices=("auto", "on", "off"), default="auto",
+                        help="palette indices instead of RGB values; auto uses them when smaller (default)")
+    parser.add_argument("--key-interval", type=int, default=0,
+                        help="a key frame every N frames (default 0: only the first)")
+    parser.add_argument("--name", help="C array name (default: from the input file name)")
+    parser.add_argument("-o", "--output", help="C header to write (default: stdout)")
+    args = parser.parse_args()
+
+    if not 0 < args.leds < 65536 or not 0 <= args.frame_ms < 65536:
+        parser.error("--leds must be 1-65535 and --frame-ms 0-65535")
+
+    with open(args.input, "rb") as f:
+        raw = f.read()
+    frame_size = args.leds * 3
+    if not raw or len(raw) % frame_size:
+        parser.error("input size %d is not a whole number of %d-byte frames" % (len(raw), frame_size))
+    if len(raw) // frame_size > 65535:
+        parser.error("too many frames (max 65535)")
+
+    frames = [[raw[o + 3 * i:o + 3 * i + 3] for i in range(args.leds)] for o in range(0, len(raw), frame_size)]
+
+    # Palette ordered by use, so the common colours come first
+    use = {}
+    for f in frames:
+        for c in f:
+            use[c] = use.get(c, 0) + 1
+    palette = sorted(use, key=lambda c: -use[c]) if len(use) <= 256 else None
+    if args.palette == "on" and palette is None:
+        parser.error("%d colours, a palette holds at most 256" % len(use))
+
+    data, stats = encode(frames, args.leds, args.frame_ms, None, args.key_interval)
+    if palette and args.palette != "off":
+        pal_data, pal_stats = encode(frames, args.leds, args.frame_ms, palette, args.key_interval)
+        if args.palette == "on" or len(pal_data) < len(data):
+            data, stats = pal_data, pal_stats
+        else:
+            palette = None
+    else:
+        palette = None
+
+    if decode(data) != frames:
+        sys.exit("internal error: the encoded animation does not decode to the input")
+
+    name = args.name or re.sub(r"\W", "_", os.path.splitext(os.path.basename(args.input))[0])
+    if not re.match(r"[A-Za-z_]", name):
+        name = "anim_" + name
+    text = c_array(name, data, os.path.basename(args.input), args.leds, len(frames), args.frame_ms, len(raw))
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+    # Report
+    pixel_cycles = PIXEL_CYCLES + (PALETTE_PIXEL_CYCLES if palette else 0)
+    cycles = [FRAME_CYCLES + ops * OP_CYCLES + written * pixel_cycles for _, ops, written, _ in stats]
+    sizes = [s[0] for s in stats]
+    written = [s[2] for s in stats]
+    worst = max(range(len(stats)), key=lambda f: cycles[f])
+    err = sys.stderr
+    err.write("%d frames of %d LEDs, %s\n" % (len(frames), args.leds,
+              "palette of %d colours" % len(palette) if palette else "RGB values (%d colours)" % len(use)))
+    err.write("size: %d bytes, raw %d bytes, ratio %.1f:1\n" % (len(data), len(raw), len(raw) / len(data)))
+    err.write("key frames: %d\n" % sum(1 for s in stats if s[3]))
+    err.write("bytes per frame: avg %.1f, max %d\n" % (sum(sizes) / len(sizes), max(sizes)))
+    err.write("LEDs written per frame: avg %.1f, max %d\n" % (sum(written) / len(written), max(written)))
+    err.write("decode estimate: avg %d cycles, max %d cycles (%.1f us at %d MHz, frame %d)\n"
+              % (sum(cycles) / len(cycles), cycles[worst], cycles[worst] * 1e6 / F_CPU, F_CPU // 1000000, worst))
+
+
+if __name__ == "__main__":
+    main()